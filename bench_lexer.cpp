@@ -0,0 +1,169 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include "eop_corpus.hpp"
+#include "eop_lex_stream.hpp"
+#include "exp_parser.hpp"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>
+#define EOP_CYCLE_COUNTER 1
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define EOP_CYCLE_COUNTER 1
+#endif
+
+/*
+    bench_lexer measures the lexer one token class at a time: each input holds tokens of a
+    single class, so the time goes to one recognizer - is_identifier_or_keyword, is_number,
+    is_string, is_compound, is_simple or is_comment - and to what every token pays: skipping
+    the space before it, the recognizers tried ahead of its own, and handing it out.
+
+    usage: bench_lexer [--class <name>] [--size <bytes>] [--seed <n>] [--iterations <n>]
+
+        --class <name>      identifiers, numbers, strings, compound, simple, comments, or all
+                            (the default) for each in turn
+        --size <bytes>      of each input (1 MiB)
+        --seed <n>          of the token generator (1)
+        --iterations <n>    of each measurement, of which the fastest is reported (10)
+
+    Cycles are read from the time stamp counter where there is one. It ticks at a constant
+    rate, near the nominal clock of the processor, rather than with the core as its frequency
+    scales, so runs are only comparable with the frequency fixed. Elsewhere nanoseconds are
+    reported in place of cycles.
+*/
+
+namespace {
+
+typedef boost::chrono::steady_clock steady_clock_t;
+
+#if defined(EOP_CYCLE_COUNTER)
+
+const char* const cycle_unit_k = "cycles";
+
+inline boost::uint64_t cycles() { return __rdtsc(); }
+
+#else
+
+const char* const cycle_unit_k = "ns";
+
+inline boost::uint64_t cycles()
+{
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+        steady_clock_t::now().time_since_epoch()).count();
+}
+
+#endif
+
+struct sample_t
+{
+    boost::uint64_t cycles_m;
+    double          seconds_m;
+};
+
+//  Lexes content to the end, counting its tokens.
+
+sample_t lex(const std::string& content, std::size_t& tokens)
+{
+    std::istringstream  stream(content);
+    eop::lex_stream_t   lexer(stream, adobe::line_position_t("bench"));
+    sample_t            result;
+
+    lexer.set_keyword_extension_lookup(&eop::keyword_lookup);
+    tokens = 0;
+
+    steady_clock_t::time_point  start(steady_clock_t::now());
+    boost::uint64_t             start_cycles(cycles());
+
+    while (lexer.get().first != adobe::eof_k) ++tokens;
+
+    result.cycles_m = cycles() - start_cycles;
+    result.seconds_m = boost::chrono::duration<double>(steady_clock_t::now() - start).count();
+    return result;
+}
+
+/*
+    Measures one token class, printing one row: the size of the input, its tokens, and the
+    cycles per byte and per token and the throughput of the fastest of the iterations. Comments
+    are counted as tokens though the lexer skips them, and the "," between strings as tokens of
+    their own.
+*/
+
+void measure(eop::token_class_t token_class, std::size_t size, boost::uint32_t seed,
+        std::size_t iterations)
+{
+    std::string content;
+    std::size_t generated(eop::generate_tokens(token_class, size, seed, content));
+    std::size_t tokens(0);
+    sample_t    best = { 0, 0 };
+
+    for (std::size_t n(0); n != iterations; ++n) {
+        sample_t sample(lex(content, tokens));
+        if (!n || sample.cycles_m < best.cycles_m) best = sample;
+    }
+
+    if (token_class == eop::comment_tokens_k) tokens = generated;
+
+    std::printf("%-12s %10lu %10lu %12.2f %12.2f %10.2f\n", eop::token_class_name(token_class),
+        static_cast<unsigned long>(content.size()), static_cast<unsigned long>(tokens),
+        double(best.cycles_m) / double(content.size()),
+        tokens ? double(best.cycles_m) / double(tokens) : 0.0,
+        best.seconds_m > 0 ? double(content.size()) / best.seconds_m / 1e6 : 0.0);
+    std::fflush(stdout);
+}
+
+} // namespace
+
+int main (int argc, char * const argv[]) {
+    const char* const*  first(argv + 1);
+    const char* const*  last(argv + argc);
+
+    eop::token_class_t  token_class(eop::identifier_tokens_k);
+    bool                all_classes(true);
+    std::size_t         size(1024 * 1024);
+    boost::uint32_t     seed(1);
+    std::size_t         iterations(10);
+
+    while (last - first >= 2) {
+        std::string option(*first);
+
+        if (option == "--class") {
+            all_classes = std::strcmp(first[1], "all") == 0;
+            if (!all_classes && !eop::find_token_class(first[1], token_class)) {
+                std::cerr << "Unknown token class " << first[1] << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "--size") size = std::strtoul(first[1], 0, 10);
+        else if (option == "--seed") seed = std::strtoul(first[1], 0, 10);
+        else if (option == "--iterations") iterations = std::strtoul(first[1], 0, 10);
+        else break;
+
+        first += 2;
+    }
+
+    if (first != last) {
+        std::cerr << "Unknown option " << *first << std::endl;
+        return 1;
+    }
+    if (!iterations) iterations = 1;
+
+    std::string per_byte(std::string(cycle_unit_k) + "/byte");
+    std::string per_token(std::string(cycle_unit_k) + "/token");
+
+    std::printf("%-12s %10s %10s %12s %12s %10s\n", "class", "bytes", "tokens",
+        per_byte.c_str(), per_token.c_str(), "MB/s");
+
+    for (std::size_t n(0); n != eop::token_class_count_k; ++n) {
+        if (all_classes) token_class = eop::token_class_t(n);
+        measure(token_class, size, seed, iterations);
+        if (!all_classes) break;
+    }
+
+    return 0;
+}
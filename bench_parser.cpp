@@ -0,0 +1,298 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/ref.hpp>
+#include "eop_bench.hpp"
+#include "eop_corpus.hpp"
+#include "eop_expression_table.hpp"
+#include "eop_lex_stream.hpp"
+#include "eop_token_file.hpp"
+
+/*
+    bench_parser measures the throughput of the lexer alone (lex_stream_t, with the parser's
+    keywords) and of expression_parser::parse(), in bytes, tokens and declarations per second.
+
+    usage: bench_parser [options] [file...]
+
+        --shape <name>      the corpus to generate: mixed, templates, expressions, statements,
+                            comments, structs, or all (the default) for each in turn
+        --size <bytes>      of each corpus (1 MiB)
+        --seed <n>          of the corpus generator (1); the same seed gives the same corpus
+        --depth <n>         of nesting in the corpus (4)
+        --length <n>        of expressions and blocks in the corpus (12)
+        --iterations <n>    of each measurement, of which the fastest is reported (5)
+        --pipeline          lexes ahead on a second thread during the parse
+        --skip-bodies       parses declarations without their bodies
+        --replay            parses from the tokens of a token file, lexed beforehand, so the
+                            parse leaves out lexing
+        --allocations       reports the allocations of a parse by phase, and the peak bytes
+                            held; needs a build with EOP_ENABLE_ALLOCATION_ACCOUNTING
+        --intern            reports the memory the expressions of a parse hold as postfix
+                            arrays, and as nodes of an expression table
+        --write <file>      writes the corpus of the shape given (mixed for all) to file, and
+                            measures nothing
+
+    Files given are measured in place of a generated corpus. The input is read into memory
+    first, so only lexing and parsing are timed. A generated corpus which does not parse
+    cleanly is an error of the generator, and makes the exit code non-zero.
+*/
+
+namespace {
+
+bool read_file(const char* file, std::string& result)
+{
+    std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+    if (!stream) return false;
+    result.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+void report_rate(double count, double seconds, double unit)
+{
+    std::printf(" %13.2f", seconds > 0 ? count / seconds / unit : 0.0);
+}
+
+/*
+    Prints the allocations of one parse of content by phase, in count, count per KiB of input
+    and bytes, and the most bytes held at once.
+*/
+
+void report_allocations(const std::string& content, const eop::parse_options_t& options)
+{
+    eop::parse_result_t         result;
+    eop::allocation_report_t    report(eop::count_parse_allocations(content, options, result));
+    double                      kilobytes(double(content.size()) / 1024);
+
+    for (std::size_t n(0); n <= eop::allocation_phase_count_k; ++n) {
+        bool                        total(n == eop::allocation_phase_count_k);
+        eop::allocation_counts_t    counts(total ? report.total() : report.phases_m[n]);
+
+        std::printf("  %-18s %10lu allocations %10.1f per KiB %12lu bytes\n",
+            total ? "total" : eop::allocation_phase_name(eop::allocation_phase_t(n)),
+            static_cast<unsigned long>(counts.count_m),
+            kilobytes > 0 ? double(counts.count_m) / kilobytes : 0.0,
+            static_cast<unsigned long>(counts.bytes_m));
+    }
+    std::printf("  %-18s %10lu bytes\n", "peak", static_cast<unsigned long>(report.peak_m));
+}
+
+/*
+    Prints the expressions of one parse of content, then what they hold kept each as its own
+    postfix array and kept as the nodes of an expression table, in values or nodes and bytes.
+    The bytes of the arrays leave out those of strings held by their values.
+*/
+
+struct interning_t
+{
+    interning_t() : expressions_m(0), values_m(0) { }
+
+    void operator()(const adobe::array_t& expression)
+    {
+        ++expressions_m;
+        values_m += expression.size();
+        roots_m.push_back(table_m.intern(expression));
+    }
+
+    eop::expression_table_t                     table_m;
+    std::size_t                                 expressions_m;
+    std::size_t                                 values_m;
+    std::vector<const eop::expression_node_t*>  roots_m;
+};
+
+void report_interning(const std::string& content, const eop::parse_options_t& options)
+{
+    std::istringstream                      stream(content);
+    eop::expression_parser                  parser(stream, adobe::line_position_t("bench"));
+    eop::declaration_callback_suite_t       callbacks;
+    interning_t                             interning;
+
+    callbacks.expression_proc_m = boost::ref(interning);
+    parser.set_options(options);
+    parser.parse(callbacks);
+
+    std::size_t array_bytes(interning.expressions_m * sizeof(adobe::array_t)
+        + interning.values_m * sizeof(adobe::any_regular_t));
+    std::size_t table_bytes(interning.table_m.bytes()
+        + interning.roots_m.size() * sizeof(const eop::expression_node_t*));
+
+    std::printf("  %-18s %10lu\n", "expressions",
+        static_cast<unsigned long>(interning.expressions_m));
+    std::printf("  %-18s %10lu values %16lu bytes\n", "postfix arrays",
+        static_cast<unsigned long>(interning.values_m), static_cast<unsigned long>(array_bytes));
+    std::printf("  %-18s %10lu nodes %17lu bytes\n", "expression table",
+        static_cast<unsigned long>(interning.table_m.size()),
+        static_cast<unsigned long>(table_bytes));
+}
+
+//  Lexes content into a token file, through memory.
+
+void write_tokens(const std::string& content, eop::token_file_t& tokens)
+{
+    std::istringstream  in(content);
+    std::stringstream   file;
+    eop::lex_stream_t   lexer(in, adobe::line_position_t("bench"));
+
+    lexer.set_keyword_extension_lookup(&eop::keyword_lookup);
+    eop::write_token_file(lexer, "bench", file);
+    tokens.read(file);
+}
+
+/*
+    Measures content, printing one row: its size, tokens and declarations, then for the lexer
+    and the parser the throughput of the fastest of the iterations, and with allocations set
+    the allocations of the parse, and with intern its expressions interned. With replay set the
+    parser replays the tokens of content rather than lexing it. Returns the number of
+    diagnostics of the parse.
+*/
+
+std::size_t measure(const std::string& label, const std::string& content,
+        const eop::parse_options_t& options, std::size_t iterations, bool allocations,
+        bool intern, bool replay)
+{
+    std::size_t         tokens(0);
+    double              lex_time(0);
+    double              parse_time(0);
+    eop::parse_result_t result;
+    eop::token_file_t   token_file;
+
+    for (std::size_t n(0); n != iterations; ++n) {
+        double time(eop::time_lex(content, tokens));
+        if (!n || time < lex_time) lex_time = time;
+    }
+    if (replay) write_tokens(content, token_file);
+    for (std::size_t n(0); n != iterations; ++n) {
+        double time(replay ? eop::time_replay(token_file, options, result)
+            : eop::time_parse(content, options, result));
+        if (!n || time < parse_time) parse_time = time;
+    }
+
+    double bytes(double(content.size()));
+    double declarations(double(result.declarations_m.size()));
+
+    std::printf("%-12s %10lu %10lu %8lu", label.c_str(),
+        static_cast<unsigned long>(content.size()), static_cast<unsigned long>(tokens),
+        static_cast<unsigned long>(result.declarations_m.size()));
+    report_rate(bytes, lex_time, 1e6);
+    report_rate(double(tokens), lex_time, 1e6);
+    report_rate(bytes, parse_time, 1e6);
+    report_rate(double(tokens), parse_time, 1e6);
+    report_rate(declarations, parse_time, 1e3);
+    std::printf("\n");
+    if (allocations) report_allocations(content, options);
+    if (intern) report_interning(content, options);
+    std::fflush(stdout);
+
+    if (!result.diagnostics_m.empty()) {
+        const eop::diagnostic_t& first(result.diagnostics_m.front());
+
+        std::cerr << label << ": " << result.diagnostics_m.size()
+            << " diagnostics, the first at line " << first.line_number_m << ": "
+            << first.message_m << std::endl;
+    }
+    return result.diagnostics_m.size();
+}
+
+} // namespace
+
+int main (int argc, char * const argv[]) {
+    const char* const*  first(argv + 1);
+    const char* const*  last(argv + argc);
+
+    eop::corpus_options_t   corpus;
+    eop::parse_options_t    options;
+    bool                    all_shapes(true);
+    std::size_t             iterations(5);
+    const char*             output_file(0);
+    bool                    allocations(false);
+    bool                    intern(false);
+    bool                    replay(false);
+
+    while (first != last) {
+        std::string option(*first);
+
+        if (option == "--pipeline") { options.pipeline_m = true; ++first; continue; }
+        if (option == "--skip-bodies") { options.skip_bodies_m = true; ++first; continue; }
+        if (option == "--allocations") { allocations = true; ++first; continue; }
+        if (option == "--intern") { intern = true; ++first; continue; }
+        if (option == "--replay") { replay = true; ++first; continue; }
+        if (last - first < 2) break;
+
+        if (option == "--shape") {
+            all_shapes = std::strcmp(first[1], "all") == 0;
+            if (!all_shapes && !eop::find_corpus_shape(first[1], corpus.shape_m)) {
+                std::cerr << "Unknown shape " << first[1] << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "--size") corpus.size_m = std::strtoul(first[1], 0, 10);
+        else if (option == "--seed") corpus.seed_m = std::strtoul(first[1], 0, 10);
+        else if (option == "--depth") corpus.depth_m = std::strtoul(first[1], 0, 10);
+        else if (option == "--length") corpus.length_m = std::strtoul(first[1], 0, 10);
+        else if (option == "--iterations") iterations = std::strtoul(first[1], 0, 10);
+        else if (option == "--write") output_file = first[1];
+        else break;
+
+        first += 2;
+    }
+
+    if (!iterations) iterations = 1;
+    if (!corpus.length_m) corpus.length_m = 1;
+    if (allocations && !eop::allocation_accounting_enabled()) {
+        std::cerr << "Allocation accounting is not built in" << std::endl;
+        return 1;
+    }
+
+    if (output_file) {
+        std::string     content;
+        std::ofstream   stream(output_file, std::ios_base::out | std::ios_base::binary);
+
+        if (all_shapes) corpus.shape_m = eop::mixed_k;
+        eop::generate_corpus(corpus, content);
+        if (!stream.write(content.data(), content.size())) {
+            std::cerr << "Cannot write " << output_file << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::printf("%-12s %10s %10s %8s %13s %13s %13s %13s %13s\n", "input", "bytes", "tokens",
+        "decls", "lex MB/s", "lex Mtok/s", "parse MB/s", "parse Mtok/s", "parse Kdecl/s");
+
+    std::size_t diagnostics(0);
+
+    if (first != last) {
+        for (; first != last; ++first) {
+            std::string content;
+
+            if (!read_file(*first, content)) {
+                std::cerr << "Cannot open " << *first << std::endl;
+                continue;
+            }
+            try {
+                measure(*first, content, options, iterations, allocations, intern, replay);
+            } catch (const std::exception& error) {
+                std::cerr << *first << ": " << error.what() << std::endl;
+            }
+        }
+        return 0;
+    }
+
+    for (std::size_t n(0); n != eop::corpus_shape_count_k; ++n) {
+        std::string content;
+
+        if (all_shapes) corpus.shape_m = eop::corpus_shape_t(n);
+        eop::generate_corpus(corpus, content);
+        diagnostics += measure(eop::corpus_shape_name(corpus.shape_m), content, options,
+            iterations, allocations, intern, replay);
+        if (!all_shapes) break;
+    }
+
+    return diagnostics ? 1 : 0;
+}
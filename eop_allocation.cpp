@@ -0,0 +1,228 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <cstdlib>
+#include <new>
+
+#include <boost/atomic.hpp>
+
+#include "eop_allocation.hpp"
+
+/*************************************************************************************************/
+
+#if defined(EOP_ENABLE_ALLOCATION_ACCOUNTING)
+
+    #if defined(_MSC_VER)
+        #define EOP_THREAD_LOCAL __declspec(thread)
+    #else
+        #define EOP_THREAD_LOCAL __thread
+    #endif
+
+#endif
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+const char* const phase_names_g[allocation_phase_count_k] = {
+    "other", "lexing", "expression", "class index", "diagnostics"
+};
+
+} // namespace
+
+/*************************************************************************************************/
+
+const char* allocation_phase_name(allocation_phase_t phase)
+{
+    return phase_names_g[phase];
+}
+
+allocation_counts_t allocation_report_t::total() const
+{
+    allocation_counts_t result;
+
+    for (std::size_t n(0); n != allocation_phase_count_k; ++n) {
+        result.count_m += phases_m[n].count_m;
+        result.bytes_m += phases_m[n].bytes_m;
+    }
+    return result;
+}
+
+/*************************************************************************************************/
+
+#if defined(EOP_ENABLE_ALLOCATION_ACCOUNTING)
+
+/*
+    The counters are updated from every thread, so they are atomic; relaxed order suffices as
+    they are only read once the work counted is done. They have static storage and a trivial
+    constructor, so they are zero before any allocation, however early.
+*/
+
+namespace {
+
+struct counters_t
+{
+    boost::atomic<std::size_t> count_m;
+    boost::atomic<std::size_t> bytes_m;
+};
+
+counters_t                  phases_g[allocation_phase_count_k];
+boost::atomic<std::size_t>  held_g; // bytes allocated and not yet freed
+boost::atomic<std::size_t>  held_at_reset_g;
+boost::atomic<std::size_t>  peak_g;
+
+EOP_THREAD_LOCAL int        phase_g; // an allocation_phase_t
+
+// Each block is preceded by its size, in a header which keeps the alignment malloc() gives.
+const std::size_t           header_k = 16;
+
+void* allocate(std::size_t size)
+{
+    char* block(static_cast<char*>(std::malloc(size + header_k)));
+
+    if (!block) return 0;
+    *reinterpret_cast<std::size_t*>(block) = size;
+
+    counters_t& counters(phases_g[phase_g]);
+
+    counters.count_m.fetch_add(1, boost::memory_order_relaxed);
+    counters.bytes_m.fetch_add(size, boost::memory_order_relaxed);
+
+    std::size_t held(held_g.fetch_add(size, boost::memory_order_relaxed) + size);
+    std::size_t peak(peak_g.load(boost::memory_order_relaxed));
+
+    while (held > peak && !peak_g.compare_exchange_weak(peak, held, boost::memory_order_relaxed))
+        { }
+
+    return block + header_k;
+}
+
+void* allocate_or_throw(std::size_t size)
+{
+    void* result(allocate(size ? size : 1));
+
+    while (!result) {
+        std::new_handler handler(std::set_new_handler(0));
+
+        std::set_new_handler(handler);
+        if (!handler) throw std::bad_alloc();
+        handler();
+        result = allocate(size ? size : 1);
+    }
+    return result;
+}
+
+void deallocate(void* p)
+{
+    if (!p) return;
+
+    char* block(static_cast<char*>(p) - header_k);
+
+    held_g.fetch_sub(*reinterpret_cast<std::size_t*>(block), boost::memory_order_relaxed);
+    std::free(block);
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+bool allocation_accounting_enabled() { return true; }
+
+void reset_allocation_report()
+{
+    for (std::size_t n(0); n != allocation_phase_count_k; ++n) {
+        phases_g[n].count_m.store(0, boost::memory_order_relaxed);
+        phases_g[n].bytes_m.store(0, boost::memory_order_relaxed);
+    }
+
+    std::size_t held(held_g.load(boost::memory_order_relaxed));
+
+    held_at_reset_g.store(held, boost::memory_order_relaxed);
+    peak_g.store(held, boost::memory_order_relaxed);
+}
+
+allocation_report_t allocation_report()
+{
+    allocation_report_t result;
+
+    for (std::size_t n(0); n != allocation_phase_count_k; ++n) {
+        result.phases_m[n].count_m = phases_g[n].count_m.load(boost::memory_order_relaxed);
+        result.phases_m[n].bytes_m = phases_g[n].bytes_m.load(boost::memory_order_relaxed);
+    }
+
+    std::size_t peak(peak_g.load(boost::memory_order_relaxed));
+    std::size_t held_at_reset(held_at_reset_g.load(boost::memory_order_relaxed));
+
+    result.peak_m = peak > held_at_reset ? peak - held_at_reset : 0;
+    return result;
+}
+
+allocation_scope_t::allocation_scope_t(allocation_phase_t phase) :
+    previous_m(allocation_phase_t(phase_g))
+{
+    phase_g = phase;
+}
+
+allocation_scope_t::~allocation_scope_t()
+{
+    phase_g = previous_m;
+}
+
+#else
+
+bool allocation_accounting_enabled() { return false; }
+
+void reset_allocation_report() { }
+
+allocation_report_t allocation_report() { return allocation_report_t(); }
+
+allocation_scope_t::allocation_scope_t(allocation_phase_t) : previous_m(other_phase_k) { }
+
+allocation_scope_t::~allocation_scope_t() { }
+
+#endif
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#if defined(EOP_ENABLE_ALLOCATION_ACCOUNTING)
+
+void* operator new(std::size_t size) throw(std::bad_alloc)
+    { return eop::allocate_or_throw(size); }
+
+void* operator new[](std::size_t size) throw(std::bad_alloc)
+    { return eop::allocate_or_throw(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw()
+    { try { return eop::allocate_or_throw(size); } catch (...) { return 0; } }
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw()
+    { try { return eop::allocate_or_throw(size); } catch (...) { return 0; } }
+
+void operator delete(void* p) throw()
+    { eop::deallocate(p); }
+
+void operator delete[](void* p) throw()
+    { eop::deallocate(p); }
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+    { eop::deallocate(p); }
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+    { eop::deallocate(p); }
+
+#endif
+
+/*************************************************************************************************/
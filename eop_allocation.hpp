@@ -0,0 +1,113 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_ALLOCATION_HPP
+#define EOP_ALLOCATION_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    Allocation accounting counts the heap allocations made through operator new, and their
+    bytes, by the phase of the parse making them. It is built in only with
+    EOP_ENABLE_ALLOCATION_ACCOUNTING defined, which replaces the global operator new and
+    operator delete; otherwise the phases are not marked and every report is empty.
+
+    The phase is that of the innermost EOP_ALLOCATION_PHASE() in effect on the allocating
+    thread, so the lexing done within an expression is counted as lexing:
+
+        lexing_phase_k      - the lexer: tokens, their values and the names interned for them,
+                              including on the pipelined lexing thread.
+        expression_phase_k  - the operand and operator stacks of parse_expression() and the
+                              arrays it builds.
+        class_index_phase_k - entering class names into the index.
+        diagnostics_phase_k - forming errors and the diagnostics recorded for them.
+        other_phase_k       - all else, the declarations recorded among it.
+*/
+
+enum allocation_phase_t
+{
+    other_phase_k,
+    lexing_phase_k,
+    expression_phase_k,
+    class_index_phase_k,
+    diagnostics_phase_k
+};
+
+const std::size_t allocation_phase_count_k = diagnostics_phase_k + 1;
+
+const char* allocation_phase_name(allocation_phase_t phase);
+
+struct allocation_counts_t
+{
+    allocation_counts_t() : count_m(0), bytes_m(0) { }
+
+    std::size_t count_m;
+    std::size_t bytes_m;
+};
+
+struct allocation_report_t
+{
+    allocation_report_t() : peak_m(0) { }
+
+    allocation_counts_t total() const;
+
+    allocation_counts_t phases_m[allocation_phase_count_k];
+    std::size_t         peak_m; // most bytes held at once beyond those held at the reset
+};
+
+//  allocation_accounting_enabled() is true if built with EOP_ENABLE_ALLOCATION_ACCOUNTING.
+bool allocation_accounting_enabled();
+
+//  reset_allocation_report() zeroes the counts, of every thread, and starts the peak anew.
+void reset_allocation_report();
+
+//  allocation_report() is what was allocated since the last reset.
+allocation_report_t allocation_report();
+
+/*************************************************************************************************/
+
+//  allocation_scope_t marks the allocations of the calling thread as phase while it lives.
+
+class allocation_scope_t : boost::noncopyable
+{
+ public:
+    explicit allocation_scope_t(allocation_phase_t phase);
+    ~allocation_scope_t();
+
+ private:
+    allocation_phase_t previous_m;
+};
+
+#if defined(EOP_ENABLE_ALLOCATION_ACCOUNTING)
+    #define EOP_ALLOCATION_PHASE(phase) \
+        ::eop::allocation_scope_t eop_allocation_scope_(::eop::phase)
+#else
+    #define EOP_ALLOCATION_PHASE(phase)
+#endif
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
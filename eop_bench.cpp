@@ -0,0 +1,104 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <sstream>
+
+#include <boost/chrono.hpp>
+
+#include "eop_bench.hpp"
+#include "eop_lex_stream.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+typedef boost::chrono::steady_clock steady_clock_t;
+
+double seconds_since(steady_clock_t::time_point start)
+{
+    return boost::chrono::duration<double>(steady_clock_t::now() - start).count();
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+double time_lex(const std::string& content, std::size_t& tokens)
+{
+    std::istringstream  stream(content);
+    lex_stream_t        lexer(stream, line_position_t("bench"));
+
+    lexer.set_keyword_extension_lookup(&keyword_lookup);
+    tokens = 0;
+
+    steady_clock_t::time_point start(steady_clock_t::now());
+
+    while (lexer.get().first != eof_k) ++tokens;
+    return seconds_since(start);
+}
+
+/*************************************************************************************************/
+
+double time_parse(const std::string& content, const parse_options_t& options,
+        parse_result_t& result)
+{
+    std::istringstream  stream(content);
+    expression_parser   parser(stream, line_position_t("bench"));
+
+    parser.set_options(options);
+    result = parse_result_t();
+
+    steady_clock_t::time_point start(steady_clock_t::now());
+
+    parser.parse(result);
+    return seconds_since(start);
+}
+
+/*************************************************************************************************/
+
+double time_replay(const token_file_t& tokens, const parse_options_t& options,
+        parse_result_t& result)
+{
+    std::istringstream  empty;
+    expression_parser   parser(empty, line_position_t("bench"));
+
+    parser.set_options(options);
+    parser.reset(tokens, line_position_t("bench"), expression_parser::snapshot_t());
+    result = parse_result_t();
+
+    steady_clock_t::time_point start(steady_clock_t::now());
+
+    parser.parse(result);
+    return seconds_since(start);
+}
+
+/*************************************************************************************************/
+
+allocation_report_t count_parse_allocations(const std::string& content,
+        const parse_options_t& options, parse_result_t& result)
+{
+    std::istringstream  stream(content);
+    expression_parser   parser(stream, line_position_t("bench"));
+
+    parser.set_options(options);
+    result = parse_result_t();
+
+    reset_allocation_report();
+    parser.parse(result);
+    return allocation_report();
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
@@ -0,0 +1,63 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_BENCH_HPP
+#define EOP_BENCH_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <string>
+
+#include "eop_allocation.hpp"
+#include "exp_parser.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    The timed workloads of the benchmarks. Each reads content from memory, so only lexing or
+    parsing is timed, and constructs its lexer or parser before the clock starts.
+*/
+
+//  time_lex() returns the seconds taken to lex content to the end, counting its tokens.
+double time_lex(const std::string& content, std::size_t& tokens);
+
+//  time_parse() returns the seconds taken to parse content, keeping the result.
+double time_parse(const std::string& content, const parse_options_t& options,
+        parse_result_t& result);
+
+/*
+    time_replay() returns the seconds taken to parse the tokens of a token file, keeping the
+    result; the tokens were lexed beforehand, so only parsing is timed.
+*/
+double time_replay(const token_file_t& tokens, const parse_options_t& options,
+        parse_result_t& result);
+
+/*
+    count_parse_allocations() returns the allocations made parsing content, keeping the result;
+    those of constructing the parser are not counted. The report is empty unless allocation
+    accounting is built in.
+*/
+allocation_report_t count_parse_allocations(const std::string& content,
+        const parse_options_t& options, parse_result_t& result);
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
@@ -0,0 +1,882 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "eop_corpus.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+const char* const shape_names_g[corpus_shape_count_k] = {
+    "mixed", "templates", "expressions", "statements", "comments", "structs"
+};
+
+const char* const builtin_types_g[] = { "int", "double", "bool", "char" };
+
+const char* const concepts_g[] = {
+    "Regular", "TotallyOrdered", "Integer", "Transformation", "Relation", "Readable",
+    "Iterator", "ForwardIterator", "BinaryOperation", "Monoid"
+};
+
+const char* const type_functions_g[] = {
+    "Domain", "Codomain", "ValueType", "DistanceType", "IteratorType", "Arity"
+};
+
+const char* const functions_g[] = {
+    "successor", "predecessor", "source", "sink", "twice", "half_nonnegative", "power",
+    "remainder", "quotient", "distance", "collision_point", "find_if", "reduce", "rotate"
+};
+
+const char* const words_g[] = {
+    "the", "a", "of", "is", "to", "and", "returns", "iterator", "range", "orbit", "cycle",
+    "transformation", "domain", "value", "regular", "type", "precondition", "postcondition",
+    "power", "associative", "operation", "distance", "from", "weak", "ordering", "bounded",
+    "counted", "element", "position", "partition", "point", "stable", "each", "linear"
+};
+
+const char* const binary_operators_g[] = {
+    "+", "-", "*", "/", "%", "<", "<=", ">", ">=", "==", "!=", "&&", "||"
+};
+
+const char* const unary_operators_g[] = { "-", "!", "*" };
+
+const char* const token_class_names_g[token_class_count_k] = {
+    "identifiers", "numbers", "strings", "compound", "simple", "comments"
+};
+
+const char* const keywords_g[] = {
+    "template", "typename", "requires", "const", "return", "struct", "typedef", "if", "else",
+    "while", "do", "enum", "case", "switch", "goto", "true", "false"
+};
+
+const char* const compound_operators_g[] = {
+    "==", "!=", "<=", ">=", "&&", "||", "<<", ">>", "<=="
+};
+
+const char* const simple_operators_g[] = {
+    "+", "-", "*", "/", "%", "<", ">", "=", "!", "&", "~", "(", ")", "[", "]", "{", "}", ";",
+    ",", ".", ":"
+};
+
+/*
+    random_t is a xorshift generator; its sequence is fixed here, so a seed gives the same corpus
+    on every platform and with every library.
+*/
+
+class random_t
+{
+ public:
+    explicit random_t(boost::uint32_t seed) : state_m(seed * 2654435761U ^ 0x9E3779B9U)
+    {
+        if (!state_m) state_m = 1;
+        for (int n(0); n != 8; ++n) next();
+    }
+
+    //  Returns a number in [0, n); n must not be zero.
+    std::size_t operator()(std::size_t n) { return next() % n; }
+
+    bool chance(std::size_t percent) { return next() % 100 < percent; }
+
+    template <typename T, std::size_t N>
+    const T& pick(T (&table)[N]) { return table[next() % N]; }
+
+ private:
+    boost::uint32_t next()
+    {
+        state_m ^= state_m << 13;
+        state_m ^= state_m >> 17;
+        state_m ^= state_m << 5;
+        return state_m;
+    }
+
+    boost::uint32_t state_m;
+};
+
+/*************************************************************************************************/
+
+/*
+    generator_t writes the declarations. Names are drawn from disjoint families so that none of
+    them is mistaken for another: s and t for structs and templates, T for template parameters,
+    U for typedefs, e for enumerations, f for functions, m for members, v for variables and l
+    for labels. Only the first four are class names, and they are only written where a type is
+    expected; an expression never names one, so "<" in an expression is never taken for the
+    start of template arguments.
+*/
+
+class generator_t
+{
+ public:
+    generator_t(const corpus_options_t& options, std::string& out) :
+        options_m(options), random_m(options.seed_m), out_m(out), indent_m(0), structs_m(0),
+        functions_m(0), enums_m(0), typedefs_m(0), labels_m(0), parameters_m(0), variables_m(0),
+        commenting_m(options.shape_m == comments_k)
+    { }
+
+    void run()
+    {
+        while (out_m.size() < options_m.size_m) {
+            corpus_shape_t shape(options_m.shape_m);
+
+            if (shape == mixed_k || shape == comments_k)
+                shape = corpus_shape_t(templates_k + random_m(structs_k - templates_k + 1));
+            if (shape == comments_k) shape = statements_k;
+
+            commenting_m = options_m.shape_m == comments_k
+                || (options_m.shape_m == mixed_k && random_m.chance(20));
+            if (commenting_m) comment_block();
+
+            switch (shape) {
+            case templates_k:   template_declaration(); break;
+            case expressions_k: expression_function(); break;
+            case statements_k:  statement_function(); break;
+            default:
+                if (random_m.chance(80)) struct_declaration();
+                else enum_declaration();
+            }
+            out_m += '\n';
+        }
+    }
+
+ private:
+    void template_declaration();
+    void expression_function();
+    void statement_function();
+    void struct_declaration();
+    void enum_declaration();
+
+    void function_header(std::size_t parameters);
+    void template_header(std::size_t parameters);
+    void struct_body(const std::string& name, std::size_t members);
+
+    std::string type(std::size_t depth);
+    void expression(std::size_t length, std::size_t depth);
+    void operand(std::size_t depth);
+    void arguments(std::size_t count, std::size_t depth);
+    void block(std::size_t count, std::size_t depth, bool returns = false);
+    void statement(std::size_t depth);
+
+    void comment_block();
+    void comment_line();
+    void prose(std::size_t words);
+
+    void line() { out_m += '\n'; out_m.append(indent_m * 4, ' '); }
+    void name(char prefix, std::size_t n)
+    {
+        char buffer[24];
+
+        std::sprintf(buffer, "%c%lu", prefix, static_cast<unsigned long>(n));
+        out_m += buffer;
+    }
+    void variable() { name('v', random_m(variables_m)); }
+
+    std::size_t between(std::size_t first, std::size_t last) // [first, last]
+        { return first + random_m(last - first + 1); }
+
+    const corpus_options_t&     options_m;
+    random_t                    random_m;
+    std::string&                out_m;
+    std::size_t                 indent_m;
+
+    std::size_t                 structs_m;
+    std::vector<std::size_t>    templates_m; // arities
+    std::size_t                 functions_m;
+    std::size_t                 enums_m;
+    std::size_t                 typedefs_m;
+    std::size_t                 labels_m;
+
+    std::size_t                 parameters_m; // of the template being written, T0 on
+    std::size_t                 variables_m; // of the function being written, v0 on
+    bool                        commenting_m;
+};
+
+/*************************************************************************************************/
+
+void generator_t::template_header(std::size_t parameters)
+{
+    out_m += "template <";
+    for (std::size_t n(0); n != parameters; ++n) {
+        if (n) out_m += ", ";
+        out_m += "typename ";
+        name('T', n);
+    }
+    out_m += ">";
+    ++indent_m;
+    line();
+    out_m += "requires(";
+
+    std::size_t clauses(parameters + random_m(parameters + 1));
+
+    for (std::size_t n(0); n != clauses; ++n) {
+        if (n) {
+            out_m += " && ";
+            if (n % 3 == 0) line();
+        }
+        if (n < parameters || random_m.chance(50)) {
+            out_m += random_m.pick(concepts_g);
+            out_m += '(';
+            name('T', n < parameters ? n : random_m(parameters));
+            out_m += ')';
+        } else {
+            out_m += random_m.pick(type_functions_g);
+            out_m += '(';
+            name('T', random_m(parameters));
+            out_m += ") == ";
+            name('T', random_m(parameters));
+        }
+    }
+    out_m += ')';
+    --indent_m;
+    line();
+    parameters_m = parameters;
+}
+
+void generator_t::template_declaration()
+{
+    bool deep(options_m.shape_m == templates_k);
+
+    template_header(between(1, deep ? 5 : 3));
+
+    if (random_m.chance(40)) {
+        std::string declared;
+        char        buffer[24];
+
+        std::sprintf(buffer, "t%lu", static_cast<unsigned long>(templates_m.size()));
+        declared = buffer;
+        // The template is a class name from its declarator on, so its body may use it.
+        out_m += "struct " + declared;
+        line();
+        struct_body(declared, between(1, 4));
+        templates_m.push_back(parameters_m);
+    } else {
+        function_header(between(1, 4));
+        block(between(1, deep ? 4 : options_m.length_m), deep ? 1 : options_m.depth_m, true);
+    }
+    parameters_m = 0;
+}
+
+/*************************************************************************************************/
+
+void generator_t::function_header(std::size_t parameters)
+{
+    out_m += type(options_m.depth_m) + " ";
+    name('f', functions_m++);
+    out_m += '(';
+    variables_m = 0;
+    for (std::size_t n(0); n != parameters; ++n) {
+        if (n) out_m += ", ";
+        if (random_m.chance(30)) out_m += "const " + type(options_m.depth_m) + "& ";
+        else out_m += type(options_m.depth_m) + " ";
+        name('v', variables_m++);
+    }
+    out_m += ')';
+    line();
+}
+
+void generator_t::expression_function()
+{
+    function_header(between(1, 4));
+    out_m += '{';
+    ++indent_m;
+
+    std::size_t count(between(0, 2));
+
+    for (std::size_t n(0); n != count; ++n) {
+        line();
+        variable();
+        out_m += " = ";
+        expression(options_m.length_m, options_m.depth_m);
+        out_m += ';';
+    }
+    line();
+    out_m += "return ";
+    expression(options_m.length_m, options_m.depth_m);
+    out_m += ';';
+    --indent_m;
+    line();
+    out_m += '}';
+}
+
+void generator_t::statement_function()
+{
+    function_header(between(1, 4));
+    block(options_m.length_m, options_m.depth_m, true);
+}
+
+/*************************************************************************************************/
+
+void generator_t::struct_body(const std::string& declared, std::size_t members)
+{
+    std::vector<std::string> types;
+
+    out_m += '{';
+    ++indent_m;
+    for (std::size_t n(0); n != members; ++n) {
+        types.push_back(type(options_m.shape_m == structs_k ? 0 : options_m.depth_m));
+        line();
+        out_m += types.back() + " ";
+        name('m', n);
+        if (random_m.chance(10)) {
+            out_m += '[';
+            out_m += char('1' + random_m(9));
+            out_m += ']';
+        }
+        out_m += ';';
+    }
+
+    line();
+    out_m += declared + "() { }";
+    line();
+    out_m += declared + "(";
+    for (std::size_t n(0); n != members; ++n) {
+        if (n) out_m += ", ";
+        out_m += "const " + types[n] + "& ";
+        name('v', n);
+    }
+    out_m += ") : ";
+    for (std::size_t n(0); n != members; ++n) {
+        if (n) out_m += ", ";
+        name('m', n);
+        out_m += '(';
+        name('v', n);
+        out_m += ')';
+    }
+    out_m += " { }";
+
+    variables_m = 1;
+    if (random_m.chance(30)) {
+        line();
+        out_m += "~" + declared + "() { }";
+    }
+    if (random_m.chance(40)) {
+        line();
+        // A member starting with the class name is taken for a constructor, so no "T&" result.
+        out_m += "void operator=(const " + declared + "& v0)";
+        line();
+        out_m += "{";
+        ++indent_m;
+        for (std::size_t n(0); n != members; ++n) {
+            line();
+            name('m', n);
+            out_m += " = v0.";
+            name('m', n);
+            out_m += ';';
+        }
+        --indent_m;
+        line();
+        out_m += '}';
+    }
+    if (random_m.chance(30)) {
+        line();
+        out_m += types[0] + " operator[](int v0) { return m0; }";
+    }
+    if (random_m.chance(30)) {
+        line();
+        out_m += "bool operator()(int v0) { return ";
+        expression(between(1, 4), 1);
+        out_m += "; }";
+    }
+    if (random_m.chance(20)) {
+        line();
+        out_m += "typedef " + type(1) + " ";
+        name('U', typedefs_m++);
+        out_m += ';';
+    }
+    --indent_m;
+    line();
+    out_m += "};";
+}
+
+void generator_t::struct_declaration()
+{
+    std::string declared;
+    char        buffer[24];
+
+    std::sprintf(buffer, "s%lu", static_cast<unsigned long>(structs_m));
+    declared = buffer;
+    out_m += "struct " + declared;
+    line();
+    struct_body(declared, between(1, 4));
+    ++structs_m;
+
+    if (random_m.chance(30)) {
+        out_m += "\n\nbool operator==(const " + declared + "& v0, const " + declared + "& v1)";
+        line();
+        out_m += "{";
+        ++indent_m;
+        line();
+        out_m += "return v0.m0 == v1.m0;";
+        --indent_m;
+        line();
+        out_m += '}';
+    }
+}
+
+void generator_t::enum_declaration()
+{
+    std::size_t count(between(2, 8));
+
+    out_m += "enum ";
+    name('e', enums_m);
+    out_m += " { ";
+    for (std::size_t n(0); n != count; ++n) {
+        if (n) out_m += ", ";
+        name('e', enums_m);
+        out_m += '_';
+        out_m += char('a' + n);
+    }
+    out_m += " };";
+    ++enums_m;
+}
+
+/*************************************************************************************************/
+
+//  type() is a type name: a builtin, a struct, a template parameter or, depth allowing, a
+//  template instantiated with types depth - 1 deep.
+
+std::string generator_t::type(std::size_t depth)
+{
+    std::size_t choice(random_m(10));
+    char        buffer[24];
+
+    if (depth && !templates_m.empty() && choice < 4) {
+        std::size_t instance(random_m(templates_m.size()));
+        std::string result;
+
+        std::sprintf(buffer, "t%lu<", static_cast<unsigned long>(instance));
+        result = buffer;
+        for (std::size_t n(0); n != templates_m[instance]; ++n) {
+            if (n) result += ", ";
+            result += type(depth - 1);
+        }
+        // "> >" rather than ">>", which is a shift.
+        if (result[result.size() - 1] == '>') result += ' ';
+        return result + '>';
+    }
+    if (parameters_m && choice < 7) {
+        std::sprintf(buffer, "T%lu", static_cast<unsigned long>(random_m(parameters_m)));
+        return buffer;
+    }
+    if (structs_m && choice < 8) {
+        std::sprintf(buffer, "s%lu", static_cast<unsigned long>(random_m(structs_m)));
+        return buffer;
+    }
+    return random_m.pick(builtin_types_g);
+}
+
+/*************************************************************************************************/
+
+void generator_t::expression(std::size_t length, std::size_t depth)
+{
+    operand(depth);
+    for (std::size_t n(1); n < length; ++n) {
+        if (n % 6 == 0) {
+            ++indent_m;
+            line();
+            --indent_m;
+        } else {
+            out_m += ' ';
+        }
+        out_m += random_m.pick(binary_operators_g);
+        out_m += ' ';
+        operand(depth);
+    }
+}
+
+//  arguments() is a parenthesized list of count expressions; count must not be zero.
+
+void generator_t::arguments(std::size_t count, std::size_t depth)
+{
+    out_m += '(';
+    for (std::size_t n(0); n != count; ++n) {
+        if (n) out_m += ", ";
+        expression(between(1, 3), depth);
+    }
+    out_m += ')';
+}
+
+void generator_t::operand(std::size_t depth)
+{
+    std::size_t choice(random_m(depth ? 16 : 8));
+
+    if (!variables_m && choice < 4) choice = 4;
+
+    switch (choice) {
+    case 0: case 1: case 2:
+        variable();
+        break;
+    case 3:
+        variable();
+        out_m += ".m";
+        out_m += char('0' + random_m(4));
+        break;
+    case 4: case 5: {
+        char buffer[24];
+
+        if (random_m.chance(20))
+            std::sprintf(buffer, "%lu.%02lu", static_cast<unsigned long>(random_m(1000)),
+                static_cast<unsigned long>(random_m(100)));
+        else
+            std::sprintf(buffer, "%lu", static_cast<unsigned long>(random_m(100)));
+        out_m += buffer;
+        break;
+    }
+    case 6:
+        out_m += random_m.chance(50) ? "true" : "false";
+        break;
+    case 7:
+        out_m += '"';
+        prose(between(1, 3));
+        out_m += '"';
+        break;
+    case 8: case 9: case 10:
+        out_m += '(';
+        expression(between(2, 4), depth - 1);
+        out_m += ')';
+        break;
+    case 11: case 12:
+        if (functions_m && random_m.chance(50)) name('f', random_m(functions_m));
+        else out_m += random_m.pick(functions_g);
+        arguments(between(1, 3), depth - 1);
+        break;
+    case 13:
+        if (!variables_m) { out_m += '0'; break; }
+        variable();
+        out_m += '[';
+        expression(between(1, 3), depth - 1);
+        out_m += ']';
+        break;
+    default:
+        out_m += random_m.pick(unary_operators_g);
+        out_m += '(';
+        expression(between(1, 3), depth - 1);
+        out_m += ')';
+    }
+}
+
+/*************************************************************************************************/
+
+//  block() is a compound statement of count statements; a function body ends with a return.
+
+void generator_t::block(std::size_t count, std::size_t depth, bool returns)
+{
+    out_m += '{';
+    ++indent_m;
+    for (std::size_t n(0); n != count; ++n) {
+        line();
+        statement(depth);
+    }
+    if (returns) {
+        line();
+        out_m += "return ";
+        expression(between(1, 4), 1);
+        out_m += ';';
+    }
+    --indent_m;
+    line();
+    out_m += '}';
+}
+
+void generator_t::statement(std::size_t depth)
+{
+    std::size_t length(between(1, options_m.length_m));
+    // Blocks multiply with depth; once the size is reached each holds a single statement.
+    std::size_t nested(out_m.size() < options_m.size_m
+                           ? between(1, options_m.length_m / 4 + 1) : 1);
+
+    if (commenting_m && random_m.chance(40)) {
+        comment_line();
+        line();
+    }
+
+    switch (random_m(depth ? 14 : 7)) {
+    case 0: case 1:
+        if (!variables_m) { out_m += "return;"; break; }
+        variable();
+        out_m += " = ";
+        expression(length, 1);
+        out_m += ';';
+        break;
+    case 2: case 3:
+        out_m += type(1) + " ";
+        name('v', variables_m++);
+        if (random_m.chance(50)) {
+            out_m += " = ";
+            expression(length, 1);
+        } else if (random_m.chance(70)) {
+            arguments(between(1, 3), 1);
+        }
+        out_m += ';';
+        break;
+    case 4:
+        out_m += random_m.pick(functions_g);
+        arguments(between(1, 3), 1);
+        out_m += ';';
+        break;
+    case 5:
+        name('l', labels_m++);
+        out_m += ": ";
+        if (!variables_m) { out_m += "f0(0);"; break; }
+        variable();
+        out_m += " = ";
+        expression(between(1, 3), 0);
+        out_m += ';';
+        break;
+    case 6:
+        if (labels_m && random_m.chance(50)) {
+            out_m += "goto ";
+            name('l', random_m(labels_m));
+        } else {
+            out_m += "typedef " + type(1) + " ";
+            name('U', typedefs_m++);
+        }
+        out_m += ';';
+        break;
+    case 7: case 8:
+        out_m += "if (";
+        expression(between(1, 4), 1);
+        out_m += ") ";
+        block(nested, depth - 1);
+        if (random_m.chance(50)) {
+            line();
+            out_m += "else ";
+            if (random_m.chance(30)) statement(depth - 1);
+            else block(nested, depth - 1);
+        }
+        break;
+    case 9:
+        out_m += "while (";
+        expression(between(1, 4), 1);
+        out_m += ") ";
+        block(nested, depth - 1);
+        break;
+    case 10:
+        out_m += "do ";
+        block(nested, depth - 1);
+        out_m += " while (";
+        expression(between(1, 4), 1);
+        out_m += ");";
+        break;
+    case 11: {
+        std::size_t cases(between(1, 4));
+
+        out_m += "switch (";
+        expression(between(1, 3), 1);
+        out_m += ") {";
+        for (std::size_t n(0); n != cases; ++n) {
+            line();
+            out_m += "case ";
+            name('e', n);
+            out_m += ':';
+            ++indent_m;
+            for (std::size_t k(between(1, 3)); k; --k) {
+                line();
+                statement(depth - 1);
+            }
+            --indent_m;
+        }
+        line();
+        out_m += '}';
+        break;
+    }
+    default:
+        block(nested, depth - 1);
+    }
+
+    if (commenting_m && random_m.chance(20)) {
+        out_m += " // ";
+        prose(between(2, 6));
+    }
+}
+
+/*************************************************************************************************/
+
+void generator_t::prose(std::size_t words)
+{
+    for (std::size_t n(0); n != words; ++n) {
+        if (n) out_m += ' ';
+        out_m += random_m.pick(words_g);
+    }
+}
+
+void generator_t::comment_line()
+{
+    out_m += "// ";
+    prose(between(3, 12));
+}
+
+void generator_t::comment_block()
+{
+    switch (random_m(4)) {
+    case 0:
+        for (std::size_t n(between(1, 4)); n; --n) {
+            comment_line();
+            line();
+        }
+        break;
+    case 1:
+        out_m += "# include \"";
+        prose(1);
+        out_m += ".hpp\"";
+        line();
+        break;
+    default:
+        out_m += "/*";
+        for (std::size_t n(between(2, 10)); n; --n) {
+            line();
+            out_m += "    ";
+            prose(between(4, 14));
+        }
+        line();
+        out_m += "*/";
+        line();
+    }
+}
+
+/*************************************************************************************************/
+
+//  Appends one token of the class given.
+
+void token(token_class_t token_class, random_t& random, std::string& out)
+{
+    char buffer[32];
+
+    switch (token_class) {
+    case identifier_tokens_k:
+        if (random.chance(12)) out += random.pick(keywords_g);
+        else if (random.chance(40)) out += random.pick(functions_g);
+        else if (random.chance(50)) out += random.pick(words_g);
+        else {
+            std::sprintf(buffer, "%c%lu", "stTUefmvl"[random(9)],
+                static_cast<unsigned long>(random(1000)));
+            out += buffer;
+        }
+        break;
+    case number_tokens_k:
+        if (random.chance(25))
+            std::sprintf(buffer, "%lu.%lu", static_cast<unsigned long>(random(100000)),
+                static_cast<unsigned long>(random(1000)));
+        else
+            std::sprintf(buffer, "%lu", static_cast<unsigned long>(random(100000)));
+        out += buffer;
+        break;
+    case string_tokens_k: {
+        char quote(random.chance(80) ? '"' : '\'');
+
+        out += quote;
+        for (std::size_t n(1 + random(4)); n; --n) {
+            out += random.pick(words_g);
+            if (n != 1) out += ' ';
+        }
+        out += quote;
+        break;
+    }
+    case compound_tokens_k:
+        out += random.pick(compound_operators_g);
+        break;
+    case simple_tokens_k:
+        out += random.pick(simple_operators_g);
+        break;
+    case comment_tokens_k: {
+        std::size_t kind(random(3));
+
+        out += kind == 0 ? "//" : kind == 1 ? "/*" : "#";
+        for (std::size_t n(2 + random(10)); n; --n) {
+            out += ' ';
+            out += random.pick(words_g);
+        }
+        // A line or "#" comment runs to the end of the line.
+        out += kind == 1 ? " */" : "\n";
+        break;
+    }
+    }
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+const char* corpus_shape_name(corpus_shape_t shape)
+{
+    return shape_names_g[shape];
+}
+
+bool find_corpus_shape(const char* name, corpus_shape_t& shape)
+{
+    for (std::size_t n(0); n != corpus_shape_count_k; ++n) {
+        if (std::strcmp(name, shape_names_g[n]) == 0) {
+            shape = corpus_shape_t(n);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*************************************************************************************************/
+
+void generate_corpus(const corpus_options_t& options, std::string& result)
+{
+    result.clear();
+    result.reserve(options.size_m + options.size_m / 8);
+    generator_t(options, result).run();
+}
+
+/*************************************************************************************************/
+
+const char* token_class_name(token_class_t token_class)
+{
+    return token_class_names_g[token_class];
+}
+
+bool find_token_class(const char* name, token_class_t& token_class)
+{
+    for (std::size_t n(0); n != token_class_count_k; ++n) {
+        if (std::strcmp(name, token_class_names_g[n]) == 0) {
+            token_class = token_class_t(n);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*************************************************************************************************/
+
+std::size_t generate_tokens(token_class_t token_class, std::size_t size, boost::uint32_t seed,
+        std::string& result)
+{
+    random_t    random(seed);
+    std::size_t count(0);
+    std::size_t line(0); // start of the current line
+
+    result.clear();
+    result.reserve(size + 128);
+    while (result.size() < size) {
+        if (count) {
+            if (token_class == string_tokens_k) result += ',';
+            if (result[result.size() - 1] == '\n') line = result.size();
+            else if (result.size() - line > 80) { result += '\n'; line = result.size(); }
+            else result += ' ';
+        }
+        token(token_class, random, result);
+        ++count;
+    }
+    return count;
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
@@ -0,0 +1,133 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_CORPUS_HPP
+#define EOP_CORPUS_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    The shapes of synthetic source generate_corpus() can write, each stressing one part of the
+    lexer or parser:
+
+        templates_k     - templates of several parameters with long requires clauses, and
+                          template arguments nested depth_m deep.
+        expressions_k   - functions returning chains of length_m binary operators, with
+                          parentheses, calls, member access and indexing nested depth_m deep.
+        statements_k    - functions of length_m statements per block, with conditionals, loops,
+                          switches, labels and local declarations nested depth_m deep.
+        comments_k      - declarations interleaved with line, block and "#" comments, which
+                          take up most of the text.
+        structs_k       - many small structs and enumerations, with constructors and operators.
+        mixed_k         - declarations of all the shapes above in random proportion.
+*/
+
+enum corpus_shape_t
+{
+    mixed_k,
+    templates_k,
+    expressions_k,
+    statements_k,
+    comments_k,
+    structs_k
+};
+
+const std::size_t corpus_shape_count_k = structs_k + 1;
+
+//  corpus_shape_name() is the name of shape as accepted by find_corpus_shape().
+const char* corpus_shape_name(corpus_shape_t shape);
+//  find_corpus_shape() sets shape to the one named; returns false if there is none.
+bool find_corpus_shape(const char* name, corpus_shape_t& shape);
+
+/*************************************************************************************************/
+
+struct corpus_options_t
+{
+    corpus_options_t() :
+        shape_m(mixed_k), size_m(1024 * 1024), seed_m(1), depth_m(4), length_m(12)
+    { }
+
+    corpus_shape_t  shape_m;
+    std::size_t     size_m;     // in bytes; the last declaration ends at or past it
+    boost::uint32_t seed_m;
+    std::size_t     depth_m;    // nesting of template arguments, statements and parentheses
+    std::size_t     length_m;   // operators per expression, statements per block
+};
+
+/*
+    generate_corpus() writes synthetic source of the shape given to result, a sequence of
+    top-level declarations which parses without error and without a prelude. Class names are
+    declared before they are used and only ever appear as types, so the text is valid whatever
+    the seed. The same options always produce the same text: the random numbers are drawn from
+    a generator defined here rather than from a library whose sequences may change.
+*/
+
+void generate_corpus(const corpus_options_t& options, std::string& result);
+
+/*************************************************************************************************/
+
+/*
+    The classes of token generate_tokens() can write, each going to one recognizer of the lexer:
+
+        identifier_tokens_k - identifiers, one in eight a keyword (is_identifier_or_keyword).
+        number_tokens_k     - integers and decimals (is_number).
+        string_tokens_k     - single and double quoted strings (is_string).
+        compound_tokens_k   - two and three character operators (is_compound).
+        simple_tokens_k     - single character operators (is_simple).
+        comment_tokens_k    - line, block and "#" comments (is_comment).
+*/
+
+enum token_class_t
+{
+    identifier_tokens_k,
+    number_tokens_k,
+    string_tokens_k,
+    compound_tokens_k,
+    simple_tokens_k,
+    comment_tokens_k
+};
+
+const std::size_t token_class_count_k = comment_tokens_k + 1;
+
+//  token_class_name() is the name of token_class as accepted by find_token_class().
+const char* token_class_name(token_class_t token_class);
+//  find_token_class() sets token_class to the one named; returns false if there is none.
+bool find_token_class(const char* name, token_class_t& token_class);
+
+/*
+    generate_tokens() writes tokens of one class to result until it holds size bytes, and
+    returns how many it wrote. Tokens are separated by a space, or a line end every eighty
+    columns or so; strings also by ",", as adjacent strings lex as one. The comments are
+    counted although the lexer skips them. The same arguments always produce the same text.
+*/
+
+std::size_t generate_tokens(token_class_t token_class, std::size_t size, boost::uint32_t seed,
+        std::string& result);
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
@@ -0,0 +1,356 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/next_prior.hpp>
+#include <boost/ref.hpp>
+
+#include <adobe/implementation/token.hpp>
+
+#include "eop_expression_table.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+const std::size_t block_size_k = 1024; // operands to a block
+const std::size_t slot_count_k = 256; // of the index, at first
+
+/*
+    Values are hashed and compared by their type and, for the types a token can hold, by their
+    contents; any other is left to its own equality, and all of a type hash alike.
+*/
+
+std::size_t hash_value_of(const any_regular_t& x)
+{
+    const std::type_info& type(x.type_info());
+
+    if (type == typeid(name_t)) return boost::hash<const void*>()(x.cast<name_t>().c_str());
+    if (type == typeid(double)) return boost::hash<double>()(x.cast<double>());
+    if (type == typeid(std::string)) return boost::hash<std::string>()(x.cast<std::string>());
+    if (type == typeid(bool)) return x.cast<bool>() ? 1 : 2;
+    return boost::hash<std::string>()(type.name());
+}
+
+bool equal_values(const any_regular_t& x, const any_regular_t& y)
+{
+    const std::type_info& type(x.type_info());
+
+    if (type != y.type_info()) return false;
+    if (type == typeid(name_t)) return x.cast<name_t>() == y.cast<name_t>();
+    if (type == typeid(double)) return x.cast<double>() == y.cast<double>();
+    if (type == typeid(std::string)) return x.cast<std::string>() == y.cast<std::string>();
+    if (type == typeid(bool)) return x.cast<bool>() == y.cast<bool>();
+    return x == y;
+}
+
+//  The count of an array, as the parser writes it; false if x is not one.
+
+bool count_of(const any_regular_t& x, std::size_t& count)
+{
+    const std::type_info& type(x.type_info());
+
+    if (type == typeid(double)) {
+        double value(x.cast<double>());
+
+        if (value < 0 || value != double(std::size_t(value))) return false;
+        count = std::size_t(value);
+        return true;
+    }
+    if (type == typeid(std::size_t)) { count = x.cast<std::size_t>(); return true; }
+    return false;
+}
+
+bool is_array(const any_regular_t& x)
+{
+    return x.type_info() == typeid(name_t) && x.cast<name_t>() == array_k;
+}
+
+/*
+    The operands of a node are of the table, so two nodes are equal if their values are and
+    their operands are the same nodes, and a node is hashed by the addresses of its operands.
+*/
+
+std::size_t hash_node(const expression_node_t& x)
+{
+    std::size_t seed(hash_value_of(x.value()));
+
+    boost::hash_combine(seed, x.is_operator());
+    for (expression_node_t::const_iterator first(x.begin()); first != x.end(); ++first)
+        boost::hash_combine(seed, static_cast<const void*>(*first));
+    return seed;
+}
+
+bool equal_nodes(const expression_node_t& x, const expression_node_t& y)
+{
+    return x.is_operator() == y.is_operator() && x.size() == y.size()
+        && std::equal(x.begin(), x.end(), y.begin()) && equal_values(x.value(), y.value());
+}
+
+void intern_expression(expression_table_t& table,
+        const boost::function<void (const expression_node_t*)>& proc, const array_t& expression)
+{
+    proc(table.intern(expression));
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+/*
+    Nodes are kept in a deque, which never moves them, and their operands in blocks which are
+    never freed before the table. The index is open addressed: a power of two slots, probed
+    in turn from the hash of a node, and at most three quarters full; as nodes hold no hash,
+    each is hashed again when it grows.
+*/
+
+struct expression_table_t::implementation_t
+{
+    typedef std::vector<const expression_node_t*> slots_t;
+    typedef std::vector<const expression_node_t*> stack_t;
+
+    implementation_t() :
+        used_m(0), capacity_m(0), allocated_m(0), slots_m(slot_count_k), lookups_m(0)
+    { }
+
+    ~implementation_t()
+    {
+        for (std::size_t n(0); n != blocks_m.size(); ++n) delete [] blocks_m[n];
+    }
+
+    const expression_node_t* const* store(const expression_node_t* const* first,
+            std::size_t count)
+    {
+        if (!count) return 0;
+        if (capacity_m - used_m < count) {
+            capacity_m = (std::max)(block_size_k, count);
+            blocks_m.reserve(blocks_m.size() + 1);
+            blocks_m.push_back(new const expression_node_t*[capacity_m]);
+            used_m = 0;
+            allocated_m += capacity_m;
+        }
+
+        const expression_node_t** result(blocks_m.back() + used_m);
+
+        std::copy(first, first + count, result);
+        used_m += count;
+        return result;
+    }
+
+    //  slot() is the slot holding a node equal to x, or the empty slot where it would go.
+
+    const expression_node_t*& slot(const expression_node_t& x, std::size_t hash)
+    {
+        std::size_t mask(slots_m.size() - 1);
+
+        for (std::size_t n(hash & mask); ; n = (n + 1) & mask) {
+            if (!slots_m[n] || equal_nodes(*slots_m[n], x)) return slots_m[n];
+        }
+    }
+
+    void grow()
+    {
+        slots_t slots(slots_m.size() * 2);
+
+        slots_m.swap(slots);
+        for (slots_t::const_iterator first(slots.begin()); first != slots.end(); ++first) {
+            if (*first) slot(**first, hash_node(**first)) = *first;
+        }
+    }
+
+    std::deque<expression_node_t>           nodes_m;
+    std::vector<const expression_node_t**>  blocks_m;
+    std::size_t                             used_m; // of the last block
+    std::size_t                             capacity_m; // ...
+    std::size_t                             allocated_m; // operands, of every block
+    slots_t                                 slots_m;
+    std::size_t                             lookups_m;
+    stack_t                                 stack_m; // of intern()
+};
+
+/*************************************************************************************************/
+
+expression_table_t::expression_table_t() :
+    object_m(new implementation_t)
+{ }
+
+expression_table_t::~expression_table_t()
+{
+    delete object_m;
+}
+
+/*************************************************************************************************/
+
+/*
+    find() returns the node equal to key, adding a copy of key, with its operands copied to
+    the table, if there is none.
+*/
+
+const expression_node_t* expression_table_t::find(const expression_node_t& key)
+{
+    implementation_t& object(*object_m);
+
+    ++object.lookups_m;
+    if ((object.nodes_m.size() + 1) * 4 > object.slots_m.size() * 3) object.grow();
+
+    const expression_node_t*& slot(object.slot(key, hash_node(key)));
+
+    if (slot) return slot;
+
+    expression_node_t node(key);
+
+    node.operands_m = object.store(key.operands_m, key.size_m);
+    object.nodes_m.push_back(node);
+    slot = &object.nodes_m.back();
+    return slot;
+}
+
+const expression_node_t* expression_table_t::value(const any_regular_t& x)
+{
+    expression_node_t key;
+
+    key.value_m = x;
+    return find(key);
+}
+
+const expression_node_t* expression_table_t::apply(name_t operation,
+        const expression_node_t* const* first, const expression_node_t* const* last)
+{
+    expression_node_t key;
+
+    key.value_m = any_regular_t(operation);
+    key.is_operator_m = true;
+    key.size_m = last - first;
+    key.operands_m = first;
+    return find(key);
+}
+
+/*************************************************************************************************/
+
+/*
+    intern() evaluates postfix as the virtual machine would, on a stack of nodes: a value
+    pushes its node, and an operator pops its operands and pushes the node applying it to
+    them. A count is taken with the array_k after it.
+*/
+
+const expression_node_t* expression_table_t::intern(const array_t& postfix)
+{
+    implementation_t::stack_t& stack(object_m->stack_m);
+
+    stack.clear();
+
+    for (array_t::const_iterator first(postfix.begin()), last(postfix.end()); first != last;
+            ++first) {
+        std::size_t arity(0);
+        name_t      operation;
+
+        if (first->type_info() == typeid(name_t)) {
+            operation = first->cast<name_t>();
+            arity = expression_operator_arity(operation);
+        }
+
+        if (arity == 1 && operation == array_k) return 0; // without a count
+        if (!arity && boost::next(first) != last && is_array(*boost::next(first))) {
+            if (!count_of(*first, arity)) return 0;
+            operation = array_k;
+            ++first;
+        } else if (!arity) {
+            stack.push_back(value(*first));
+            continue;
+        }
+
+        if (stack.size() < arity) return 0;
+
+        const expression_node_t* const* operands(stack.empty() ? 0
+            : &stack.front() + stack.size() - arity);
+        const expression_node_t*        node(apply(operation, operands, operands + arity));
+
+        stack.resize(stack.size() - arity);
+        stack.push_back(node);
+    }
+
+    return stack.size() == 1 ? stack.back() : 0;
+}
+
+/*************************************************************************************************/
+
+std::size_t expression_table_t::size() const
+{
+    return object_m->nodes_m.size();
+}
+
+std::size_t expression_table_t::lookups() const
+{
+    return object_m->lookups_m;
+}
+
+std::size_t expression_table_t::bytes() const
+{
+    const implementation_t& object(*object_m);
+
+    return object.nodes_m.size() * sizeof(expression_node_t)
+        + object.allocated_m * sizeof(const expression_node_t*)
+        + object.slots_m.size() * sizeof(const expression_node_t*);
+}
+
+/*************************************************************************************************/
+
+/*
+    postfix() walks node depth first on a stack of its own, as a chain of binary operators
+    nests as deeply as it is long.
+*/
+
+void postfix(const expression_node_t* node, array_t& result)
+{
+    typedef std::pair<const expression_node_t*, std::size_t> frame_t; // node, operands written
+
+    std::vector<frame_t> stack(1, frame_t(node, 0));
+
+    while (!stack.empty()) {
+        frame_t& frame(stack.back());
+
+        if (frame.second != frame.first->size()) {
+            const expression_node_t* operand((*frame.first)[frame.second++]);
+
+            stack.push_back(frame_t(operand, 0));
+            continue;
+        }
+
+        const expression_node_t& x(*frame.first);
+
+        if (x.is_operator() && is_array(x.value())) result.push_back(any_regular_t(x.size()));
+        result.push_back(x.value());
+        stack.pop_back();
+    }
+}
+
+/*************************************************************************************************/
+
+declaration_callback_suite_t::expression_proc_t intern_expressions(expression_table_t& table,
+        const boost::function<void (const expression_node_t*)>& proc)
+{
+    return boost::bind(&intern_expression, boost::ref(table), proc, _1);
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
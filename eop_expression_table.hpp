@@ -0,0 +1,123 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_EXPRESSION_TABLE_HPP
+#define EOP_EXPRESSION_TABLE_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <adobe/any_regular.hpp>
+#include <adobe/array.hpp>
+#include <adobe/name.hpp>
+
+#include "exp_parser.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    An expression_table_t holds expressions, in the postfix form of expression_parser, as a
+    DAG in which each distinct expression is a single node: the node of pair<T0, T1> is the
+    node of every occurrence of pair<T0, T1>, and its operand T0 the node of every T0. Two
+    expressions from the same table are equal if and only if their nodes are the same, so
+    comparing them is comparing pointers, and a corpus repeating its types holds each once.
+
+    An expression_node_t is a value - a number, boolean, string or name - or an operator
+    with its operands. array_k is an operator with an operand for each element and the count
+    left out. Nodes are immutable and live as long as their table; a map keyed by expression
+    is keyed by the address of its node.
+*/
+
+class expression_node_t
+{
+ public:
+    typedef const expression_node_t* const* const_iterator;
+
+    bool is_operator() const { return is_operator_m; }
+//  value() is the value of a value node, or the name of the operator of an operator node.
+    const any_regular_t& value() const { return value_m; }
+
+    std::size_t size() const { return size_m; } // of the operands
+    const_iterator begin() const { return operands_m; }
+    const_iterator end() const { return operands_m + size_m; }
+    const expression_node_t* operator[](std::size_t n) const { return operands_m[n]; }
+
+ private:
+    friend class expression_table_t;
+
+    expression_node_t() : is_operator_m(false), size_m(0), operands_m(0) { }
+
+    any_regular_t                   value_m;
+    bool                            is_operator_m;
+    std::size_t                     size_m;
+    const expression_node_t* const* operands_m;
+};
+
+/*************************************************************************************************/
+
+/*
+    intern() adds the expression postfix to the table, or finds it there, and returns its node;
+    null if postfix is not a single well formed expression. value() and apply() do the same
+    for a value, and for an operator applied to operands of the table. A table is not safe to
+    use from more than one thread at once.
+*/
+
+class expression_table_t : boost::noncopyable
+{
+ public:
+    expression_table_t();
+    ~expression_table_t();
+
+    const expression_node_t* intern(const array_t& postfix);
+
+    const expression_node_t* value(const any_regular_t& x);
+    const expression_node_t* apply(name_t operation, const expression_node_t* const* first,
+            const expression_node_t* const* last);
+
+    std::size_t size() const; // in nodes
+    std::size_t lookups() const; // of nodes, by intern(), value() and apply()
+    std::size_t bytes() const; // held by the nodes and the index, approximately
+
+ private:
+    struct implementation_t;
+
+    const expression_node_t* find(const expression_node_t& key);
+
+    implementation_t* object_m;
+};
+
+//  postfix() appends the postfix form of node to result.
+void postfix(const expression_node_t* node, array_t& result);
+
+/*
+    intern_expressions() returns a proc for declaration_callback_suite_t::expression_proc_m
+    which interns each expression in table and passes its node, or null if the expression is
+    not well formed, to proc.
+*/
+declaration_callback_suite_t::expression_proc_t intern_expressions(expression_table_t& table,
+        const boost::function<void (const expression_node_t*)>& proc);
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
@@ -0,0 +1,356 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <cctype>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+
+#include "eop_json.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+const json_value_t null_value_g;
+
+const std::size_t depth_limit_k = 256;
+
+/*
+    reader_t reads a value by recursive descent; each read_ function consumes the white space
+    following what it reads.
+*/
+
+class reader_t
+{
+ public:
+    reader_t(const char* first, const char* last) : p_m(first), last_m(last) { }
+
+    bool read(json_value_t& result)
+    {
+        skip();
+        return value(result, 0) && p_m == last_m;
+    }
+
+ private:
+    void skip()
+    {
+        while (p_m != last_m && (*p_m == ' ' || *p_m == '\t' || *p_m == '\n' || *p_m == '\r'))
+            ++p_m;
+    }
+
+    bool is_next(char c)
+    {
+        if (p_m == last_m || *p_m != c) return false;
+        ++p_m;
+        skip();
+        return true;
+    }
+
+    bool is_word(const char* word)
+    {
+        std::size_t size(std::strlen(word));
+
+        if (std::size_t(last_m - p_m) < size || std::strncmp(p_m, word, size) != 0) return false;
+        p_m += size;
+        skip();
+        return true;
+    }
+
+    bool value(json_value_t& result, std::size_t depth);
+    bool number(json_value_t& result);
+    bool string(std::string& result);
+    bool hex4(unsigned& result);
+
+    const char* p_m;
+    const char* last_m;
+};
+
+bool reader_t::value(json_value_t& result, std::size_t depth)
+{
+    if (p_m == last_m || depth == depth_limit_k) return false;
+
+    switch (*p_m) {
+    case '{':
+        result.kind_m = json_value_t::object_k;
+        ++p_m;
+        skip();
+        if (is_next('}')) return true;
+        do {
+            result.names_m.push_back(std::string());
+            result.elements_m.push_back(json_value_t());
+            if (!string(result.names_m.back()) || !is_next(':')
+                    || !value(result.elements_m.back(), depth + 1))
+                return false;
+        } while (is_next(','));
+        return is_next('}');
+    case '[':
+        result.kind_m = json_value_t::array_k;
+        ++p_m;
+        skip();
+        if (is_next(']')) return true;
+        do {
+            result.elements_m.push_back(json_value_t());
+            if (!value(result.elements_m.back(), depth + 1)) return false;
+        } while (is_next(','));
+        return is_next(']');
+    case '"':
+        result.kind_m = json_value_t::string_k;
+        return string(result.string_m);
+    case 't':
+        result.kind_m = json_value_t::boolean_k;
+        result.boolean_m = true;
+        return is_word("true");
+    case 'f':
+        result.kind_m = json_value_t::boolean_k;
+        return is_word("false");
+    case 'n':
+        return is_word("null");
+    default:
+        return number(result);
+    }
+}
+
+bool reader_t::number(json_value_t& result)
+{
+    const char* first(p_m);
+
+    if (p_m != last_m && *p_m == '-') ++p_m;
+    if (p_m == last_m || !std::isdigit(static_cast<unsigned char>(*p_m))) return false;
+    if (*p_m == '0') ++p_m;
+    else while (p_m != last_m && std::isdigit(static_cast<unsigned char>(*p_m))) ++p_m;
+
+    if (p_m != last_m && *p_m == '.') {
+        ++p_m;
+        if (p_m == last_m || !std::isdigit(static_cast<unsigned char>(*p_m))) return false;
+        while (p_m != last_m && std::isdigit(static_cast<unsigned char>(*p_m))) ++p_m;
+    }
+    if (p_m != last_m && (*p_m == 'e' || *p_m == 'E')) {
+        ++p_m;
+        if (p_m != last_m && (*p_m == '+' || *p_m == '-')) ++p_m;
+        if (p_m == last_m || !std::isdigit(static_cast<unsigned char>(*p_m))) return false;
+        while (p_m != last_m && std::isdigit(static_cast<unsigned char>(*p_m))) ++p_m;
+    }
+
+    // strtod() takes the decimal point of the C locale, so it is put in place of the JSON one.
+    std::string             text(first, p_m);
+    std::string::size_type  point(text.find('.'));
+
+    if (point != std::string::npos) text.replace(point, 1, std::localeconv()->decimal_point);
+
+    result.kind_m = json_value_t::number_k;
+    result.number_m = std::strtod(text.c_str(), 0);
+    skip();
+    return true;
+}
+
+bool reader_t::hex4(unsigned& result)
+{
+    result = 0;
+    for (int n(0); n != 4; ++n, ++p_m) {
+        if (p_m == last_m) return false;
+
+        char c(*p_m);
+
+        result <<= 4;
+        if (c >= '0' && c <= '9') result |= c - '0';
+        else if (c >= 'a' && c <= 'f') result |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') result |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+void append_utf8(std::string& result, unsigned code)
+{
+    if (code < 0x80) {
+        result += char(code);
+    } else if (code < 0x800) {
+        result += char(0xC0 | (code >> 6));
+        result += char(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        result += char(0xE0 | (code >> 12));
+        result += char(0x80 | ((code >> 6) & 0x3F));
+        result += char(0x80 | (code & 0x3F));
+    } else {
+        result += char(0xF0 | (code >> 18));
+        result += char(0x80 | ((code >> 12) & 0x3F));
+        result += char(0x80 | ((code >> 6) & 0x3F));
+        result += char(0x80 | (code & 0x3F));
+    }
+}
+
+bool reader_t::string(std::string& result)
+{
+    if (p_m == last_m || *p_m != '"') return false;
+    ++p_m;
+
+    while (true) {
+        const char* first(p_m);
+
+        while (p_m != last_m && *p_m != '"' && *p_m != '\\'
+                && static_cast<unsigned char>(*p_m) >= 0x20)
+            ++p_m;
+        result.append(first, p_m);
+
+        if (p_m == last_m || static_cast<unsigned char>(*p_m) < 0x20) return false;
+        if (*p_m++ == '"') break;
+        if (p_m == last_m) return false;
+
+        switch (*p_m++) {
+        case '"':   result += '"'; break;
+        case '\\':  result += '\\'; break;
+        case '/':   result += '/'; break;
+        case 'b':   result += '\b'; break;
+        case 'f':   result += '\f'; break;
+        case 'n':   result += '\n'; break;
+        case 'r':   result += '\r'; break;
+        case 't':   result += '\t'; break;
+        case 'u': {
+            unsigned code;
+
+            if (!hex4(code)) return false;
+            // A surrogate pair is combined; a lone surrogate is kept as it is.
+            if (code >= 0xD800 && code < 0xDC00 && last_m - p_m >= 6 && p_m[0] == '\\'
+                    && p_m[1] == 'u') {
+                const char* pair(p_m);
+                unsigned    low;
+
+                p_m += 2;
+                if (hex4(low) && low >= 0xDC00 && low < 0xE000)
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                else
+                    p_m = pair;
+            }
+            append_utf8(result, code);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    skip();
+    return true;
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+const json_value_t& json_value_t::operator[](const char* name) const
+{
+    if (kind_m != object_k) return null_value_g;
+
+    for (std::size_t n(0); n != names_m.size(); ++n) {
+        if (names_m[n] == name) return elements_m[n];
+    }
+    return null_value_g;
+}
+
+const json_value_t& json_value_t::operator[](std::size_t index) const
+{
+    if (kind_m != array_k || index >= elements_m.size()) return null_value_g;
+    return elements_m[index];
+}
+
+/*************************************************************************************************/
+
+bool read_json(const char* first, const char* last, json_value_t& result)
+{
+    json_value_t empty;
+
+    result = empty;
+    return reader_t(first, last).read(result);
+}
+
+/*************************************************************************************************/
+
+void write_json_string(std::ostream& out, const std::string& value)
+{
+    out << '"';
+
+    for (std::string::const_iterator first(value.begin()); first != value.end(); ++first) {
+        char c(*first);
+
+        switch (c) {
+        case '"':   out << "\\\""; break;
+        case '\\':  out << "\\\\"; break;
+        case '\b':  out << "\\b"; break;
+        case '\f':  out << "\\f"; break;
+        case '\n':  out << "\\n"; break;
+        case '\r':  out << "\\r"; break;
+        case '\t':  out << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buffer[8];
+
+                std::sprintf(buffer, "\\u%04x", static_cast<unsigned>(c));
+                out << buffer;
+            } else {
+                out << c;
+            }
+        }
+    }
+
+    out << '"';
+}
+
+/*************************************************************************************************/
+
+void write_json(std::ostream& out, const json_value_t& value)
+{
+    switch (value.kind_m) {
+    case json_value_t::null_k:
+        out << "null";
+        break;
+    case json_value_t::boolean_k:
+        out << (value.boolean_m ? "true" : "false");
+        break;
+    case json_value_t::number_k: {
+        char buffer[32];
+
+        std::sprintf(buffer, "%.17g", value.number_m);
+        out << buffer;
+        break;
+    }
+    case json_value_t::string_k:
+        write_json_string(out, value.string_m);
+        break;
+    case json_value_t::array_k:
+        out << '[';
+        for (std::size_t n(0); n != value.elements_m.size(); ++n) {
+            if (n) out << ',';
+            write_json(out, value.elements_m[n]);
+        }
+        out << ']';
+        break;
+    case json_value_t::object_k:
+        out << '{';
+        for (std::size_t n(0); n != value.elements_m.size(); ++n) {
+            if (n) out << ',';
+            write_json_string(out, value.names_m[n]);
+            out << ':';
+            write_json(out, value.elements_m[n]);
+        }
+        out << '}';
+        break;
+    }
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
@@ -0,0 +1,74 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_JSON_HPP
+#define EOP_JSON_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+#include <boost/container/vector.hpp>
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    json_value_t is a JSON value, as read by read_json(). An array keeps its elements in
+    elements_m; an object its member values there too, and the member names, in the same order,
+    in names_m. Lookups of a missing member or element give a null value, so a path into a
+    message can be followed without checking each step.
+*/
+
+struct json_value_t
+{
+    enum kind_t { null_k, boolean_k, number_k, string_k, array_k, object_k };
+
+    json_value_t() : kind_m(null_k), boolean_m(false), number_m(0) { }
+
+    const json_value_t& operator[](const char* name) const;
+    const json_value_t& operator[](std::size_t index) const;
+
+    bool is_null() const { return kind_m == null_k; }
+
+    kind_t                                  kind_m;
+    bool                                    boolean_m;
+    double                                  number_m;
+    std::string                             string_m;
+    boost::container::vector<json_value_t>  elements_m;
+    boost::container::vector<std::string>   names_m;
+};
+
+/*
+    read_json() reads the JSON text [first, last) into result; returns false if it is not well
+    formed. Values nest at most 256 deep. Strings are kept as UTF-8.
+*/
+
+bool read_json(const char* first, const char* last, json_value_t& result);
+
+//  write_json() writes value to out as JSON; write_json_string() a string, quoted and escaped.
+
+void write_json(std::ostream& out, const json_value_t& value);
+void write_json_string(std::ostream& out, const std::string& value);
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
@@ -16,11 +16,20 @@
 #include <adobe/istream.hpp>
 
 #include <boost/array.hpp>
+#include <boost/atomic.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <iostream>
 #include <sstream>
 
+#include "eop_allocation.hpp"
 #include "eop_lex_stream.hpp"
+#include "eop_token_file.hpp"
+#include "eop_trace.hpp"
 
 /*************************************************************************************************/
 
@@ -88,9 +97,14 @@ struct stream_lex_base_t
 
     virtual ~stream_lex_base_t();
 
+    void                        reset(I first, I last, const line_position_t& position);
+
     const stream_lex_token_t&   get_token();
     void                        putback_token();
     void                        put_token(stream_lex_token_t token);
+    void                        take_token(stream_lex_token_t token, const line_position_t& position,
+                                    const char* error, const line_position_t& error_position);
+    bool                        token_pending() const { return !last_token_m.empty(); }
 
     bool                    get_char(char& c);
     void                    putback_char(char c);
@@ -100,9 +114,15 @@ struct stream_lex_base_t
     void                    throw_exception(const name_t& expected, const name_t& found);
     void                    throw_parser_exception(const char* error_string);
 
+    void                    set_defer_errors(bool defer) { defer_errors_m = defer; }
+    const char*             error() const { return error_m; }
+    const line_position_t&  error_position() const { return error_position_m; }
+    void                    clear_error() { error_m = 0; }
+
     virtual void            skip_white_space() = 0;
 
     const line_position_t&  next_position();
+    void                    mark_position() { line_position_m.position_m = streampos_m; }
 
     bool                    is_line_end(char c);
 
@@ -118,6 +138,9 @@ private:
     parse_token_proc_t                  parse_proc_m;
     boost::array<char, 8>               putback_m; // stack-based is faster
     std::size_t                         index_m; // for putback_m
+    bool                                defer_errors_m;
+    const char*                         error_m; // deferred, a literal
+    line_position_t                     error_position_m;
 
 #if !defined(ADOBE_NO_DOCUMENTATION)
     circular_queue<implementation::lex_fragment_t>  last_token_m; // N token lookahead
@@ -134,6 +157,8 @@ stream_lex_base_t<S, I>::stream_lex_base_t(I first, I last, const line_position_
     streampos_m(1),
     line_position_m(position),
     index_m(0),
+    defer_errors_m(false),
+    error_m(0),
     last_token_m(S)
 { }
 
@@ -145,6 +170,27 @@ stream_lex_base_t<S, I>::~stream_lex_base_t()
 
 /*************************************************************************************************/
 
+/*
+    reset() rebinds the lexer to a new input but keeps the lookahead queue and the identifier
+    buffer, so their storage is reused from one input to the next.
+*/
+
+template <std::size_t S, typename I>
+void stream_lex_base_t<S, I>::reset(I first, I last, const line_position_t& position)
+{
+    first_m = first;
+    last_m = last;
+    streampos_m = 1;
+    line_position_m = position;
+    index_m = 0;
+    error_m = 0;
+
+    last_token_m.clear();
+    identifier_buffer_m.clear();
+}
+
+/*************************************************************************************************/
+
 template <std::size_t S, typename I>
 bool stream_lex_base_t<S, I>::get_char(char& c)
 {
@@ -228,7 +274,7 @@ const stream_lex_token_t& stream_lex_base_t<S, I>::get_token()
 
         skip_white_space();
 
-        line_position_m.position_m = streampos_m; // remember the start of the token position
+        mark_position(); // remember the start of the token position
 
     /*
         REVISIT (sparent) : I don't like that eof is not handled as the other tokens are handled
@@ -258,6 +304,26 @@ void stream_lex_base_t<S, I>::put_token(stream_lex_token_t token)
 
 /*************************************************************************************************/
 
+/*
+    take_token() queues a token lexed elsewhere as if it had been lexed here: at its position,
+    reporting the error, if any, found lexing it - thrown, or kept if errors are deferred.
+*/
+
+template <std::size_t S, typename I>
+void stream_lex_base_t<S, I>::take_token(stream_lex_token_t token, const line_position_t& position,
+    const char* error, const line_position_t& error_position)
+{
+    if (error) {
+        line_position_m = error_position;
+        throw_parser_exception(error);
+    }
+
+    line_position_m = position;
+    put_token(move(token));
+}
+
+/*************************************************************************************************/
+
 template <std::size_t S, typename I>
 void stream_lex_base_t<S, I>::putback_token()
 {
@@ -301,12 +367,21 @@ bool stream_lex_base_t<S, I>::is_line_end(char c)
 
 /*************************************************************************************************/
 
+/*
+    With errors deferred the first error is recorded instead of thrown and the caller carries on
+    as best it can; the parser checks error() after each token.
+*/
+
 template <std::size_t S, typename I>
 void stream_lex_base_t<S, I>::throw_parser_exception(const char* error_string)
 {
     using adobe::throw_parser_exception;
 
-    throw_parser_exception(error_string, line_position_m);
+    if (!defer_errors_m) throw_parser_exception(error_string, line_position_m);
+    if (error_m) return;
+
+    error_m = error_string;
+    error_position_m = line_position_m;
 }
 
 /*************************************************************************************************/
@@ -489,10 +564,25 @@ struct lex_stream_t::implementation_t : stream_lex_base_t<2, std::istream_iterat
     typedef std::istream::pos_type pos_type;
 
     implementation_t(std::istream& in, const line_position_t& position);
+    implementation_t(const implementation_t& x);
+
+    ~implementation_t();
+
+    implementation_t& operator=(const implementation_t& x);
+
+    void reset(std::istream& in, const line_position_t& position);
+    void reset(const token_file_t& tokens, const line_position_t& position);
 
     void set_keyword_extension_lookup(const keyword_extension_lookup_proc_t& proc);
 
+    void set_pipelined(bool pipelined) { pipelined_m = pipelined; }
+    void stop_pipeline();
+    void pipe_token();
+
  private:
+    class token_pipe_t;
+
+    void bind_parse_token();
     void parse_token(char c);
 
     bool is_comment(char c, stream_lex_token_t& result);
@@ -506,6 +596,12 @@ struct lex_stream_t::implementation_t : stream_lex_base_t<2, std::istream_iterat
     bool skip_space(char& c);
 
     keyword_extension_lookup_proc_t     keyword_proc_m;
+    bool                                pipelined_m;
+    boost::scoped_ptr<token_pipe_t>     pipe_m; // the lexing thread, once started
+    bool                                stopped_m; // the pipe was stopped; only eof is left
+    const token_file_t*                 replay_m; // replayed in place of the input, if any
+    token_cursor_t                      cursor_m; // the next token of replay_m
+    line_position_t                     replay_position_m; // of the last token replayed
 };
 
 /*************************************************************************************************/
@@ -529,17 +625,50 @@ lex_stream_t& lex_stream_t::operator = (const lex_stream_t& rhs)
 #endif // !defined(ADOBE_NO_DOCUMENTATION)
 
 const stream_lex_token_t& lex_stream_t::get()
-    { return object_m->get_token(); }
+{
+    EOP_TRACE_SCOPE("lex_stream_t::get");
+    EOP_ALLOCATION_PHASE(lexing_phase_k);
+    object_m->pipe_token();
+    return object_m->get_token();
+}
 
 void lex_stream_t::putback()
     { object_m->putback_token(); }
 
 const line_position_t& lex_stream_t::next_position()
-    { return object_m->next_position(); }
+{
+    EOP_ALLOCATION_PHASE(lexing_phase_k);
+    object_m->pipe_token();
+    return object_m->next_position();
+}
 
 void lex_stream_t::set_keyword_extension_lookup(const keyword_extension_lookup_proc_t& proc)
     { return object_m->set_keyword_extension_lookup(proc); }
 
+void lex_stream_t::reset(std::istream& in, const line_position_t& position)
+    { object_m->reset(in, position); }
+
+void lex_stream_t::reset(const token_file_t& tokens, const line_position_t& position)
+    { object_m->reset(tokens, position); }
+
+void lex_stream_t::set_pipelined(bool pipelined)
+    { object_m->set_pipelined(pipelined); }
+
+void lex_stream_t::stop_pipeline()
+    { object_m->stop_pipeline(); }
+
+void lex_stream_t::set_defer_errors(bool defer)
+    { object_m->set_defer_errors(defer); }
+
+const char* lex_stream_t::error() const
+    { return object_m->error(); }
+
+const line_position_t& lex_stream_t::error_position() const
+    { return object_m->error_position(); }
+
+void lex_stream_t::clear_error()
+    { object_m->clear_error(); }
+
 /*************************************************************************************************/
 
 #if 0
@@ -548,16 +677,275 @@ void lex_stream_t::set_keyword_extension_lookup(const keyword_extension_lookup_p
 
 /*************************************************************************************************/
 
-lex_stream_t::implementation_t::implementation_t(std::istream& in, const line_position_t& position) :
-    _super(std::istream_iterator<char>(in), std::istream_iterator<char>(), position)
+/*
+    The skipws flag has to be cleared before the iterator is constructed - istream_iterator reads
+    its first character on construction and would otherwise drop leading white space, leaving
+    every recorded position short by that amount.
+*/
+
+namespace {
+
+std::istream_iterator<char> unskipped_begin(std::istream& in)
 {
     in.unsetf(std::ios_base::skipws);
 
+    return std::istream_iterator<char>(in);
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+/*
+    token_pipe_t lexes on a thread of its own. The producer is a copy of the stream's lexer, so
+    it picks up the input where that left off, and passes each token through a bounded
+    single-producer, single-consumer queue with its position and the error, if any, found
+    lexing it; the consumer reports the error as it takes the token, so errors arrive in order
+    and at the token they belong to. The producer stops at the end of the input, or when the
+    pipe is destroyed.
+*/
+
+namespace {
+
+struct pipe_token_t
+{
+    pipe_token_t() : error_m(0) { }
+
+    stream_lex_token_t  token_m;
+    line_position_t     position_m;
+    const char*         error_m;
+    line_position_t     error_position_m;
+};
+
+const std::size_t pipe_capacity_k = 1024;
+
+} // namespace
+
+class lex_stream_t::implementation_t::token_pipe_t : boost::noncopyable
+{
+ public:
+    explicit token_pipe_t(const implementation_t& lexer);
+    ~token_pipe_t();
+
+    // Waits for the next token; returns false once the producer is done and the queue empty.
+    bool pop(pipe_token_t& result);
+
+ private:
+    void run();
+    bool push(const pipe_token_t& token);
+
+    implementation_t                            lexer_m;
+    boost::lockfree::spsc_queue<pipe_token_t>   queue_m;
+    boost::atomic<bool>                         stop_m;
+    boost::atomic<bool>                         done_m;
+    boost::exception_ptr                        failure_m; // written before done_m is set
+    boost::thread                               thread_m; // last, started once the rest is built
+};
+
+/*************************************************************************************************/
+
+lex_stream_t::implementation_t::token_pipe_t::token_pipe_t(const implementation_t& lexer) :
+    lexer_m(lexer),
+    queue_m(pipe_capacity_k),
+    stop_m(false),
+    done_m(false),
+    thread_m(boost::bind(&token_pipe_t::run, this))
+{ }
+
+lex_stream_t::implementation_t::token_pipe_t::~token_pipe_t()
+{
+    stop_m.store(true, boost::memory_order_relaxed);
+    thread_m.join();
+}
+
+/*************************************************************************************************/
+
+bool lex_stream_t::implementation_t::token_pipe_t::push(const pipe_token_t& token)
+{
+    while (!queue_m.push(token)) {
+        if (stop_m.load(boost::memory_order_relaxed)) return false;
+        boost::this_thread::yield();
+    }
+    return true;
+}
+
+void lex_stream_t::implementation_t::token_pipe_t::run()
+{
+    EOP_ALLOCATION_PHASE(lexing_phase_k);
+
+    // An error the stream's lexer had already found is its own to report.
+    lexer_m.set_defer_errors(true);
+    lexer_m.clear_error();
+
+    try {
+        while (!stop_m.load(boost::memory_order_relaxed)) {
+            pipe_token_t token;
+
+            token.position_m = lexer_m.next_position();
+            token.token_m = lexer_m.get_token();
+            token.error_m = lexer_m.error();
+            if (token.error_m) {
+                token.error_position_m = lexer_m.error_position();
+                lexer_m.clear_error();
+            }
+
+            // With errors deferred a token the lexer cannot make is eof, with the error.
+            if (!push(token) || (token.token_m.first == eof_k && !token.error_m)) break;
+        }
+    } catch (...) {
+        failure_m = boost::current_exception();
+    }
+
+    done_m.store(true, boost::memory_order_release);
+}
+
+/*************************************************************************************************/
+
+bool lex_stream_t::implementation_t::token_pipe_t::pop(pipe_token_t& result)
+{
+    while (!queue_m.pop(result)) {
+        if (done_m.load(boost::memory_order_acquire)) {
+            if (queue_m.pop(result)) break;
+            if (failure_m) boost::rethrow_exception(failure_m);
+            return false;
+        }
+        boost::this_thread::yield();
+    }
+    return true;
+}
+
+/*************************************************************************************************/
+
+lex_stream_t::implementation_t::implementation_t(std::istream& in, const line_position_t& position) :
+    _super(unskipped_begin(in), std::istream_iterator<char>(), position),
+    pipelined_m(false),
+    stopped_m(false),
+    replay_m(0)
+{
+    bind_parse_token();
+}
+
+/*
+    A copy lexes on from where the original is, and must call back into itself rather than
+    into the original. A running pipe is not copied - its producer is ahead of the original.
+*/
+
+lex_stream_t::implementation_t::implementation_t(const implementation_t& x) :
+    _super(x),
+    keyword_proc_m(x.keyword_proc_m),
+    pipelined_m(x.pipelined_m),
+    stopped_m(x.stopped_m),
+    replay_m(x.replay_m),
+    cursor_m(x.cursor_m),
+    replay_position_m(x.replay_position_m)
+{
+    bind_parse_token();
+}
+
+lex_stream_t::implementation_t::~implementation_t()
+{ }
+
+lex_stream_t::implementation_t& lex_stream_t::implementation_t::operator=(const implementation_t& x)
+{
+    pipe_m.reset();
+
+    _super::operator=(x);
+    keyword_proc_m = x.keyword_proc_m;
+    pipelined_m = x.pipelined_m;
+    stopped_m = x.stopped_m;
+    replay_m = x.replay_m;
+    cursor_m = x.cursor_m;
+    replay_position_m = x.replay_position_m;
+
+    bind_parse_token();
+    return *this;
+}
+
+void lex_stream_t::implementation_t::bind_parse_token()
+{
     _super::set_parse_token_proc(boost::bind(&lex_stream_t::implementation_t::parse_token, boost::ref(*this), _1));
 }
 
 /*************************************************************************************************/
 
+void lex_stream_t::implementation_t::reset(std::istream& in, const line_position_t& position)
+{
+    pipe_m.reset();
+    stopped_m = false;
+    replay_m = 0;
+
+    _super::reset(unskipped_begin(in), std::istream_iterator<char>(), position);
+}
+
+//  Replaying, the lexer is bound to an empty input; every token comes through pipe_token().
+
+void lex_stream_t::implementation_t::reset(const token_file_t& tokens,
+        const line_position_t& position)
+{
+    pipe_m.reset();
+    stopped_m = false;
+    replay_m = &tokens;
+    cursor_m = token_cursor_t();
+    replay_position_m = position;
+
+    _super::reset(std::istream_iterator<char>(), std::istream_iterator<char>(), position);
+}
+
+/*************************************************************************************************/
+
+/*
+    The producer has read past the stream's own lexer, so once it is stopped the stream has
+    nothing more to give until it is reset.
+*/
+
+void lex_stream_t::implementation_t::stop_pipeline()
+{
+    if (!pipe_m) return;
+    pipe_m.reset();
+    stopped_m = true;
+}
+
+/*
+    Once the lookahead is drained the next token comes from the token file being replayed, or
+    else from the pipe, started on the first token wanted after pipelining is turned on. After
+    the last token each is eof again, as the lexer's would be.
+*/
+
+void lex_stream_t::implementation_t::pipe_token()
+{
+    if (!(pipelined_m || pipe_m || replay_m || stopped_m) || _super::token_pending()) return;
+
+    if (stopped_m) {
+        _super::put_token(stream_lex_token_t(eof_k, any_regular_t()));
+        return;
+    }
+
+    if (replay_m) {
+        stream_lex_token_t  token;
+        const char*         error;
+        line_position_t     error_position;
+
+        if (replay_m->next(cursor_m, token, replay_position_m, error, error_position))
+            _super::take_token(move(token), replay_position_m, error, error_position);
+        else
+            _super::put_token(stream_lex_token_t(eof_k, any_regular_t()));
+        return;
+    }
+
+    if (!pipe_m) pipe_m.reset(new token_pipe_t(*this));
+
+    pipe_token_t token;
+
+    if (pipe_m->pop(token)) {
+        _super::take_token(move(token.token_m), token.position_m, token.error_m,
+            token.error_position_m);
+    } else {
+        _super::put_token(stream_lex_token_t(eof_k, any_regular_t()));
+    }
+}
+
+/*************************************************************************************************/
+
 void lex_stream_t::implementation_t::set_keyword_extension_lookup(const keyword_extension_lookup_proc_t& proc)
 {
     keyword_proc_m = proc;
@@ -673,8 +1061,12 @@ bool lex_stream_t::implementation_t::is_comment(char c, stream_lex_token_t& resu
     {
         while (true)
         {
-            if (!_super::get_char(c))
+            if (!_super::get_char(c)) {
+                // Comments are skipped ahead of a token, so the position is still the last one's.
+                _super::mark_position();
                 throw_parser_exception("Unexpected EOF in comment.");
+                break;
+            }
 
             if (c == '*')
             {
@@ -717,7 +1109,7 @@ bool lex_stream_t::implementation_t::is_string(char c, stream_lex_token_t& resul
             identifier_buffer_m.push_back(c);
         }
 
-        if (c != end_char) throw_parser_exception("Unexpected EOF in string.");
+        if (c != end_char) { throw_parser_exception("Unexpected EOF in string."); break; }
         
         if (!skip_space(c)) break;
         
@@ -838,7 +1230,10 @@ void lex_stream_t::implementation_t::parse_token(char c)
         ||  is_string(c,result)
         ||  is_compound(c, result)
         ||  is_simple(c, result)))
-        { throw_parser_exception("Syntax Error"); }
+    {
+        throw_parser_exception("Syntax Error");
+        result = stream_lex_token_t(eof_k, any_regular_t()); // only reached with errors deferred
+    }
 
     put_token(move(result));
 }
@@ -85,6 +85,44 @@ public:
 
     void                        set_keyword_extension_lookup(const keyword_extension_lookup_proc_t& proc);
 
+    /*
+        Rebinds the stream to a new input. Pending lookahead is discarded, the keyword extension
+        lookup is kept and buffers retain their capacity.
+    */
+    void                        reset(std::istream& in, const line_position_t& position);
+
+    /*
+        Rebinds the stream to the tokens of a token file, from the first, in place of an input;
+        position gives the file name of their positions. Nothing is lexed, so pipelining and
+        the keyword extension lookup have no effect. The file must outlive its use.
+    */
+    void                        reset(const token_file_t& tokens, const line_position_t& position);
+
+    /*
+        With pipelining on the stream is lexed ahead on a thread of its own, from the first token
+        wanted after it is turned on, and the tokens handed over through a bounded lock-free
+        queue; tokens, positions and errors are as without it. Turning it off takes effect at
+        the next reset(). The keyword extension lookup must be set before, and is then called
+        from the lexing thread; names are interned from that thread too.
+    */
+    void                        set_pipelined(bool pipelined);
+
+    /*
+        stop_pipeline() stops the lexing thread, if running, and waits for it; it must be
+        called before the input goes, as the thread may be reading ahead in it. The stream then
+        gives only eof until it is reset.
+    */
+    void                        stop_pipeline();
+
+    /*
+        With errors deferred malformed input does not throw: the first error is kept, error()
+        returns its message until clear_error(), and lexing continues past the offending text.
+    */
+    void                        set_defer_errors(bool defer);
+    const char*                 error() const;
+    const line_position_t&      error_position() const;
+    void                        clear_error();
+
 #if !defined(ADOBE_NO_DOCUMENTATION)
 private:
     friend void ::swap(lex_stream_t&, lex_stream_t&);
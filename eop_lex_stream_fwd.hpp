@@ -39,6 +39,7 @@ typedef boost::function<keyword_extension_lookup_proc_signature_t> keyword_exten
 /*************************************************************************************************/
 
 class lex_stream_t;
+class token_file_t;
 
 /*************************************************************************************************/
 
@@ -0,0 +1,656 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <exception>
+#include <istream>
+#include <ostream>
+
+#include "eop_lsp_server.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+// Error codes of JSON-RPC and the protocol.
+
+const int parse_error_k             = -32700;
+const int invalid_request_k         = -32600;
+const int method_not_found_k        = -32601;
+const int internal_error_k          = -32603;
+const int server_not_initialized_k  = -32002;
+
+// Symbol kinds of the protocol.
+
+const int enum_symbol_k             = 10;
+const int function_symbol_k         = 12;
+const int struct_symbol_k           = 23;
+
+/*
+    Reads the next message into body: header lines, each ended by "\r\n", an empty line, then
+    Content-Length bytes of content. Returns false at the end of the input.
+*/
+
+bool read_message(std::istream& in, std::string& body)
+{
+    const char  header[] = "content-length:";
+    std::size_t length(std::string::npos);
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+
+        if (line.empty()) {
+            if (length == std::string::npos) continue; // not a header; resynchronize
+            body.resize(length);
+            return !length || in.read(&body[0], length);
+        }
+
+        std::size_t n(0);
+
+        while (header[n] && n != line.size()
+                && std::tolower(static_cast<unsigned char>(line[n])) == header[n])
+            ++n;
+        if (!header[n]) length = std::strtoul(line.c_str() + n, 0, 10);
+    }
+    return false;
+}
+
+inline bool is_identifier(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+//  The UTF-16 code units of a UTF-8 sequence starting with c; none for a continuation byte.
+
+inline std::size_t utf16_units(char c)
+{
+    unsigned char x(static_cast<unsigned char>(c));
+
+    return (x & 0xC0) == 0x80 ? 0 : x >= 0xF0 ? 2 : 1;
+}
+
+//  Finds name as a whole word within [first, last) of text; returns npos if it is not there.
+
+std::size_t find_word(const std::string& text, const std::string& name, std::size_t first,
+        std::size_t last)
+{
+    if (name.empty()) return std::string::npos;
+
+    for (std::size_t n(text.find(name, first)); n != std::string::npos && n + name.size() <= last;
+            n = text.find(name, n + 1)) {
+        std::size_t end(n + name.size());
+
+        if (n != 0 && is_identifier(name[0]) && is_identifier(text[n - 1])) continue;
+        if (end != text.size() && is_identifier(name[name.size() - 1]) && is_identifier(text[end]))
+            continue;
+        return n;
+    }
+    return std::string::npos;
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+lsp_server_t::lsp_server_t(const expression_parser::snapshot_t& prelude,
+        const parse_options_t& options) :
+    parser_m(empty_m, line_position_t(""), prelude),
+    prelude_m(prelude),
+    out_m(0),
+    initialized_m(false),
+    shutdown_m(false),
+    exit_m(false)
+{
+    parse_options_t recovering(options);
+
+    recovering.recover_m = true;
+    parser_m.set_options(recovering);
+}
+
+/*************************************************************************************************/
+
+int lsp_server_t::run(std::istream& in, std::ostream& out)
+{
+    std::string body;
+
+    out_m = &out;
+
+    while (!exit_m && read_message(in, body)) {
+        json_value_t message;
+
+        if (!read_json(body.data(), body.data() + body.size(), message)) {
+            respond_error(json_value_t(), parse_error_k, "Parse error.");
+            continue;
+        }
+
+        try {
+            dispatch(message);
+        } catch (const std::exception& error) {
+            if (!message["id"].is_null()) respond_error(message["id"], internal_error_k, error.what());
+        }
+
+        // Parse and publish only once the messages waiting have been applied.
+        if (in.rdbuf()->in_avail() <= 0) flush();
+    }
+
+    out.flush();
+    return shutdown_m ? 0 : 1;
+}
+
+/*************************************************************************************************/
+
+void lsp_server_t::dispatch(const json_value_t& message)
+{
+    const std::string&  method(message["method"].string_m);
+    const json_value_t& id(message["id"]);
+    const json_value_t& params(message["params"]);
+    bool                request(!id.is_null());
+
+    if (method == "exit") { exit_m = true; return; }
+
+    if (!initialized_m && method != "initialize") {
+        if (request) respond_error(id, server_not_initialized_k, "Server not initialized.");
+        return;
+    }
+    if (shutdown_m) {
+        if (request) respond_error(id, invalid_request_k, "Server is shut down.");
+        return;
+    }
+
+    if (method == "initialize") {
+        initialized_m = true;
+        respond(id, "{\"capabilities\":{"
+            "\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+            "\"documentSymbolProvider\":true,\"definitionProvider\":true},"
+            "\"serverInfo\":{\"name\":\"eop\"}}");
+    } else if (method == "shutdown") {
+        shutdown_m = true;
+        respond(id, "null");
+    } else if (method == "textDocument/didOpen") {
+        open(params);
+    } else if (method == "textDocument/didChange") {
+        change(params);
+    } else if (method == "textDocument/didClose") {
+        close(params);
+    } else if (method == "textDocument/documentSymbol") {
+        symbols(id, params);
+    } else if (method == "textDocument/definition") {
+        definition(id, params);
+    } else if (request) {
+        respond_error(id, method_not_found_k, "Method not found: " + method);
+    }
+}
+
+/*************************************************************************************************/
+
+void lsp_server_t::open(const json_value_t& params)
+{
+    const json_value_t& item(params["textDocument"]);
+    document_t&         document(documents_m[item["uri"].string_m]);
+
+    document = document_t();
+    document.text_m = item["text"].string_m;
+    document.version_m = static_cast<long>(item["version"].number_m);
+    document.pending_m = true;
+    document.full_m = true;
+}
+
+/*************************************************************************************************/
+
+/*
+    Each change is applied to the text at once and merged into the pending edit. In the text
+    between, the pending edit covers [edit_offset_m, edit_offset_m + edit_size_m) and the change
+    [first, first + length); the merged edit covers both, mapped back to the parsed text on the
+    one side and on to the changed text on the other.
+*/
+
+void lsp_server_t::change(const json_value_t& params)
+{
+    document_map_t::iterator found(documents_m.find(params["textDocument"]["uri"].string_m));
+
+    if (found == documents_m.end()) return;
+
+    document_t&         document(found->second);
+    const json_value_t& changes(params["contentChanges"]);
+
+    document.version_m = static_cast<long>(params["textDocument"]["version"].number_m);
+
+    for (std::size_t n(0); n != changes.elements_m.size(); ++n) {
+        const json_value_t& change(changes.elements_m[n]);
+        const std::string&  text(change["text"].string_m);
+
+        if (change["range"].is_null()) {
+            document.text_m = text;
+            document.lines_m.clear();
+            document.pending_m = true;
+            document.full_m = true;
+            continue;
+        }
+
+        std::size_t first(offset(document, change["range"]["start"]));
+        std::size_t last((std::max)(first, offset(document, change["range"]["end"])));
+        std::size_t length(last - first);
+
+        document.text_m.replace(first, length, text);
+        move_lines(document, first, length, text.size());
+
+        if (document.full_m) continue;
+
+        if (!document.pending_m) {
+            document.edit_offset_m = first;
+            document.edit_length_m = length;
+            document.edit_size_m = text.size();
+        } else {
+            std::size_t begin((std::min)(document.edit_offset_m, first));
+            std::size_t end((std::max)(document.edit_offset_m + document.edit_size_m, last));
+
+            document.edit_length_m = end - document.edit_size_m + document.edit_length_m - begin;
+            document.edit_size_m = end + text.size() - length - begin;
+            document.edit_offset_m = begin;
+        }
+        document.pending_m = true;
+    }
+}
+
+/*************************************************************************************************/
+
+void lsp_server_t::close(const json_value_t& params)
+{
+    const std::string&       uri(params["textDocument"]["uri"].string_m);
+    document_map_t::iterator found(documents_m.find(uri));
+
+    if (found == documents_m.end()) return;
+
+    documents_m.erase(found);
+
+    std::ostringstream body;
+
+    body << "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\","
+        "\"params\":{\"uri\":";
+    write_json_string(body, uri);
+    body << ",\"diagnostics\":[]}}";
+    send(body.str());
+}
+
+/*************************************************************************************************/
+
+void lsp_server_t::symbols(const json_value_t& id, const json_value_t& params)
+{
+    const std::string&       uri(params["textDocument"]["uri"].string_m);
+    document_map_t::iterator found(documents_m.find(uri));
+
+    if (found == documents_m.end()) { respond(id, "null"); return; }
+
+    document_t&        document(found->second);
+    std::ostringstream result;
+    bool               first(true);
+
+    update(uri, document);
+
+    result << '[';
+
+    for (std::size_t n(0); n != document.result_m.declarations_m.size(); ++n) {
+        const declaration_t& declaration(*document.result_m.declarations_m[n]);
+
+        if (!declaration.name_m) continue;
+
+        std::string                          name(declaration.name_m.c_str());
+        std::pair<std::size_t, std::size_t>  range(extent(document, n));
+        std::size_t                          at(find_word(document.text_m, name, range.first,
+                                                range.second));
+        int                                  kind(declaration.kind_m == struct_k ? struct_symbol_k
+                                                : declaration.kind_m == enum_k ? enum_symbol_k
+                                                : function_symbol_k);
+
+        if (at == std::string::npos) at = range.first;
+
+        if (!first) result << ',';
+        first = false;
+
+        result << "{\"name\":";
+        write_json_string(result, name);
+        result << ",\"kind\":" << kind << ",\"range\":";
+        write_range(result, document, range.first, range.second);
+        result << ",\"selectionRange\":";
+        write_range(result, document, at, (std::min)(at + name.size(), range.second));
+        result << '}';
+    }
+
+    result << ']';
+    respond(id, result.str());
+}
+
+/*************************************************************************************************/
+
+/*
+    The identifier under the position is looked up among the names of the declarations of every
+    open document; each declaring it is a definition.
+*/
+
+void lsp_server_t::definition(const json_value_t& id, const json_value_t& params)
+{
+    document_map_t::iterator found(documents_m.find(params["textDocument"]["uri"].string_m));
+
+    if (found == documents_m.end()) { respond(id, "null"); return; }
+
+    const std::string& text(found->second.text_m);
+    std::size_t        at(offset(found->second, params["position"]));
+    std::size_t        first(at), last(at);
+
+    while (first != 0 && is_identifier(text[first - 1])) --first;
+    while (last != text.size() && is_identifier(text[last])) ++last;
+
+    if (first == last) { respond(id, "null"); return; }
+
+    std::string        name(text, first, last - first);
+    std::ostringstream result;
+    bool               any(false);
+
+    result << '[';
+
+    for (document_map_t::iterator document(documents_m.begin()); document != documents_m.end();
+            ++document) {
+        update(document->first, document->second);
+
+        typedef std::multimap<std::string, std::size_t>::const_iterator iterator;
+
+        std::pair<iterator, iterator> declarations(document->second.names_m.equal_range(name));
+
+        for (; declarations.first != declarations.second; ++declarations.first) {
+            std::pair<std::size_t, std::size_t> range(extent(document->second,
+                                                        declarations.first->second));
+            std::size_t                         start(find_word(document->second.text_m, name,
+                                                        range.first, range.second));
+
+            if (start == std::string::npos) start = range.first;
+
+            if (any) result << ',';
+            any = true;
+
+            result << "{\"uri\":";
+            write_json_string(result, document->first);
+            result << ",\"range\":";
+            write_range(result, document->second, start,
+                (std::min)(start + name.size(), range.second));
+            result << '}';
+        }
+    }
+
+    result << ']';
+    respond(id, any ? result.str() : std::string("null"));
+}
+
+/*************************************************************************************************/
+
+void lsp_server_t::update(const std::string& uri, document_t& document)
+{
+    if (!document.pending_m) return;
+
+    parse_result_t  result;
+    line_position_t position(uri.c_str());
+
+    if (document.full_m) {
+        std::istringstream stream(document.text_m);
+
+        parser_m.reset(stream, position, prelude_m);
+        parser_m.parse(result);
+        parser_m.reset(empty_m, position, prelude_m);
+    } else {
+        std::vector<text_edit_t> edits(1, text_edit_t(document.edit_offset_m,
+            document.edit_length_m, document.text_m.substr(document.edit_offset_m,
+            document.edit_size_m)));
+
+        parser_m.reparse(document.result_m, document.text_m, edits, position, result);
+    }
+
+    document.result_m.offset_m = result.offset_m;
+    document.result_m.declarations_m.swap(result.declarations_m);
+    document.result_m.diagnostics_m.swap(result.diagnostics_m);
+    document.pending_m = false;
+    document.full_m = false;
+    document.published_m = false;
+
+    // The index of the declarations by name.
+
+    std::size_t start(document.result_m.offset_m);
+
+    document.starts_m.clear();
+    document.names_m.clear();
+
+    for (std::size_t n(0); n != document.result_m.declarations_m.size(); ++n) {
+        const declaration_t& declaration(*document.result_m.declarations_m[n]);
+
+        document.starts_m.push_back(start);
+        start += declaration.length_m;
+        if (declaration.name_m)
+            document.names_m.insert(std::make_pair(std::string(declaration.name_m.c_str()), n));
+    }
+}
+
+/*************************************************************************************************/
+
+void lsp_server_t::publish(const std::string& uri, document_t& document)
+{
+    const std::vector<diagnostic_t>& diagnostics(document.result_m.diagnostics_m);
+    const std::string&               text(document.text_m);
+    std::ostringstream               body;
+
+    body << "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\","
+        "\"params\":{\"uri\":";
+    write_json_string(body, uri);
+    body << ",\"version\":" << document.version_m << ",\"diagnostics\":[";
+
+    for (std::size_t n(0); n != diagnostics.size(); ++n) {
+        std::size_t first((std::min)(diagnostics[n].offset_m, text.size()));
+        std::size_t last(first);
+
+        // The range is the identifier at the error, else the one character there.
+        while (last != text.size() && is_identifier(text[last])) ++last;
+        if (last == first && last != text.size() && text[last] != '\n' && text[last] != '\r')
+            ++last;
+
+        if (n) body << ',';
+        body << "{\"range\":";
+        write_range(body, document, first, last);
+        body << ",\"severity\":1,\"source\":\"eop\",\"message\":";
+        write_json_string(body, diagnostics[n].message_m);
+        body << '}';
+    }
+
+    body << "]}}";
+    send(body.str());
+
+    document.published_m = true;
+}
+
+/*************************************************************************************************/
+
+void lsp_server_t::flush()
+{
+    for (document_map_t::iterator document(documents_m.begin()); document != documents_m.end();
+            ++document) {
+        try {
+            update(document->first, document->second);
+            if (!document->second.published_m) publish(document->first, document->second);
+        } catch (const std::exception& error) {
+            log_error(document->first + ": " + error.what());
+        }
+    }
+}
+
+/*************************************************************************************************/
+
+void lsp_server_t::respond(const json_value_t& id, const std::string& result)
+{
+    std::ostringstream body;
+
+    body << "{\"jsonrpc\":\"2.0\",\"id\":";
+    write_json(body, id);
+    body << ",\"result\":" << result << '}';
+    send(body.str());
+}
+
+void lsp_server_t::respond_error(const json_value_t& id, int code, const std::string& message)
+{
+    std::ostringstream body;
+
+    body << "{\"jsonrpc\":\"2.0\",\"id\":";
+    write_json(body, id);
+    body << ",\"error\":{\"code\":" << code << ",\"message\":";
+    write_json_string(body, message);
+    body << "}}";
+    send(body.str());
+}
+
+//  Shows message in the client's log; a failure outside any request has no response to go in.
+
+void lsp_server_t::log_error(const std::string& message)
+{
+    std::ostringstream body;
+
+    body << "{\"jsonrpc\":\"2.0\",\"method\":\"window/logMessage\",\"params\":{\"type\":1,"
+        "\"message\":";
+    write_json_string(body, message);
+    body << "}}";
+    send(body.str());
+}
+
+void lsp_server_t::send(const std::string& body)
+{
+    *out_m << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+    out_m->flush();
+}
+
+/*************************************************************************************************/
+
+const std::vector<std::size_t>& lsp_server_t::lines(document_t& document)
+{
+    if (!document.lines_m.empty()) return document.lines_m;
+
+    const std::string& text(document.text_m);
+
+    document.lines_m.push_back(0);
+    for (std::size_t n(0); n != text.size(); ++n) {
+        if (text[n] == '\n' || (text[n] == '\r' && (n + 1 == text.size() || text[n + 1] != '\n')))
+            document.lines_m.push_back(n + 1);
+    }
+    return document.lines_m;
+}
+
+/*
+    Updates the line starts for length characters at first replaced by size characters. Whether
+    offset n starts a line depends on the characters at n - 1 and n, so only the starts from
+    first to one past the change are found again; those after move with the text.
+*/
+
+void lsp_server_t::move_lines(document_t& document, std::size_t first, std::size_t length,
+        std::size_t size)
+{
+    std::vector<std::size_t>& starts(document.lines_m);
+    const std::string&        text(document.text_m);
+
+    if (starts.empty()) return;
+
+    std::vector<std::size_t>::iterator begin(std::lower_bound(starts.begin() + 1, starts.end(),
+                                            first));
+    std::vector<std::size_t>::iterator end(std::upper_bound(begin, starts.end(),
+                                            first + length + 1));
+    std::vector<std::size_t>           inserted;
+
+    for (std::size_t n((std::max)(first, std::size_t(1)));
+            n <= (std::min)(first + size + 1, text.size()); ++n) {
+        if (text[n - 1] == '\n' || (text[n - 1] == '\r' && (n == text.size() || text[n] != '\n')))
+            inserted.push_back(n);
+    }
+
+    for (std::vector<std::size_t>::iterator p(end); p != starts.end(); ++p) *p = *p - length + size;
+
+    starts.insert(starts.erase(begin, end), inserted.begin(), inserted.end());
+}
+
+//  The offset of a protocol position, clamped to the end of its line.
+
+std::size_t lsp_server_t::offset(document_t& document, const json_value_t& position)
+{
+    const std::vector<std::size_t>& starts(lines(document));
+    const std::string&              text(document.text_m);
+    double                          line(position["line"].number_m);
+    double                          character(position["character"].number_m);
+
+    if (line < 0) return 0;
+    if (line >= starts.size()) return text.size();
+
+    std::size_t n(starts[std::size_t(line)]);
+
+    for (double units(0); n != text.size() && text[n] != '\n' && text[n] != '\r';) {
+        units += utf16_units(text[n]);
+        if (units > character) break;
+        ++n;
+        while (n != text.size() && !utf16_units(text[n])) ++n;
+    }
+    return n;
+}
+
+void lsp_server_t::write_position(std::ostream& out, document_t& document, std::size_t offset)
+{
+    const std::vector<std::size_t>& starts(lines(document));
+    const std::string&              text(document.text_m);
+
+    offset = (std::min)(offset, text.size());
+
+    std::size_t line(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1);
+    std::size_t character(0);
+
+    for (std::size_t n(starts[line]); n != offset; ++n) character += utf16_units(text[n]);
+
+    out << "{\"line\":" << line << ",\"character\":" << character << '}';
+}
+
+void lsp_server_t::write_range(std::ostream& out, document_t& document, std::size_t first,
+        std::size_t last)
+{
+    out << "{\"start\":";
+    write_position(out, document, first);
+    out << ",\"end\":";
+    write_position(out, document, last);
+    out << '}';
+}
+
+/*
+    The span of a declaration, to its closing ";" or "}" - a declaration's length runs on to the
+    next, so takes in the white space and comments between.
+*/
+
+std::pair<std::size_t, std::size_t> lsp_server_t::extent(const document_t& document,
+        std::size_t declaration)
+{
+    const std::string& text(document.text_m);
+    std::size_t        first((std::min)(document.starts_m[declaration], text.size()));
+    std::size_t        last((std::min)(first
+                            + document.result_m.declarations_m[declaration]->length_m,
+                            text.size()));
+    std::size_t        end(text.find_last_of(";}", last == 0 ? 0 : last - 1));
+
+    if (end != std::string::npos && end >= first) return std::make_pair(first, end + 1);
+
+    while (last != first && std::isspace(static_cast<unsigned char>(text[last - 1]))) --last;
+    return std::make_pair(first, last);
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
@@ -0,0 +1,137 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_LSP_SERVER_HPP
+#define EOP_LSP_SERVER_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "eop_json.hpp"
+#include "exp_parser.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    lsp_server_t is a language server speaking the Language Server Protocol (JSON-RPC with
+    Content-Length framing). It keeps each open document and its parse in memory: an edit only
+    reparses the declarations it touches, and diagnostics, document symbols and go to
+    definition are answered from the declarations recorded by the last parse, so a request costs
+    in proportion to what changed rather than to the input.
+
+    Edits are applied to the text as they arrive but parsed only once no further message is
+    waiting, or a request needs the parse; the edits queued meanwhile are merged into one
+    reparse, and the diagnostics published once, for the final text. Positions are in UTF-16
+    code units, as the protocol requires; any of "\n", "\r\n" and "\r" ends a line.
+
+    The parses recover from errors, so every error is published together with the declarations
+    that could be parsed; the other options are as given.
+*/
+
+class lsp_server_t : public boost::noncopyable
+{
+ public:
+    explicit lsp_server_t(const expression_parser::snapshot_t& prelude
+            = expression_parser::snapshot_t(), const parse_options_t& options = parse_options_t());
+
+/*
+    run() serves the messages read from in, writing the replies to out, until an exit
+    notification or the end of the input. Returns the exit code - zero only if a shutdown
+    request came first.
+*/
+    int run(std::istream& in, std::ostream& out);
+
+ private:
+    struct document_t
+    {
+        document_t() :
+            version_m(0), pending_m(false), full_m(false), published_m(false),
+            edit_offset_m(0), edit_length_m(0), edit_size_m(0)
+        { }
+
+        std::string                             text_m;
+        long                                    version_m;
+        parse_result_t                          result_m; // of the text before the pending edit
+        bool                                    pending_m; // text_m has changed since
+        bool                                    full_m; // the change is not a single edit
+        bool                                    published_m; // the diagnostics of result_m
+
+        /*
+            The pending edits merged into one: [edit_offset_m, edit_offset_m + edit_length_m)
+            of the parsed text became edit_size_m characters of text_m.
+        */
+        std::size_t                             edit_offset_m;
+        std::size_t                             edit_length_m;
+        std::size_t                             edit_size_m;
+
+        std::vector<std::size_t>                lines_m; // line starts of text_m; empty if stale
+        std::vector<std::size_t>                starts_m; // of the declarations of result_m
+        std::multimap<std::string, std::size_t> names_m; // to indices of declarations
+    };
+
+    typedef std::map<std::string, document_t> document_map_t;
+
+    void dispatch(const json_value_t& message);
+    void open(const json_value_t& params);
+    void change(const json_value_t& params);
+    void close(const json_value_t& params);
+    void symbols(const json_value_t& id, const json_value_t& params);
+    void definition(const json_value_t& id, const json_value_t& params);
+
+    void update(const std::string& uri, document_t& document);
+    void publish(const std::string& uri, document_t& document);
+    void flush();
+
+    void respond(const json_value_t& id, const std::string& result);
+    void respond_error(const json_value_t& id, int code, const std::string& message);
+    void log_error(const std::string& message);
+    void send(const std::string& body);
+
+    static const std::vector<std::size_t>& lines(document_t& document);
+    static void move_lines(document_t& document, std::size_t first, std::size_t length,
+            std::size_t size);
+    static std::size_t offset(document_t& document, const json_value_t& position);
+    static void write_position(std::ostream& out, document_t& document, std::size_t offset);
+    static void write_range(std::ostream& out, document_t& document, std::size_t first,
+            std::size_t last);
+    static std::pair<std::size_t, std::size_t> extent(const document_t& document,
+            std::size_t declaration);
+
+    std::istringstream              empty_m;
+    expression_parser               parser_m;
+    expression_parser::snapshot_t   prelude_m;
+    document_map_t                  documents_m;
+    std::ostream*                   out_m;
+    bool                            initialized_m;
+    bool                            shutdown_m;
+    bool                            exit_m;
+};
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
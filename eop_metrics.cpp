@@ -0,0 +1,541 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <process.h>
+    #define EOP_PROCESS_ID _getpid
+#else
+    #include <unistd.h>
+    #define EOP_PROCESS_ID getpid
+#endif
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "eop_metrics.hpp"
+
+/*************************************************************************************************/
+
+#if defined(_MSC_VER)
+    #define EOP_THREAD_LOCAL __declspec(thread)
+#else
+    #define EOP_THREAD_LOCAL __thread
+#endif
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+const char* const error_names_g[metric_error_count_k] = {
+    "syntax", "cancelled", "deadline", "token_budget", "read", "internal"
+};
+
+const char* const size_names_g[size_class_count_k] = {
+    "0-4KiB", "4KiB-64KiB", "64KiB-1MiB", "1MiB-"
+};
+
+// The largest latency with a bucket of its own, 2^32 - 1 microseconds.
+const boost::uint64_t latency_limit_k = UINT64_C(0xffffffff);
+
+std::size_t floor_log2(boost::uint64_t x)
+{
+    std::size_t result(0);
+
+    while (x >>= 1) ++result;
+    return result;
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+const char* metric_error_name(metric_error_t error)
+{
+    return error_names_g[error];
+}
+
+size_class_t size_class(std::size_t bytes)
+{
+    if (bytes < 4 * 1024) return small_size_k;
+    if (bytes < 64 * 1024) return medium_size_k;
+    if (bytes < 1024 * 1024) return large_size_k;
+    return huge_size_k;
+}
+
+const char* size_class_name(size_class_t size)
+{
+    return size_names_g[size];
+}
+
+/*************************************************************************************************/
+
+/*
+    Below 64 a latency is its own bucket. From 2^m, m of six or more, to 2^(m + 1) there are 32
+    buckets each 2^(m - 5) wide; the bucket of x is the top six bits of x, less the 32 which
+    are always set, after the buckets of the lower powers.
+*/
+
+std::size_t latency_histogram_t::bucket(boost::uint64_t microseconds)
+{
+    boost::uint64_t x((std::min)(microseconds, latency_limit_k));
+
+    if (x < 64) return std::size_t(x);
+
+    std::size_t m(floor_log2(x));
+
+    return 64 + (m - 6) * 32 + std::size_t(x >> (m - 5)) - 32;
+}
+
+boost::uint64_t latency_histogram_t::bucket_low(std::size_t bucket)
+{
+    if (bucket < 64) return bucket;
+
+    std::size_t m((bucket - 64) / 32 + 6);
+
+    return boost::uint64_t(32 + (bucket - 64) % 32) << (m - 5);
+}
+
+boost::uint64_t latency_histogram_t::bucket_high(std::size_t bucket)
+{
+    if (bucket + 1 == bucket_count_k) return latency_limit_k;
+    return bucket_low(bucket + 1) - 1;
+}
+
+latency_histogram_t::latency_histogram_t() : count_m(0), sum_m(0)
+{
+    std::fill(counts_m, counts_m + bucket_count_k, boost::uint64_t(0));
+}
+
+void latency_histogram_t::record(boost::uint64_t microseconds)
+{
+    ++counts_m[bucket(microseconds)];
+    ++count_m;
+    sum_m += microseconds;
+}
+
+void latency_histogram_t::merge(const latency_histogram_t& x)
+{
+    for (std::size_t n(0); n != bucket_count_k; ++n) counts_m[n] += x.counts_m[n];
+    count_m += x.count_m;
+    sum_m += x.sum_m;
+}
+
+boost::uint64_t latency_histogram_t::quantile(double q) const
+{
+    if (!count_m) return 0;
+
+    boost::uint64_t rank(boost::uint64_t(q * double(count_m) + 0.5));
+    boost::uint64_t seen(0);
+
+    if (rank == 0) rank = 1;
+
+    for (std::size_t n(0); n != bucket_count_k; ++n) {
+        seen += counts_m[n];
+        if (seen >= rank) return bucket_high(n);
+    }
+    return latency_limit_k;
+}
+
+boost::uint64_t latency_histogram_t::count_below(boost::uint64_t microseconds) const
+{
+    boost::uint64_t result(0);
+
+    for (std::size_t n(0); n != bucket_count_k && bucket_low(n) < microseconds; ++n)
+        result += counts_m[n];
+    return result;
+}
+
+/*************************************************************************************************/
+
+metrics_t::metrics_t() : files_m(0), bytes_m(0), tokens_m(0)
+{
+    std::fill(errors_m, errors_m + metric_error_count_k, boost::uint64_t(0));
+}
+
+/*************************************************************************************************/
+
+namespace {
+
+/*
+    A counter of a block is written only by the thread owning the block, so it is stored
+    rather than incremented atomically; it is atomic only so that read_metrics() may load it
+    from another thread. Relaxed order suffices as no counter guards any other data.
+*/
+
+typedef boost::atomic<boost::uint64_t> counter_t;
+
+inline void add(counter_t& counter, boost::uint64_t n)
+{
+    counter.store(counter.load(boost::memory_order_relaxed) + n, boost::memory_order_relaxed);
+}
+
+inline boost::uint64_t load(const counter_t& counter)
+{
+    return counter.load(boost::memory_order_relaxed);
+}
+
+struct histogram_block_t
+{
+    counter_t counts_m[latency_histogram_t::bucket_count_k];
+    counter_t count_m;
+    counter_t sum_m;
+};
+
+struct metrics_block_t
+{
+    metrics_block_t()
+    {
+        files_m.store(0);
+        bytes_m.store(0);
+        tokens_m.store(0);
+        for (std::size_t n(0); n != metric_error_count_k; ++n) errors_m[n].store(0);
+        for (std::size_t n(0); n != size_class_count_k; ++n) {
+            histogram_block_t& latency(latency_m[n]);
+
+            for (std::size_t i(0); i != latency_histogram_t::bucket_count_k; ++i)
+                latency.counts_m[i].store(0);
+            latency.count_m.store(0);
+            latency.sum_m.store(0);
+        }
+    }
+
+    //  Adds the counts of this block to result.
+    void read(metrics_t& result) const
+    {
+        result.files_m += load(files_m);
+        result.bytes_m += load(bytes_m);
+        result.tokens_m += load(tokens_m);
+        for (std::size_t n(0); n != metric_error_count_k; ++n)
+            result.errors_m[n] += load(errors_m[n]);
+        for (std::size_t n(0); n != size_class_count_k; ++n) {
+            const histogram_block_t&    latency(latency_m[n]);
+            latency_histogram_t&        histogram(result.latency_m[n]);
+
+            for (std::size_t i(0); i != latency_histogram_t::bucket_count_k; ++i)
+                histogram.counts_m[i] += load(latency.counts_m[i]);
+            histogram.count_m += load(latency.count_m);
+            histogram.sum_m += load(latency.sum_m);
+        }
+    }
+
+    //  Adds the counts of x to this block; the registry must be locked.
+    void fold(const metrics_block_t& x)
+    {
+        add(files_m, load(x.files_m));
+        add(bytes_m, load(x.bytes_m));
+        add(tokens_m, load(x.tokens_m));
+        for (std::size_t n(0); n != metric_error_count_k; ++n)
+            add(errors_m[n], load(x.errors_m[n]));
+        for (std::size_t n(0); n != size_class_count_k; ++n) {
+            for (std::size_t i(0); i != latency_histogram_t::bucket_count_k; ++i)
+                add(latency_m[n].counts_m[i], load(x.latency_m[n].counts_m[i]));
+            add(latency_m[n].count_m, load(x.latency_m[n].count_m));
+            add(latency_m[n].sum_m, load(x.latency_m[n].sum_m));
+        }
+    }
+
+    counter_t           files_m;
+    counter_t           bytes_m;
+    counter_t           tokens_m;
+    counter_t           errors_m[metric_error_count_k];
+    histogram_block_t   latency_m[size_class_count_k];
+};
+
+/*
+    The registry holds the block of every live thread which has counted, and the sum of the
+    blocks of those which have exited. It is locked only as a thread counts for the first time
+    and as it exits, and by read_metrics().
+*/
+
+struct registry_t
+{
+    boost::mutex                    mutex_m;
+    std::vector<metrics_block_t*>   blocks_m;
+    metrics_block_t                 exited_m;
+};
+
+/*
+    The registry is never destroyed: a thread, the main thread among them, may release its
+    block during static destruction, after a static registry would be gone.
+*/
+
+registry_t& registry()
+{
+    static registry_t* registry_s(new registry_t);
+    return *registry_s;
+}
+
+void release_block(metrics_block_t* block)
+{
+    registry_t&                     metrics(registry());
+    boost::lock_guard<boost::mutex> lock(metrics.mutex_m);
+
+    metrics.exited_m.fold(*block);
+    metrics.blocks_m.erase(std::find(metrics.blocks_m.begin(), metrics.blocks_m.end(), block));
+    delete block;
+}
+
+/*
+    The block of a thread is found through a thread local pointer; the thread specific pointer
+    is there only to release the block as the thread exits.
+*/
+
+boost::thread_specific_ptr<metrics_block_t> thread_block_g(&release_block);
+EOP_THREAD_LOCAL metrics_block_t*           block_g;
+
+metrics_block_t& thread_block()
+{
+    if (!block_g) {
+        registry_t& metrics(registry());
+        {
+        boost::lock_guard<boost::mutex> lock(metrics.mutex_m);
+
+        // Room is made first, so once the block is allocated nothing can throw and leak it.
+        metrics.blocks_m.reserve(metrics.blocks_m.size() + 1);
+        block_g = new metrics_block_t;
+        metrics.blocks_m.push_back(block_g);
+        }
+        thread_block_g.reset(block_g);
+    }
+    return *block_g;
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+void count_parse(std::size_t bytes, std::size_t tokens, boost::uint64_t microseconds)
+{
+    metrics_block_t&    block(thread_block());
+    histogram_block_t&  latency(block.latency_m[size_class(bytes)]);
+
+    add(block.files_m, 1);
+    add(block.bytes_m, bytes);
+    add(block.tokens_m, tokens);
+    add(latency.counts_m[latency_histogram_t::bucket(microseconds)], 1);
+    add(latency.count_m, 1);
+    add(latency.sum_m, microseconds);
+}
+
+void count_error(metric_error_t error, std::size_t count)
+{
+    if (count) add(thread_block().errors_m[error], count);
+}
+
+metrics_t read_metrics()
+{
+    metrics_t                       result;
+    registry_t&                     metrics(registry());
+    boost::lock_guard<boost::mutex> lock(metrics.mutex_m);
+
+    metrics.exited_m.read(result);
+    for (std::size_t n(0); n != metrics.blocks_m.size(); ++n) metrics.blocks_m[n]->read(result);
+    return result;
+}
+
+/*************************************************************************************************/
+
+namespace {
+
+//  Powers of two microseconds, from 16 to 2^32, bound the buckets written to Prometheus.
+const std::size_t first_bound_k = 4;
+const std::size_t last_bound_k = 32;
+
+void write_seconds(std::ostream& out, boost::uint64_t microseconds)
+{
+    char buffer[32];
+
+    std::sprintf(buffer, "%.6f", double(microseconds) / 1e6);
+    out << buffer;
+}
+
+void write_counter(std::ostream& out, const char* name, const char* help, boost::uint64_t value)
+{
+    out << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << " counter\n"
+        << name << ' ' << value << '\n';
+}
+
+} // namespace
+
+void write_prometheus(std::ostream& out, const metrics_t& metrics)
+{
+    write_counter(out, "eop_files_parsed_total", "Files parsed to their end.", metrics.files_m);
+    write_counter(out, "eop_bytes_parsed_total", "Bytes of the files parsed.", metrics.bytes_m);
+    write_counter(out, "eop_tokens_parsed_total", "Tokens of the files parsed.",
+        metrics.tokens_m);
+
+    out << "# HELP eop_errors_total Errors by kind.\n"
+        << "# TYPE eop_errors_total counter\n";
+    for (std::size_t n(0); n != metric_error_count_k; ++n) {
+        out << "eop_errors_total{kind=\"" << error_names_g[n] << "\"} " << metrics.errors_m[n]
+            << '\n';
+    }
+
+    out << "# HELP eop_parse_duration_seconds Latency of a parse by size of file.\n"
+        << "# TYPE eop_parse_duration_seconds histogram\n";
+    for (std::size_t n(0); n != size_class_count_k; ++n) {
+        const latency_histogram_t& latency(metrics.latency_m[n]);
+
+        for (std::size_t bound(first_bound_k); bound <= last_bound_k; ++bound) {
+            boost::uint64_t microseconds(boost::uint64_t(1) << bound);
+
+            out << "eop_parse_duration_seconds_bucket{size=\"" << size_names_g[n] << "\",le=\"";
+            write_seconds(out, microseconds);
+            out << "\"} " << latency.count_below(microseconds) << '\n';
+        }
+        out << "eop_parse_duration_seconds_bucket{size=\"" << size_names_g[n]
+            << "\",le=\"+Inf\"} " << latency.count_m << '\n'
+            << "eop_parse_duration_seconds_sum{size=\"" << size_names_g[n] << "\"} ";
+        write_seconds(out, latency.sum_m);
+        out << '\n'
+            << "eop_parse_duration_seconds_count{size=\"" << size_names_g[n] << "\"} "
+            << latency.count_m << '\n';
+    }
+}
+
+void write_metrics_json(std::ostream& out, const metrics_t& metrics)
+{
+    const double quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1 };
+    const char* const quantile_names[] = { "p50", "p90", "p99", "p999", "max" };
+
+    out << "{\"files\":" << metrics.files_m
+        << ",\"bytes\":" << metrics.bytes_m
+        << ",\"tokens\":" << metrics.tokens_m
+        << ",\"errors\":{";
+    for (std::size_t n(0); n != metric_error_count_k; ++n) {
+        out << (n ? "," : "") << '"' << error_names_g[n] << "\":" << metrics.errors_m[n];
+    }
+    out << "},\"latency_seconds\":{";
+    for (std::size_t n(0); n != size_class_count_k; ++n) {
+        const latency_histogram_t& latency(metrics.latency_m[n]);
+
+        out << (n ? "," : "") << '"' << size_names_g[n] << "\":{\"count\":" << latency.count_m
+            << ",\"sum\":";
+        write_seconds(out, latency.sum_m);
+        for (std::size_t i(0); i != sizeof(quantiles) / sizeof(quantiles[0]); ++i) {
+            out << ",\"" << quantile_names[i] << "\":";
+            write_seconds(out, latency.quantile(quantiles[i]));
+        }
+        out << '}';
+    }
+    out << "}}\n";
+}
+
+/*************************************************************************************************/
+
+struct metrics_writer_t::implementation_t
+{
+    implementation_t(const std::string& file, double interval) :
+        file_m(file),
+        json_m(file.size() >= 5 && file.compare(file.size() - 5, 5, ".json") == 0),
+        interval_m(boost::chrono::duration_cast<boost::chrono::milliseconds>(
+            boost::chrono::duration<double>(interval > 0 ? interval : 1))),
+        stopping_m(false)
+    { }
+
+    bool write()
+    {
+        boost::lock_guard<boost::mutex> lock(write_mutex_m);
+        metrics_t                       metrics(read_metrics());
+        std::string                     temporary(temporary_file());
+
+        {
+        std::ofstream stream(temporary.c_str());
+
+        if (json_m) write_metrics_json(stream, metrics);
+        else write_prometheus(stream, metrics);
+        if (!stream.flush()) return false;
+        }
+
+        // On Windows rename() does not replace an existing file.
+        if (std::rename(temporary.c_str(), file_m.c_str()) == 0) return true;
+        std::remove(file_m.c_str());
+        return std::rename(temporary.c_str(), file_m.c_str()) == 0;
+    }
+
+    /*
+        The temporary file is named for the process, as writers in other processes may share
+        file; within the process write_mutex_m serializes the writes.
+    */
+
+    std::string temporary_file() const
+    {
+        std::stringstream result;
+
+        result << file_m << '.' << EOP_PROCESS_ID() << ".tmp";
+        return result.str();
+    }
+
+    void run()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_m);
+
+        while (!stopping_m) {
+            if (condition_m.wait_for(lock, interval_m) == boost::cv_status::no_timeout) continue;
+            lock.unlock();
+            write();
+            lock.lock();
+        }
+    }
+
+    std::string                 file_m;
+    bool                        json_m;
+    boost::chrono::milliseconds interval_m;
+    boost::mutex                write_mutex_m; // for write(), the thread's or the owner's
+    boost::mutex                mutex_m; // for stopping_m
+    boost::condition_variable   condition_m;
+    bool                        stopping_m;
+    boost::thread               thread_m;
+};
+
+metrics_writer_t::metrics_writer_t(const std::string& file, double interval) :
+    object_m(new implementation_t(file, interval))
+{
+    object_m->thread_m = boost::thread(&implementation_t::run, object_m);
+}
+
+metrics_writer_t::~metrics_writer_t()
+{
+    {
+    boost::lock_guard<boost::mutex> lock(object_m->mutex_m);
+    object_m->stopping_m = true;
+    }
+    object_m->condition_m.notify_one();
+    object_m->thread_m.join();
+    object_m->write();
+    delete object_m;
+}
+
+bool metrics_writer_t::write()
+{
+    return object_m->write();
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
@@ -0,0 +1,178 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_METRICS_HPP
+#define EOP_METRICS_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    The metrics count what the parsers of the process have done since it started: the files
+    parsed, their bytes and tokens, the errors by kind, and the latency of each parse in a
+    histogram for each class of file size. expression_parser records its parses itself - by
+    parse(), and reparse() as a parse of the region it parses - so only what happens outside a
+    parser, such as a file which cannot be read, is counted by the caller.
+
+    Each thread counts into a block of its own, so counting takes no lock and no read-modify-
+    write; read_metrics() sums the blocks. The blocks of threads which have exited are folded
+    into one, so nothing counted is lost.
+*/
+
+enum metric_error_t
+{
+    syntax_error_k,         // a diagnostic
+    cancelled_error_k,      // a parse stopped by parse_options_t::cancel_m
+    deadline_error_k,       // ... deadline_m
+    token_budget_error_k,   // ... token_budget_m
+    read_error_k,           // a file which could not be read
+    internal_error_k        // any other exception out of a parse
+};
+
+const std::size_t metric_error_count_k = internal_error_k + 1;
+
+//  metric_error_name() is the label of error in the output, as "syntax".
+const char* metric_error_name(metric_error_t error);
+
+/*
+    Latencies are kept by the size of what was parsed: under 4 KiB, under 64 KiB, under 1 MiB,
+    and larger.
+*/
+
+enum size_class_t
+{
+    small_size_k,
+    medium_size_k,
+    large_size_k,
+    huge_size_k
+};
+
+const std::size_t size_class_count_k = huge_size_k + 1;
+
+size_class_t size_class(std::size_t bytes);
+//  size_class_name() is the label of size in the output, as "4KiB-64KiB".
+const char* size_class_name(size_class_t size);
+
+/*************************************************************************************************/
+
+/*
+    latency_histogram_t counts latencies in microseconds, in the manner of an HDR histogram:
+    exactly below 64, and above in 32 buckets to each power of two, so a bucket is never wider
+    than 1/32 of its lower bound and a quantile read from it is within about 3% of the true
+    value. Latencies of 2^32 microseconds, over an hour, and more are counted in the last bucket.
+*/
+
+class latency_histogram_t
+{
+ public:
+    static const std::size_t bucket_count_k = 64 + 26 * 32;
+
+    latency_histogram_t();
+
+    void record(boost::uint64_t microseconds);
+    void merge(const latency_histogram_t& x);
+
+//  quantile() is the highest latency of the bucket holding quantile q of those counted.
+    boost::uint64_t quantile(double q) const;
+//  count_below() is the number of latencies counted under microseconds, a power of two.
+    boost::uint64_t count_below(boost::uint64_t microseconds) const;
+
+    static std::size_t bucket(boost::uint64_t microseconds);
+    static boost::uint64_t bucket_low(std::size_t bucket);  // the lowest latency of bucket
+    static boost::uint64_t bucket_high(std::size_t bucket); // ... and the highest
+
+    boost::uint64_t counts_m[bucket_count_k];
+    boost::uint64_t count_m;
+    boost::uint64_t sum_m; // microseconds
+};
+
+/*************************************************************************************************/
+
+struct metrics_t
+{
+    metrics_t();
+
+    boost::uint64_t     files_m;
+    boost::uint64_t     bytes_m;
+    boost::uint64_t     tokens_m;
+    boost::uint64_t     errors_m[metric_error_count_k];
+    latency_histogram_t latency_m[size_class_count_k];
+};
+
+/*
+    count_parse() counts a parse which ran to its end, with or without diagnostics, of bytes
+    and tokens taking microseconds. count_error() counts count errors of kind error.
+*/
+void count_parse(std::size_t bytes, std::size_t tokens, boost::uint64_t microseconds);
+void count_error(metric_error_t error, std::size_t count = 1);
+
+/*
+    read_metrics() sums the counts of every thread. A thread counting meanwhile may have
+    counted part of a parse, so the files and the histograms can briefly disagree by one.
+*/
+metrics_t read_metrics();
+
+/*************************************************************************************************/
+
+/*
+    write_prometheus() writes metrics in the Prometheus text exposition format: counters
+    eop_files_parsed_total, eop_bytes_parsed_total, eop_tokens_parsed_total and
+    eop_errors_total by kind, and the histogram eop_parse_duration_seconds by size, with a
+    bucket at each power of two microseconds. write_metrics_json() writes them as a JSON
+    object, with the histograms as their quantiles.
+*/
+void write_prometheus(std::ostream& out, const metrics_t& metrics);
+void write_metrics_json(std::ostream& out, const metrics_t& metrics);
+
+/*************************************************************************************************/
+
+/*
+    metrics_writer_t writes the metrics to file every interval seconds, from a thread of its
+    own, and once more when destroyed. Each write goes to a temporary file renamed over file,
+    so a scraper never reads one half written. A file named ".json" is written as JSON, any
+    other in the Prometheus format.
+*/
+
+class metrics_writer_t : boost::noncopyable
+{
+ public:
+    metrics_writer_t(const std::string& file, double interval);
+    ~metrics_writer_t();
+
+//  write() writes the metrics now; returns false if the file cannot be written.
+    bool write();
+
+ private:
+    struct implementation_t;
+
+    implementation_t* object_m;
+};
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
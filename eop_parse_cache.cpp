@@ -0,0 +1,437 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <process.h>
+    #define EOP_PROCESS_ID _getpid
+#else
+    #include <unistd.h>
+    #define EOP_PROCESS_ID getpid
+#endif
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <adobe/name.hpp>
+
+#include "eop_parse_cache.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    parser_version_k is recorded in every entry and its file name, and is bumped whenever a
+    change to the parser alters what it records - declarations, body spans, diagnostics or
+    their positions - so an entry of an earlier parser is never served. cache_format_k is the
+    layout of an entry.
+*/
+
+const boost::uint32_t parser_version_k = 2;
+
+/*************************************************************************************************/
+
+namespace {
+
+const char              cache_magic_k[8] = { 'E', 'O', 'P', 'C', 'A', 'C', 'H', 'E' };
+const boost::uint32_t   cache_format_k = 1;
+
+const content_hash_t    fnv_offset_basis_k = UINT64_C(14695981039346656037);
+const content_hash_t    fnv_prime_k = UINT64_C(1099511628211);
+
+/*************************************************************************************************/
+
+class string_table_t
+{
+ public:
+    boost::uint32_t insert(const std::string& x)
+    {
+        std::map<std::string, boost::uint32_t>::const_iterator f(index_m.find(x));
+        if (f != index_m.end()) return f->second;
+
+        boost::uint32_t result(static_cast<boost::uint32_t>(data_m.size()));
+        data_m.insert(data_m.end(), x.begin(), x.end());
+        data_m.push_back(0);
+        index_m.insert(std::make_pair(x, result));
+        return result;
+    }
+
+    const std::vector<char>& data() const { return data_m; }
+
+ private:
+    std::map<std::string, boost::uint32_t>  index_m;
+    std::vector<char>                       data_m;
+};
+
+/*************************************************************************************************/
+
+inline std::size_t align(std::size_t x) { return (x + 7) & ~std::size_t(7); }
+
+//  Whether the count records from first lie within the count records of a section.
+
+inline bool within(boost::uint64_t first, boost::uint64_t count, boost::uint64_t section_count)
+{
+    return first <= section_count && count <= section_count - first;
+}
+
+/*
+    valid_records() checks that every index within the records of an entry, whose sections
+    lie within the mapping, refers into its section: the strings to the string table, which
+    ends with a null, and the class names and bodies of a declaration to theirs.
+*/
+
+bool valid_records(const cache_entry_t& entry)
+{
+    const cache_header_t&   header(entry.header());
+    boost::uint32_t         string_size(header.string_size_m);
+
+    if (string_size && *entry.string(string_size - 1) != 0) return false;
+
+    for (std::size_t n(0); n != header.declaration_count_m; ++n) {
+        const cache_declaration_t& record(entry.declaration(n));
+
+        if (record.kind_m >= string_size || record.name_m >= string_size
+                || !within(record.class_name_first_m, record.class_name_count_m,
+                    header.class_name_count_m)
+                || !within(record.body_first_m, record.body_count_m, header.body_count_m))
+            return false;
+    }
+    for (std::size_t n(0); n != header.class_name_count_m; ++n) {
+        if (entry.class_name(n).name_m >= string_size) return false;
+    }
+    for (std::size_t n(0); n != header.diagnostic_count_m; ++n) {
+        if (entry.diagnostic(n).message_m >= string_size) return false;
+    }
+    return true;
+}
+
+/*
+    temporary_path() is a name beside path for a file to be renamed onto it, unique to the
+    process and the call, so concurrent writers of path never share one.
+*/
+
+std::string temporary_path(const std::string& path)
+{
+    static boost::atomic<unsigned long> count_s(0);
+
+    std::stringstream result;
+
+    result << path << '.' << EOP_PROCESS_ID() << '.'
+        << count_s.fetch_add(1, boost::memory_order_relaxed) << ".tmp";
+    return result.str();
+}
+
+template <typename T>
+void write_at(std::vector<char>& buffer, std::size_t offset, const std::vector<T>& x)
+{
+    if (!x.empty()) std::memcpy(&buffer[offset], &x[0], x.size() * sizeof(T));
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+content_hash_t content_hash(content_hash_t seed, const char* first, const char* last)
+{
+    content_hash_t result(seed);
+
+    for (; first != last; ++first) {
+        result ^= static_cast<unsigned char>(*first);
+        result *= fnv_prime_k;
+    }
+
+    return result;
+}
+
+content_hash_t content_hash(const char* first, const char* last)
+    { return content_hash(fnv_offset_basis_k, first, last); }
+
+/*************************************************************************************************/
+
+struct cache_entry_t::implementation_t
+{
+    boost::interprocess::file_mapping   file_m;
+    boost::interprocess::mapped_region  region_m;
+};
+
+/*************************************************************************************************/
+
+cache_entry_t::cache_entry_t() :
+    object_m(0), base_m(0)
+{ }
+
+cache_entry_t::~cache_entry_t()
+    { delete object_m; }
+
+const cache_header_t& cache_entry_t::header() const
+    { return *reinterpret_cast<const cache_header_t*>(base_m); }
+
+const cache_declaration_t& cache_entry_t::declaration(std::size_t index) const
+{
+    return reinterpret_cast<const cache_declaration_t*>(base_m + header().declarations_m)[index];
+}
+
+const cache_class_name_t& cache_entry_t::class_name(std::size_t index) const
+{
+    return reinterpret_cast<const cache_class_name_t*>(base_m + header().class_names_m)[index];
+}
+
+const cache_diagnostic_t& cache_entry_t::diagnostic(std::size_t index) const
+{
+    return reinterpret_cast<const cache_diagnostic_t*>(base_m + header().diagnostics_m)[index];
+}
+
+const cache_body_t& cache_entry_t::body(std::size_t index) const
+{
+    return reinterpret_cast<const cache_body_t*>(base_m + header().bodies_m)[index];
+}
+
+const char* cache_entry_t::string(boost::uint32_t offset) const
+    { return base_m + header().strings_m + offset; }
+
+/*************************************************************************************************/
+
+void cache_entry_t::get(parse_result_t& result) const
+{
+    const cache_header_t& entry_header(header());
+
+    result = parse_result_t();
+    result.offset_m = entry_header.offset_m;
+
+    for (std::size_t n(0); n != entry_header.declaration_count_m; ++n) {
+        const cache_declaration_t&          record(declaration(n));
+        boost::shared_ptr<declaration_t>    item(new declaration_t);
+
+        item->kind_m = name_t(string(record.kind_m));
+        item->name_m = name_t(string(record.name_m));
+        item->length_m = record.length_m;
+        item->lines_m = record.lines_m;
+        item->template_m = record.template_m != 0;
+        item->diagnostic_count_m = record.diagnostic_count_m;
+
+        for (std::size_t i(0); i != record.class_name_count_m; ++i) {
+            const cache_class_name_t& entry(class_name(record.class_name_first_m + i));
+            item->class_names_m.push_back(std::make_pair(name_t(string(entry.name_m)),
+                entry.template_m != 0));
+        }
+        for (std::size_t i(0); i != record.body_count_m; ++i) {
+            const cache_body_t& entry(body(record.body_first_m + i));
+            item->bodies_m.push_back(std::make_pair(std::size_t(entry.offset_m),
+                std::size_t(entry.length_m)));
+        }
+        result.declarations_m.push_back(item);
+    }
+
+    for (std::size_t n(0); n != entry_header.diagnostic_count_m; ++n) {
+        const cache_diagnostic_t&   record(diagnostic(n));
+        diagnostic_t                item;
+
+        item.message_m = string(record.message_m);
+        item.line_number_m = static_cast<int>(record.line_number_m);
+        item.line_start_m = record.line_start_m;
+        item.offset_m = record.offset_m;
+        result.diagnostics_m.push_back(item);
+    }
+}
+
+/*************************************************************************************************/
+
+parse_cache_t::parse_cache_t(const std::string& directory) :
+    directory_m(directory)
+{ }
+
+/*************************************************************************************************/
+
+std::string parse_cache_t::path(content_hash_t key) const
+{
+    std::stringstream result;
+
+    result << directory_m << '/' << std::hex;
+    result.width(16);
+    result.fill('0');
+    result << key << '-' << std::dec << parser_version_k << ".eopc";
+
+    return result.str();
+}
+
+/*************************************************************************************************/
+
+bool parse_cache_t::find(content_hash_t key, std::size_t content_size, cache_entry_t& entry) const
+{
+    using namespace boost::interprocess;
+
+    // The candidate owns the mapping until it is valid, and then the entry it replaces.
+
+    cache_entry_t candidate;
+
+    candidate.object_m = new cache_entry_t::implementation_t;
+
+    try {
+        file_mapping(path(key).c_str(), read_only).swap(candidate.object_m->file_m);
+        mapped_region(candidate.object_m->file_m, read_only).swap(candidate.object_m->region_m);
+    } catch (const interprocess_exception&) {
+        return false;
+    }
+
+    const char*         base(static_cast<const char*>(candidate.object_m->region_m.get_address()));
+    std::size_t         size(candidate.object_m->region_m.get_size());
+    cache_header_t      header;
+
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, base, sizeof(header));
+
+    if (std::memcmp(header.magic_m, cache_magic_k, sizeof(cache_magic_k)) != 0
+            || header.format_m != cache_format_k
+            || header.parser_version_m != parser_version_k
+            || header.content_hash_m != key
+            || header.content_size_m != content_size
+            || header.declarations_m + header.declaration_count_m * sizeof(cache_declaration_t) > size
+            || header.class_names_m + header.class_name_count_m * sizeof(cache_class_name_t) > size
+            || header.diagnostics_m + header.diagnostic_count_m * sizeof(cache_diagnostic_t) > size
+            || header.bodies_m + header.body_count_m * sizeof(cache_body_t) > size
+            || header.strings_m + header.string_size_m > size) {
+        return false;
+    }
+
+    candidate.base_m = base;
+    if (!valid_records(candidate)) return false;
+
+    std::swap(entry.object_m, candidate.object_m);
+    std::swap(entry.base_m, candidate.base_m);
+
+    return true;
+}
+
+/*************************************************************************************************/
+
+bool parse_cache_t::store(content_hash_t key, std::size_t content_size,
+        const parse_result_t& result) const
+{
+    string_table_t                      strings;
+    std::vector<cache_declaration_t>    declarations;
+    std::vector<cache_class_name_t>     class_names;
+    std::vector<cache_diagnostic_t>     diagnostics;
+    std::vector<cache_body_t>           bodies;
+
+    for (std::size_t n(0); n != result.declarations_m.size(); ++n) {
+        const declaration_t&    item(*result.declarations_m[n]);
+        cache_declaration_t     record;
+
+        record.kind_m = strings.insert(item.kind_m.c_str());
+        record.name_m = strings.insert(item.name_m.c_str());
+        record.length_m = static_cast<boost::uint32_t>(item.length_m);
+        record.lines_m = static_cast<boost::uint32_t>(item.lines_m);
+        record.template_m = item.template_m;
+        record.class_name_first_m = static_cast<boost::uint32_t>(class_names.size());
+        record.class_name_count_m = static_cast<boost::uint32_t>(item.class_names_m.size());
+        record.diagnostic_count_m = static_cast<boost::uint32_t>(item.diagnostic_count_m);
+        record.body_first_m = static_cast<boost::uint32_t>(bodies.size());
+        record.body_count_m = static_cast<boost::uint32_t>(item.bodies_m.size());
+
+        for (std::size_t i(0); i != item.class_names_m.size(); ++i) {
+            cache_class_name_t entry;
+
+            entry.name_m = strings.insert(item.class_names_m[i].first.c_str());
+            entry.template_m = item.class_names_m[i].second;
+            class_names.push_back(entry);
+        }
+        for (std::size_t i(0); i != item.bodies_m.size(); ++i) {
+            cache_body_t entry;
+
+            entry.offset_m = static_cast<boost::uint32_t>(item.bodies_m[i].first);
+            entry.length_m = static_cast<boost::uint32_t>(item.bodies_m[i].second);
+            bodies.push_back(entry);
+        }
+        declarations.push_back(record);
+    }
+
+    for (std::size_t n(0); n != result.diagnostics_m.size(); ++n) {
+        const diagnostic_t& item(result.diagnostics_m[n]);
+        cache_diagnostic_t  record;
+
+        record.message_m = strings.insert(item.message_m);
+        record.line_number_m = static_cast<boost::uint32_t>(item.line_number_m);
+        record.line_start_m = static_cast<boost::uint32_t>(item.line_start_m);
+        record.offset_m = static_cast<boost::uint32_t>(item.offset_m);
+        diagnostics.push_back(record);
+    }
+
+    cache_header_t header;
+
+    std::memcpy(header.magic_m, cache_magic_k, sizeof(cache_magic_k));
+    header.format_m = cache_format_k;
+    header.parser_version_m = parser_version_k;
+    header.content_hash_m = key;
+    header.content_size_m = content_size;
+    header.offset_m = static_cast<boost::uint32_t>(result.offset_m);
+
+    std::size_t size(align(sizeof(header)));
+
+    header.declaration_count_m = static_cast<boost::uint32_t>(declarations.size());
+    header.declarations_m = static_cast<boost::uint32_t>(size);
+    size = align(size + declarations.size() * sizeof(cache_declaration_t));
+
+    header.class_name_count_m = static_cast<boost::uint32_t>(class_names.size());
+    header.class_names_m = static_cast<boost::uint32_t>(size);
+    size = align(size + class_names.size() * sizeof(cache_class_name_t));
+
+    header.diagnostic_count_m = static_cast<boost::uint32_t>(diagnostics.size());
+    header.diagnostics_m = static_cast<boost::uint32_t>(size);
+    size = align(size + diagnostics.size() * sizeof(cache_diagnostic_t));
+
+    header.body_count_m = static_cast<boost::uint32_t>(bodies.size());
+    header.bodies_m = static_cast<boost::uint32_t>(size);
+    size = align(size + bodies.size() * sizeof(cache_body_t));
+
+    header.string_size_m = static_cast<boost::uint32_t>(strings.data().size());
+    header.strings_m = static_cast<boost::uint32_t>(size);
+    size += strings.data().size();
+
+    std::vector<char> buffer(size, 0);
+
+    std::memcpy(&buffer[0], &header, sizeof(header));
+    write_at(buffer, header.declarations_m, declarations);
+    write_at(buffer, header.class_names_m, class_names);
+    write_at(buffer, header.diagnostics_m, diagnostics);
+    write_at(buffer, header.bodies_m, bodies);
+    write_at(buffer, header.strings_m, strings.data());
+
+    std::string destination(path(key));
+    std::string temporary(temporary_path(destination));
+
+    {
+        std::ofstream out(temporary.c_str(), std::ios_base::out | std::ios_base::binary);
+        out.write(&buffer[0], static_cast<std::streamsize>(buffer.size()));
+        if (!out) { out.close(); std::remove(temporary.c_str()); return false; }
+    }
+
+    if (std::rename(temporary.c_str(), destination.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
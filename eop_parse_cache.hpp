@@ -0,0 +1,173 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_PARSE_CACHE_HPP
+#define EOP_PARSE_CACHE_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "exp_parser.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    The parse cache maps the content of a file to the result of parsing it. Entries are keyed by
+    a 64 bit FNV-1a hash of the content and by parser_version_k, and are stored one per file in
+    the cache directory.
+*/
+
+typedef boost::uint64_t content_hash_t;
+
+extern const boost::uint32_t parser_version_k;
+
+content_hash_t content_hash(const char* first, const char* last);
+content_hash_t content_hash(content_hash_t seed, const char* first, const char* last);
+
+/*************************************************************************************************/
+
+/*
+    Entry layout. An entry is a header followed by arrays of fixed size records and a string
+    table. Every field is a 32 bit count, index or offset relative to the start of the entry, so
+    an entry is relocatable and is used in place from the mapped file. String fields are offsets
+    into the string table of NUL terminated strings.
+*/
+
+struct cache_header_t
+{
+    char            magic_m[8];
+    boost::uint32_t format_m;
+    boost::uint32_t parser_version_m;
+    boost::uint64_t content_hash_m;
+    boost::uint64_t content_size_m;
+
+    boost::uint32_t offset_m; // of the first declaration
+    boost::uint32_t declaration_count_m;
+    boost::uint32_t declarations_m;
+    boost::uint32_t class_name_count_m;
+    boost::uint32_t class_names_m;
+    boost::uint32_t diagnostic_count_m;
+    boost::uint32_t diagnostics_m;
+    boost::uint32_t body_count_m;
+    boost::uint32_t bodies_m;
+    boost::uint32_t strings_m;
+    boost::uint32_t string_size_m;
+};
+
+struct cache_declaration_t
+{
+    boost::uint32_t kind_m;
+    boost::uint32_t name_m;
+    boost::uint32_t length_m;
+    boost::uint32_t lines_m;
+    boost::uint32_t template_m;
+    boost::uint32_t class_name_first_m;
+    boost::uint32_t class_name_count_m;
+    boost::uint32_t diagnostic_count_m;
+    boost::uint32_t body_first_m;
+    boost::uint32_t body_count_m;
+};
+
+struct cache_class_name_t
+{
+    boost::uint32_t name_m;
+    boost::uint32_t template_m;
+};
+
+struct cache_diagnostic_t
+{
+    boost::uint32_t message_m;
+    boost::uint32_t line_number_m;
+    boost::uint32_t line_start_m;
+    boost::uint32_t offset_m;
+};
+
+//  A body skipped by parse_options_t::skip_bodies_m; offset_m is from the declaration.
+
+struct cache_body_t
+{
+    boost::uint32_t offset_m;
+    boost::uint32_t length_m;
+};
+
+/*************************************************************************************************/
+
+class cache_entry_t : boost::noncopyable
+{
+ public:
+    cache_entry_t();
+    ~cache_entry_t();
+
+    const cache_header_t&       header() const;
+
+    const cache_declaration_t&  declaration(std::size_t index) const;
+    const cache_class_name_t&   class_name(std::size_t index) const;
+    const cache_diagnostic_t&   diagnostic(std::size_t index) const;
+    const cache_body_t&         body(std::size_t index) const;
+    const char*                 string(boost::uint32_t offset) const;
+
+//  get() copies the entry into a parse result, interning the names it contains.
+    void get(parse_result_t& result) const;
+
+#if !defined(ADOBE_NO_DOCUMENTATION)
+ private:
+    friend class parse_cache_t;
+
+    struct implementation_t;
+
+    implementation_t*   object_m;
+    const char*         base_m;
+#endif // !defined(ADOBE_NO_DOCUMENTATION)
+};
+
+/*************************************************************************************************/
+
+class parse_cache_t
+{
+ public:
+    explicit parse_cache_t(const std::string& directory);
+
+/*
+    find() maps the entry for key into entry. It returns false if there is no entry, if the
+    entry was written by another parser version or for content of a different size, or if it
+    is truncated or corrupt.
+*/
+    bool find(content_hash_t key, std::size_t content_size, cache_entry_t& entry) const;
+
+/*
+    store() writes the entry through a temporary file which is renamed into place, so concurrent
+    runs sharing the directory never observe a partial entry. Failing to write the cache is not
+    an error; store() returns false.
+*/
+    bool store(content_hash_t key, std::size_t content_size, const parse_result_t& result) const;
+
+ private:
+    std::string path(content_hash_t key) const;
+
+    std::string directory_m;
+};
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
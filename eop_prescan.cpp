@@ -0,0 +1,361 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <cstring>
+
+#include <boost/config.hpp>
+#include <boost/cstdint.hpp>
+
+#if !defined(EOP_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+        || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define EOP_PRESCAN_SSE2
+    #include <emmintrin.h>
+#endif
+
+#ifdef BOOST_MSVC
+    #include <intrin.h>
+#endif
+
+#include "eop_prescan.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+const std::size_t prescan_t::npos;
+
+/*************************************************************************************************/
+
+namespace {
+
+typedef boost::uint64_t mask_t;
+
+const std::size_t block_size_k = 64;
+
+/*
+    block_t holds the classification of a block of 64 characters, bit n for character n. The
+    structural characters are only candidates - those in comments and strings are masked out
+    by the walk over the block.
+*/
+
+struct block_t
+{
+    mask_t  structural_m;
+    mask_t  special_m; // quotes, "/" and "#" - what can start a comment or string
+    mask_t  quote_m[2]; // "'" and '"'
+    mask_t  star_m;
+    mask_t  line_end_m;
+};
+
+#ifdef EOP_PRESCAN_SSE2
+
+inline __m128i equal(__m128i x, char c) { return _mm_cmpeq_epi8(x, _mm_set1_epi8(c)); }
+
+inline mask_t bits(__m128i x) { return static_cast<unsigned>(_mm_movemask_epi8(x)); }
+
+/*
+    The comparisons are combined before they are reduced to bits, one reduction per mask. The
+    masks which end comments and strings are only needed for a block in one, or in which one
+    may start, so unless full is set they are left out of a block of plain code.
+*/
+
+void classify(const char* p, block_t& result, bool full)
+{
+    mask_t structural(0), special(0);
+
+    for (std::size_t n(0); n != block_size_k; n += 16) {
+        __m128i x(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n)));
+        __m128i brackets(_mm_or_si128(_mm_or_si128(_mm_or_si128(equal(x, '{'), equal(x, '}')),
+            _mm_or_si128(equal(x, '('), equal(x, ')'))),
+            _mm_or_si128(_mm_or_si128(equal(x, '['), equal(x, ']')),
+            _mm_or_si128(_mm_or_si128(equal(x, '<'), equal(x, '>')), equal(x, ';')))));
+
+        structural |= bits(brackets) << n;
+        special |= bits(_mm_or_si128(_mm_or_si128(equal(x, '\''), equal(x, '"')),
+            _mm_or_si128(equal(x, '/'), equal(x, '#')))) << n;
+    }
+
+    result.structural_m = structural;
+    result.special_m = special;
+
+    if (!full && !special) return;
+
+    mask_t single(0), double_(0), star(0), line_end(0);
+
+    for (std::size_t n(0); n != block_size_k; n += 16) {
+        __m128i x(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n)));
+
+        single |= bits(equal(x, '\'')) << n;
+        double_ |= bits(equal(x, '"')) << n;
+        star |= bits(equal(x, '*')) << n;
+        line_end |= bits(_mm_or_si128(equal(x, '\n'), equal(x, '\r'))) << n;
+    }
+
+    result.quote_m[0] = single;
+    result.quote_m[1] = double_;
+    result.star_m = star;
+    result.line_end_m = line_end;
+}
+
+#else
+
+void classify(const char* p, block_t& result, bool)
+{
+    std::memset(&result, 0, sizeof(result));
+
+    for (std::size_t n(0); n != block_size_k; ++n) {
+        mask_t bit(mask_t(1) << n);
+
+        switch (p[n]) {
+        case '{': case '}': case '(': case ')': case '[': case ']': case '<': case '>': case ';':
+            result.structural_m |= bit; break;
+        case '\'':  result.special_m |= bit; result.quote_m[0] |= bit; break;
+        case '"':   result.special_m |= bit; result.quote_m[1] |= bit; break;
+        case '/':
+        case '#':   result.special_m |= bit; break;
+        case '*':   result.star_m |= bit; break;
+        case '\n':
+        case '\r':  result.line_end_m |= bit; break;
+        }
+    }
+}
+
+#endif
+
+//  The index of the lowest set bit of a non-zero x.
+
+inline std::size_t lowest_bit(mask_t x)
+{
+#if defined(__GNUC__)
+    return static_cast<std::size_t>(__builtin_ctzll(x));
+#elif defined(BOOST_MSVC) && defined(_M_X64)
+    unsigned long result;
+    _BitScanForward64(&result, x);
+    return result;
+#else
+    std::size_t result(0);
+    while (!(x & 1)) { x >>= 1; ++result; }
+    return result;
+#endif
+}
+
+//  The bits of a block at or past n, where n may fall outside it.
+
+inline mask_t from_bit(std::ptrdiff_t n)
+{
+    if (n <= 0) return ~mask_t(0);
+    if (n >= std::ptrdiff_t(block_size_k)) return 0;
+    return ~mask_t(0) << n;
+}
+
+enum scan_state_t
+{
+    code_k,
+    line_comment_k,
+    block_comment_k,
+    single_quote_k,
+    double_quote_k
+};
+
+inline char opening(char c) { return c == '}' ? '{' : c == ')' ? '(' : '['; }
+
+/*
+    scanner_t walks the blocks in order. position_m is the first character not yet consumed;
+    a comment, string or compound token may end past the block it starts in.
+*/
+
+class scanner_t
+{
+ public:
+    scanner_t(const char* first, const char* last, prescan_t& result) :
+        first_m(first), last_m(last), result_m(result), position_m(0), state_m(code_k),
+        start_m(0)
+    { }
+
+    bool block(std::size_t base, const block_t& block);
+    bool finish();
+    bool in_code() const { return state_m == code_k; }
+
+ private:
+    char at(std::size_t n) const { return first_m + n < last_m ? first_m[n] : 0; }
+    bool structural(std::size_t n);
+    bool fail(std::size_t offset, const char* message);
+
+    const char*                 first_m;
+    const char*                 last_m;
+    prescan_t&                  result_m;
+    std::size_t                 position_m;
+    scan_state_t                state_m;
+    std::size_t                 start_m; // of the comment or string being scanned
+    std::vector<std::size_t>    open_m; // indices of the unmatched brackets
+};
+
+bool scanner_t::fail(std::size_t offset, const char* message)
+{
+    result_m.error_m = offset;
+    result_m.message_m = message;
+    return false;
+}
+
+//  Records the structural character at n; returns false on a bracket which does not match.
+
+bool scanner_t::structural(std::size_t n)
+{
+    char c(first_m[n]);
+
+    position_m = n + 1;
+
+    switch (c) {
+    case '<':
+    case '>':
+        if (at(n + 1) == '=' || at(n + 1) == c) { position_m = n + 2; return true; }
+        break;
+    case '{': case '(': case '[':
+        open_m.push_back(result_m.offsets_m.size());
+        break;
+    case '}': case ')': case ']':
+        if (open_m.empty() || first_m[result_m.offsets_m[open_m.back()]] != opening(c))
+            return fail(n, "Unmatched bracket.");
+        result_m.partners_m[open_m.back()] = result_m.offsets_m.size();
+        result_m.offsets_m.push_back(n);
+        result_m.partners_m.push_back(open_m.back());
+        open_m.pop_back();
+        return true;
+    }
+
+    result_m.offsets_m.push_back(n);
+    result_m.partners_m.push_back(prescan_t::npos);
+    return true;
+}
+
+/*
+    Within code the structural characters ahead of the next quote, "/" or "#" are recorded a
+    bit at a time; the other states skip to the bit which ends them.
+*/
+
+bool scanner_t::block(std::size_t base, const block_t& block)
+{
+    while (true) {
+        mask_t live(from_bit(std::ptrdiff_t(position_m) - std::ptrdiff_t(base)));
+
+        switch (state_m) {
+        case code_k: {
+            mask_t special(block.special_m & live);
+            mask_t structurals(block.structural_m & live);
+
+            if (special) structurals &= (special & (0 - special)) - 1;
+
+            while (structurals) {
+                std::size_t n(base + lowest_bit(structurals));
+
+                structurals &= structurals - 1;
+                if (n >= position_m && !structural(n)) return false;
+            }
+
+            if (!special) return true;
+
+            std::size_t n(base + lowest_bit(special));
+            char        c(first_m[n]);
+
+            start_m = n;
+            position_m = n + 1;
+
+            if (c == '\'') state_m = single_quote_k;
+            else if (c == '"') state_m = double_quote_k;
+            else if (c == '#') state_m = line_comment_k;
+            else if (at(n + 1) == '/') { state_m = line_comment_k; position_m = n + 2; }
+            else if (at(n + 1) == '*') { state_m = block_comment_k; position_m = n + 2; }
+            break;
+        }
+        case line_comment_k: {
+            mask_t line_end(block.line_end_m & live);
+
+            if (!line_end) return true;
+            position_m = base + lowest_bit(line_end) + 1;
+            state_m = code_k;
+            break;
+        }
+        case single_quote_k:
+        case double_quote_k: {
+            mask_t quote(block.quote_m[state_m - single_quote_k] & live);
+
+            if (!quote) return true;
+            position_m = base + lowest_bit(quote) + 1;
+            state_m = code_k;
+            break;
+        }
+        case block_comment_k: {
+            mask_t star(block.star_m & live);
+
+            if (!star) return true;
+
+            std::size_t n(base + lowest_bit(star));
+
+            position_m = n + 1;
+            if (at(n + 1) == '/') { position_m = n + 2; state_m = code_k; }
+            break;
+        }
+        }
+    }
+}
+
+bool scanner_t::finish()
+{
+    switch (state_m) {
+    case block_comment_k:   return fail(start_m, "Unexpected EOF in comment.");
+    case single_quote_k:
+    case double_quote_k:    return fail(start_m, "Unexpected EOF in string.");
+    default:                break;
+    }
+
+    if (!open_m.empty()) return fail(result_m.offsets_m[open_m.back()], "Unmatched bracket.");
+    return true;
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+bool prescan(const char* first, const char* last, prescan_t& result)
+{
+    std::size_t size(static_cast<std::size_t>(last - first));
+    scanner_t   scanner(first, last, result);
+    block_t     block;
+    std::size_t base(0);
+
+    // The vectors keep their capacity, so prescanning one text after another reuses them.
+    result.offsets_m.clear();
+    result.partners_m.clear();
+    result.error_m = prescan_t::npos;
+    result.message_m = 0;
+    result.offsets_m.reserve(size / 8);
+    result.partners_m.reserve(size / 8);
+
+    for (; base + block_size_k <= size; base += block_size_k) {
+        classify(first + base, block, !scanner.in_code());
+        if (!scanner.block(base, block)) return false;
+    }
+
+    if (base != size) {
+        char tail[block_size_k] = { 0 };
+
+        std::memcpy(tail, first + base, size - base);
+        classify(tail, block, !scanner.in_code());
+        if (!scanner.block(base, block)) return false;
+    }
+
+    return scanner.finish();
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
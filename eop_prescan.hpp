@@ -0,0 +1,68 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_PRESCAN_HPP
+#define EOP_PRESCAN_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <vector>
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    prescan_t is the structure of a source found ahead of the parse: the offsets of the
+    structural characters "{", "}", "(", ")", "[", "]", "<", ">" and ";" outside comments and
+    strings, in order, and for each the index in offsets_m of the bracket matching it. "<" and
+    ">" are either template brackets or operators, which only the parse can tell, so like ";"
+    they have no partner (npos); "<" and ">" within "<=", "<<", ">=" and ">>" are not recorded.
+
+    error_m is the offset of the first unmatched or mismatched bracket, or of the start of an
+    unterminated comment or string, and message_m describes it; error_m is npos if there is
+    none. The structure up to the error is recorded.
+*/
+
+struct prescan_t
+{
+    static const std::size_t npos = std::size_t(-1);
+
+    prescan_t() : error_m(npos), message_m(0) { }
+
+    std::vector<std::size_t>    offsets_m;
+    std::vector<std::size_t>    partners_m;
+    std::size_t                 error_m;
+    const char*                 message_m;
+};
+
+/*
+    prescan() finds the structure of [first, last) following the lexer's rules for comments
+    ("#" and "//" to the end of the line, "/" "*" to "*" "/") and strings (between matching
+    quotes, without escapes). The characters are classified 64 at a time into bit masks, with
+    SSE2 where it is available, and the masks walked a set bit at a time, so the cost is in
+    proportion to the structural characters, comments and strings rather than to the text.
+    Returns false if the brackets do not balance or a comment or string is not terminated.
+*/
+
+bool prescan(const char* first, const char* last, prescan_t& result);
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
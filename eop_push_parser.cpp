@@ -0,0 +1,161 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <cctype>
+
+#include "eop_push_parser.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+push_parser_t::push_parser_t(const line_position_t& position,
+        const declaration_callback_suite_t& callbacks, const expression_parser::snapshot_t& prelude) :
+    parser_m(empty_m, position, prelude),
+    prelude_m(prelude),
+    callbacks_m(callbacks)
+{
+    reset(position);
+}
+
+/*************************************************************************************************/
+
+void push_parser_t::set_options(const parse_options_t& options)
+{
+    parser_m.set_options(options);
+}
+
+/*************************************************************************************************/
+
+void push_parser_t::reset(const line_position_t& position)
+{
+    parser_m.reset(empty_m, position, prelude_m);
+
+    position_m = position;
+    text_m.clear();
+    start_m = diagnostic_t();
+    start_m.line_number_m = 1;
+    finished_m = false;
+
+    state_m = code_k;
+    last_m = 0;
+    quote_m = 0;
+    depth_m = 0;
+    boundary_m = false;
+    token_m = std::string::npos;
+    space_m = 0;
+    ready_m = false;
+}
+
+/*************************************************************************************************/
+
+void push_parser_t::feed(const char* first, const char* last)
+{
+    if (finished_m) return;
+
+    std::size_t size(text_m.size());
+
+    text_m.append(first, last);
+    scan(size);
+
+    if (ready_m) parse(false);
+}
+
+/*************************************************************************************************/
+
+void push_parser_t::finish()
+{
+    if (!finished_m) parse(true);
+}
+
+/*************************************************************************************************/
+
+/*
+    The scan follows the lexer's rules for comments and strings, so as to find the ";" and "}"
+    which may end a top-level declaration; the braces of unbalanced input only make the parses
+    less or more frequent. A parse is due once a token has followed a boundary - the declaration
+    ending there cannot be passed on before - and it runs to the last white space in code or in
+    a line comment, where no token is cut short.
+*/
+
+void push_parser_t::scan(std::size_t first)
+{
+    for (std::size_t n(first); n != text_m.size(); ++n) {
+        char        c(text_m[n]);
+        std::size_t offset(start_m.offset_m + n);
+
+        switch (state_m) {
+        case line_comment_k:
+            if (c == '\n' || c == '\r') { state_m = code_k; last_m = 0; }
+            if (std::isspace(static_cast<unsigned char>(c))) space_m = offset + 1;
+            continue;
+        case block_comment_k:
+            if (last_m == '*' && c == '/') { state_m = code_k; c = 0; }
+            last_m = c;
+            continue;
+        case string_k:
+            if (c == quote_m) { state_m = code_k; last_m = 0; }
+            continue;
+        case code_k:
+            break;
+        }
+
+        if (last_m == '/' && (c == '/' || c == '*')) {
+            state_m = c == '/' ? line_comment_k : block_comment_k;
+            last_m = 0;
+            continue;
+        }
+
+        last_m = c;
+
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            space_m = offset + 1;
+            if (token_m != std::string::npos) ready_m = true;
+            continue;
+        }
+        if (c == '/') continue;
+        if (c == '#') { state_m = line_comment_k; continue; }
+
+        if (boundary_m && token_m == std::string::npos) token_m = offset;
+
+        if (c == '\'' || c == '"') {
+            state_m = string_k;
+            quote_m = c;
+        } else if (c == '{') {
+            ++depth_m;
+        } else if ((c == '}' && (depth_m == 0 || --depth_m == 0)) || (c == ';' && depth_m == 0)) {
+            boundary_m = true;
+            token_m = std::string::npos;
+        }
+    }
+}
+
+/*************************************************************************************************/
+
+void push_parser_t::parse(bool at_end)
+{
+    std::size_t length(at_end ? text_m.size() : space_m - start_m.offset_m);
+    std::size_t parsed(parser_m.parse_available(text_m.data(), text_m.data() + length, start_m,
+                        position_m, at_end, callbacks_m, finished_m));
+
+    boundary_m = false;
+    token_m = std::string::npos;
+    ready_m = false;
+
+    if (finished_m) { text_m.clear(); return; }
+
+    text_m.erase(0, parsed);
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
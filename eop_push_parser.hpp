@@ -0,0 +1,106 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_PUSH_PARSER_HPP
+#define EOP_PUSH_PARSER_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include "exp_parser.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    push_parser_t parses an input handed to it in fragments as they arrive, rather than pulling
+    it from a stream, so nothing waits on the input. feed() takes the next fragment and parses
+    the top-level declarations it completes; finish() parses the rest as the end of the input.
+    The declarations and their diagnostics are passed to the callbacks as by
+    expression_parser::parse(callbacks), each as soon as the text following it arrives.
+
+    Only the text from the first declaration not yet passed on is held. A parse is tried once a
+    top-level ";" or "}" has been followed by the start of another token; the declarations it
+    completes are not parsed again, and the one in progress only if it was cut short.
+
+    A parse stopped through parse_options_t throws parse_cancelled_t out of feed() or finish()
+    with the text still held, so feeding may go on.
+*/
+
+class push_parser_t : public boost::noncopyable
+{
+ public:
+    push_parser_t(const line_position_t& position, const declaration_callback_suite_t& callbacks,
+            const expression_parser::snapshot_t& prelude = expression_parser::snapshot_t());
+
+    void set_options(const parse_options_t& options);
+
+    void feed(const char* first, const char* last);
+    void finish();
+
+/*
+    finished() is true once the parse is over: after finish(), or after an error which, without
+    recovery, ends the parse. Input fed after that is ignored.
+*/
+    bool finished() const { return finished_m; }
+
+//  reset() starts a new input, with the same callbacks and prelude, reusing the buffers.
+    void reset(const line_position_t& position);
+
+ private:
+    void scan(std::size_t first);
+    void parse(bool at_end);
+
+    enum scan_state_t
+    {
+        code_k,
+        line_comment_k,
+        block_comment_k,
+        string_k
+    };
+
+    std::istringstream              empty_m;
+    expression_parser               parser_m;
+    expression_parser::snapshot_t   prelude_m;
+    declaration_callback_suite_t    callbacks_m;
+    line_position_t                 position_m;
+    std::string                     text_m; // not yet passed on, from start_m on
+    diagnostic_t                    start_m; // the position of text_m in the input
+    bool                            finished_m;
+
+    // The scan of text_m for where to parse to; offsets are into the input.
+
+    scan_state_t                    state_m;
+    char                            last_m; // the character before, within a comment or code
+    char                            quote_m;
+    std::size_t                     depth_m; // of braces
+    bool                            boundary_m; // a top-level ";" or "}" since the last parse
+    std::size_t                     token_m; // the first token after it; npos if none
+    std::size_t                     space_m; // past the last white space in code or a line comment
+    bool                            ready_m; // white space has followed token_m
+};
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
@@ -0,0 +1,199 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <cstddef>
+#include <istream>
+
+#include <adobe/implementation/token.hpp>
+
+#include "eop_lex_stream.hpp"
+#include "eop_relex.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+/*
+    token_lexer_t lexes a rope from a saved state. The underlying lex_stream_t reports positions
+    relative to where it started, one based; they are converted back to absolute offsets here.
+    Its errors are deferred, so the tokens already lexed are kept: the lexer holds the first
+    error, which is taken with the eof_k after it - the one it leaves in place of a token it
+    cannot make, or the one at the end of the text, after a string or comment running into it.
+*/
+
+class token_lexer_t
+{
+ public:
+    token_lexer_t(const rope_t& text, const lex_state_t& state, const line_position_t& position,
+            const keyword_extension_lookup_proc_t& keywords) :
+        buffer_m(text, state.offset_m),
+        in_m(&buffer_m),
+        stream_m(in_m, start_position(position, state)),
+        state_m(state)
+    {
+        stream_m.set_keyword_extension_lookup(keywords);
+        stream_m.set_defer_errors(true);
+    }
+
+    void get(lex_token_t& result)
+    {
+        locate(stream_m.next_position(), result.state_m);
+
+        result.token_m = stream_m.get();
+        if (result.token_m.first == eof_k && stream_m.error()) {
+            result.error_m = stream_m.error();
+            locate(stream_m.error_position(), result.error_state_m);
+        }
+    }
+
+ private:
+    void locate(const line_position_t& position, lex_state_t& result) const
+    {
+        result.offset_m = state_m.offset_m + static_cast<std::size_t>(position.position_m) - 1;
+        result.line_number_m = position.line_number_m;
+        result.line_start_m = position.line_number_m == state_m.line_number_m
+            ? state_m.line_start_m
+            : state_m.offset_m + static_cast<std::size_t>(position.line_start_m) - 1;
+    }
+
+    static line_position_t start_position(const line_position_t& position,
+            const lex_state_t& state)
+    {
+        line_position_t result(position);
+        result.line_number_m = state.line_number_m;
+        return result;
+    }
+
+    rope_buffer_t   buffer_m;
+    std::istream    in_m;
+    lex_stream_t    stream_m;
+    lex_state_t     state_m;
+};
+
+/*
+    Moves state, of an old token past the edits, by delta bytes and line_delta lines. A line
+    starting after the damage ends with a newline the edits left alone; one starting before it
+    is the line of the token the old ones line up with, which starts at line_start.
+*/
+
+void shift(lex_state_t& state, std::ptrdiff_t delta, int line_delta, std::size_t damage_last,
+        std::size_t line_start)
+{
+    state.offset_m += delta;
+    state.line_number_m += line_delta;
+    if (state.line_start_m > damage_last) state.line_start_m += delta;
+    else state.line_start_m = line_start;
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+void lex(const rope_t& text, const line_position_t& position,
+        const keyword_extension_lookup_proc_t& keywords, std::vector<lex_token_t>& result)
+{
+    token_lexer_t lexer(text, lex_state_t(), position, keywords);
+
+    result.clear();
+
+    do {
+        result.push_back(lex_token_t());
+        lexer.get(result.back());
+    } while (result.back().token_m.first != eof_k);
+}
+
+/*************************************************************************************************/
+
+std::size_t relex(const rope_t& text, const std::vector<lex_token_t>& previous,
+        const std::vector<text_edit_t>& edits, const line_position_t& position,
+        const keyword_extension_lookup_proc_t& keywords, std::vector<lex_token_t>& result)
+{
+    if (edits.empty()) { result = previous; return 0; }
+
+    std::size_t     damage_first(edits.front().offset_m);
+    std::size_t     damage_last(0);
+    std::ptrdiff_t  delta(0);
+
+    for (std::size_t n(0); n != edits.size(); ++n) {
+        damage_first = (std::min)(damage_first, edits[n].offset_m);
+        damage_last = (std::max)(damage_last, edits[n].offset_m + edits[n].length_m);
+        delta += static_cast<std::ptrdiff_t>(edits[n].text_m.size())
+            - static_cast<std::ptrdiff_t>(edits[n].length_m);
+    }
+
+    /*
+        An edit touching the end of a token can extend it, so restart at the last token which
+        starts strictly before the damage.
+    */
+
+    std::size_t restart(0);
+
+    while (restart != previous.size() && previous[restart].state_m.offset_m < damage_first)
+        ++restart;
+    if (restart != 0) --restart;
+
+    lex_state_t     state(restart != 0 ? previous[restart].state_m : lex_state_t());
+    token_lexer_t   lexer(text, state, position, keywords);
+    std::size_t     next(restart);
+    std::size_t     count(0);
+
+    result.assign(previous.begin(), previous.begin() + restart);
+
+    while (true) {
+        lex_token_t token;
+
+        lexer.get(token);
+        ++count;
+
+        std::ptrdiff_t offset(static_cast<std::ptrdiff_t>(token.state_m.offset_m));
+
+        // The eof_k is lexed anew, as its error may come from before the damage.
+
+        if (token.token_m.first != eof_k
+                && offset >= static_cast<std::ptrdiff_t>(damage_last) + delta) {
+            while (next != previous.size() && (previous[next].state_m.offset_m < damage_last
+                    || static_cast<std::ptrdiff_t>(previous[next].state_m.offset_m) + delta < offset)) {
+                ++next;
+            }
+
+            if (next != previous.size()
+                    && static_cast<std::ptrdiff_t>(previous[next].state_m.offset_m) + delta == offset
+                    && previous[next].token_m.first == token.token_m.first
+                    && previous[next].token_m.second == token.token_m.second) {
+                int line_delta(token.state_m.line_number_m - previous[next].state_m.line_number_m);
+
+                for (std::size_t n(next); n != previous.size(); ++n) {
+                    lex_token_t shifted(previous[n]);
+
+                    shift(shifted.state_m, delta, line_delta, damage_last,
+                        token.state_m.line_start_m);
+                    if (shifted.error_m) {
+                        shift(shifted.error_state_m, delta, line_delta, damage_last,
+                            token.state_m.line_start_m);
+                    }
+                    result.push_back(shifted);
+                }
+                return count;
+            }
+        }
+
+        result.push_back(token);
+        if (token.token_m.first == eof_k) return count;
+    }
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
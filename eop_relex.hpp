@@ -0,0 +1,84 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_RELEX_HPP
+#define EOP_RELEX_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <vector>
+
+#include "eop_lex_stream_fwd.hpp"
+#include "eop_rope.hpp"
+#include "exp_parser.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    lex_state_t is the state of the lexer at the start of a token. The lexer consumes comments
+    and strings whole, so a token never starts inside one and the position is all there is to
+    save; lexing can restart from any token boundary. Offsets are zero based.
+*/
+
+struct lex_state_t
+{
+    lex_state_t() : offset_m(0), line_number_m(1), line_start_m(0) { }
+
+    std::size_t offset_m;
+    int         line_number_m;
+    std::size_t line_start_m;
+};
+
+/*
+    Lexer errors are not thrown: a token the lexer cannot make ends the tokens as an eof_k
+    holding the error and where it was found.
+*/
+
+struct lex_token_t
+{
+    lex_token_t() : error_m(0) { }
+
+    stream_lex_token_t  token_m;
+    lex_state_t         state_m;
+    const char*         error_m; // a literal; 0 for none
+    lex_state_t         error_state_m;
+};
+
+/*************************************************************************************************/
+
+//  Lexes the whole of text, or up to its first error; the last token is eof_k.
+
+void lex(const rope_t& text, const line_position_t& position,
+        const keyword_extension_lookup_proc_t& keywords, std::vector<lex_token_t>& result);
+
+/*
+    Relexes text, the result of applying edits to the text previous was lexed from. Lexing
+    restarts at the last token starting before the first edit and stops as soon as a new token
+    past the edits lines up with an old token of the same value; the old tokens from there on
+    are reused with their positions shifted. Returns the number of tokens lexed.
+*/
+
+std::size_t relex(const rope_t& text, const std::vector<lex_token_t>& previous,
+        const std::vector<text_edit_t>& edits, const line_position_t& position,
+        const keyword_extension_lookup_proc_t& keywords, std::vector<lex_token_t>& result);
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
@@ -0,0 +1,140 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+
+#include "eop_rope.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+rope_t::rope_t() :
+    size_m(0)
+{ }
+
+rope_t::rope_t(const std::string& text) :
+    size_m(0)
+{
+    piece_t piece(new std::string(text));
+    append(piece, 0, piece->size());
+}
+
+/*************************************************************************************************/
+
+void rope_t::append(const piece_t& piece, std::size_t first, std::size_t last)
+{
+    if (first == last) return;
+    spans_m.push_back(span_t(piece, first, last));
+    size_m += last - first;
+}
+
+/*************************************************************************************************/
+
+std::size_t rope_t::split(std::size_t offset)
+{
+    assert(offset <= size_m);
+
+    std::size_t index(0);
+
+    for (; index != spans_m.size(); ++index) {
+        std::size_t size(spans_m[index].size());
+
+        if (offset == 0) return index;
+        if (offset < size) break;
+        offset -= size;
+    }
+
+    if (index == spans_m.size()) return index;
+
+    span_t tail(spans_m[index]);
+
+    tail.first_m += offset;
+    spans_m[index].last_m = tail.first_m;
+    spans_m.insert(spans_m.begin() + index + 1, tail);
+
+    return index + 1;
+}
+
+/*************************************************************************************************/
+
+void rope_t::replace(std::size_t offset, std::size_t length, const std::string& text)
+{
+    std::size_t first(split(offset));
+    std::size_t last(split(offset + length)); // splitting past first leaves first in place
+
+    spans_m.erase(spans_m.begin() + first, spans_m.begin() + last);
+    size_m -= length;
+
+    if (text.empty()) return;
+
+    piece_t piece(new std::string(text));
+
+    spans_m.insert(spans_m.begin() + first, span_t(piece, 0, piece->size()));
+    size_m += piece->size();
+}
+
+/*************************************************************************************************/
+
+std::string rope_t::substr(std::size_t offset, std::size_t length) const
+{
+    std::string result;
+
+    for (const_iterator span(begin()); span != end() && length != 0; ++span) {
+        if (offset >= span->size()) { offset -= span->size(); continue; }
+
+        std::size_t count((std::min)(length, span->size() - offset));
+
+        result.append(span->begin() + offset, count);
+        offset = 0;
+        length -= count;
+    }
+
+    return result;
+}
+
+/*************************************************************************************************/
+
+rope_buffer_t::rope_buffer_t(const rope_t& rope, std::size_t offset) :
+    current_m(rope.begin()),
+    last_m(rope.end())
+{
+    while (current_m != last_m && offset >= current_m->size()) {
+        offset -= current_m->size();
+        ++current_m;
+    }
+
+    if (current_m == last_m) return;
+
+    char* first(const_cast<char*>(current_m->begin()));
+
+    setg(first, first + offset, const_cast<char*>(current_m->end()));
+}
+
+/*************************************************************************************************/
+
+rope_buffer_t::int_type rope_buffer_t::underflow()
+{
+    if (gptr() != egptr()) return traits_type::to_int_type(*gptr());
+    if (current_m == last_m || ++current_m == last_m) return traits_type::eof();
+
+    char* first(const_cast<char*>(current_m->begin()));
+
+    setg(first, first, const_cast<char*>(current_m->end()));
+
+    return traits_type::to_int_type(*gptr());
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
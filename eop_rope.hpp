@@ -0,0 +1,100 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_ROPE_HPP
+#define EOP_ROPE_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    rope_t is a piece table: the text is a sequence of spans, each a range of an immutable,
+    shared piece. Editing splits spans and inserts a new piece; the text is never flattened.
+*/
+
+class rope_t
+{
+ public:
+    typedef boost::shared_ptr<const std::string> piece_t;
+
+    struct span_t
+    {
+        span_t(const piece_t& piece, std::size_t first, std::size_t last) :
+            piece_m(piece), first_m(first), last_m(last)
+        { }
+
+        std::size_t size() const { return last_m - first_m; }
+        const char* begin() const { return piece_m->data() + first_m; }
+        const char* end() const { return piece_m->data() + last_m; }
+
+        piece_t     piece_m;
+        std::size_t first_m;
+        std::size_t last_m;
+    };
+
+    typedef std::vector<span_t>::const_iterator const_iterator;
+
+    rope_t();
+    explicit rope_t(const std::string& text);
+
+    std::size_t     size() const { return size_m; }
+    const_iterator  begin() const { return spans_m.begin(); }
+    const_iterator  end() const { return spans_m.end(); }
+
+    void            append(const piece_t& piece, std::size_t first, std::size_t last);
+    void            replace(std::size_t offset, std::size_t length, const std::string& text);
+
+    std::string     substr(std::size_t offset, std::size_t length) const;
+
+ private:
+    // Splits the span containing offset so that a span begins at offset; returns its index.
+    std::size_t     split(std::size_t offset);
+
+    std::vector<span_t> spans_m;
+    std::size_t         size_m;
+};
+
+/*************************************************************************************************/
+
+//  rope_buffer_t reads a rope from offset onwards, one span at a time and without copying.
+
+class rope_buffer_t : public std::streambuf
+{
+ public:
+    rope_buffer_t(const rope_t& rope, std::size_t offset);
+
+ protected:
+    int_type underflow();
+
+ private:
+    rope_t::const_iterator  current_m;
+    rope_t::const_iterator  last_m;
+};
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
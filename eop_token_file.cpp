@@ -0,0 +1,421 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <typeinfo>
+
+#include <adobe/any_regular.hpp>
+#include <adobe/implementation/token.hpp>
+
+#include "eop_lex_stream.hpp"
+#include "eop_token_file.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+const boost::uint8_t token_file_format_k = 1;
+
+/*************************************************************************************************/
+
+namespace {
+
+const char          magic_k[7] = { 'E', 'O', 'P', 'T', 'O', 'K', 'S' };
+
+// The flags of a record.
+const boost::uint8_t value_mask_k   = 0x03;
+const boost::uint8_t no_value_k     = 0x00;
+const boost::uint8_t name_value_k   = 0x01;
+const boost::uint8_t number_value_k = 0x02;
+const boost::uint8_t string_value_k = 0x03;
+const boost::uint8_t new_line_k     = 0x04;
+const boost::uint8_t error_k        = 0x08;
+
+/*************************************************************************************************/
+
+void put_unsigned(std::string& out, boost::uint64_t x)
+{
+    while (x >= 0x80) {
+        out += char((x & 0x7f) | 0x80);
+        x >>= 7;
+    }
+    out += char(x);
+}
+
+void put_signed(std::string& out, boost::int64_t x)
+{
+    put_unsigned(out, (boost::uint64_t(x) << 1) ^ boost::uint64_t(x >> 63));
+}
+
+void put_string(std::string& out, const std::string& x)
+{
+    put_unsigned(out, x.size());
+    out += x;
+}
+
+void put_number(std::string& out, double x)
+{
+    boost::uint64_t bits;
+
+    std::memcpy(&bits, &x, sizeof(bits));
+    for (std::size_t n(0); n != 8; ++n) out += char((bits >> (8 * n)) & 0xff);
+}
+
+/*
+    reader_t reads the fields of a token file from [first_m, last_m); each read fails, rather
+    than reading past the end, if the field does not fit.
+*/
+
+struct reader_t
+{
+    reader_t(const char* first, const char* last) : first_m(first), last_m(last) { }
+
+    bool get_byte(boost::uint8_t& x)
+    {
+        if (first_m == last_m) return false;
+        x = boost::uint8_t(*first_m++);
+        return true;
+    }
+
+    bool get_unsigned(boost::uint64_t& x)
+    {
+        x = 0;
+        for (std::size_t shift(0); shift < 64; shift += 7) {
+            boost::uint8_t byte;
+
+            if (!get_byte(byte)) return false;
+            x |= boost::uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool get_signed(boost::int64_t& x)
+    {
+        boost::uint64_t zigzag;
+
+        if (!get_unsigned(zigzag)) return false;
+        x = boost::int64_t(zigzag >> 1) ^ -boost::int64_t(zigzag & 1);
+        return true;
+    }
+
+    bool get_index(std::size_t size, std::size_t& x)
+    {
+        boost::uint64_t index;
+
+        if (!get_unsigned(index) || index >= size) return false;
+        x = std::size_t(index);
+        return true;
+    }
+
+    bool get_string(std::string& x)
+    {
+        boost::uint64_t size;
+
+        if (!get_unsigned(size) || size > boost::uint64_t(last_m - first_m)) return false;
+        x.assign(first_m, std::size_t(size));
+        first_m += size;
+        return true;
+    }
+
+    bool get_number(double& x)
+    {
+        if (last_m - first_m < 8) return false;
+
+        boost::uint64_t bits(0);
+
+        for (std::size_t n(0); n != 8; ++n)
+            bits |= boost::uint64_t(boost::uint8_t(first_m[n])) << (8 * n);
+        std::memcpy(&x, &bits, sizeof(x));
+        first_m += 8;
+        return true;
+    }
+
+    const char* first_m;
+    const char* last_m;
+};
+
+/*************************************************************************************************/
+
+//  Numbers the names and messages of the tokens written, in the order first met.
+
+struct token_writer_t
+{
+    token_writer_t() : position_m(0), line_number_m(1), line_start_m(0), size_m(0) { }
+
+    std::size_t name(name_t x)
+    {
+        std::map<name_t, std::size_t>::iterator found(names_m.find(x));
+
+        if (found != names_m.end()) return found->second;
+        put_string(names_table_m, x.c_str());
+        return names_m.insert(std::make_pair(x, names_m.size())).first->second;
+    }
+
+    std::size_t message(const char* x)
+    {
+        std::map<std::string, std::size_t>::iterator found(messages_m.find(x));
+
+        if (found != messages_m.end()) return found->second;
+        put_string(messages_table_m, x);
+        return messages_m.insert(std::make_pair(std::string(x), messages_m.size())).first->second;
+    }
+
+    void write(const stream_lex_token_t& token, const line_position_t& position,
+            const char* error, const line_position_t& error_position)
+    {
+        boost::int64_t  offset(boost::int64_t(std::streamoff(position.position_m)));
+        boost::int64_t  line_start(boost::int64_t(std::streamoff(position.line_start_m)));
+        boost::uint8_t  flags(no_value_k);
+        const std::type_info& type(token.second.type_info());
+
+        if (type == typeid(name_t)) flags = name_value_k;
+        else if (type == typeid(double)) flags = number_value_k;
+        else if (type == typeid(std::string)) flags = string_value_k;
+
+        if (position.line_number_m != line_number_m || line_start != line_start_m)
+            flags |= new_line_k;
+        if (error) flags |= error_k;
+
+        put_unsigned(records_m, name(token.first));
+        records_m += char(flags);
+        put_signed(records_m, offset - position_m);
+        if (flags & new_line_k) {
+            put_signed(records_m, position.line_number_m - line_number_m);
+            put_signed(records_m, offset - line_start);
+        }
+
+        switch (flags & value_mask_k) {
+        case name_value_k:      put_unsigned(records_m, name(token.second.cast<name_t>())); break;
+        case number_value_k:    put_number(records_m, token.second.cast<double>()); break;
+        case string_value_k:    put_string(records_m, token.second.cast<std::string>()); break;
+        default:                break;
+        }
+
+        if (error) {
+            put_unsigned(records_m, message(error));
+            put_signed(records_m, std::streamoff(error_position.position_m));
+            put_signed(records_m, error_position.line_number_m);
+            put_signed(records_m, std::streamoff(error_position.line_start_m));
+        }
+
+        position_m = offset;
+        line_number_m = position.line_number_m;
+        line_start_m = line_start;
+        ++size_m;
+    }
+
+    std::map<name_t, std::size_t>       names_m;
+    std::map<std::string, std::size_t>  messages_m;
+    std::string                         names_table_m;
+    std::string                         messages_table_m;
+    std::string                         records_m;
+    boost::int64_t                      position_m; // as token_cursor_t
+    int                                 line_number_m;
+    boost::int64_t                      line_start_m;
+    std::size_t                         size_m;
+};
+
+} // namespace
+
+/*************************************************************************************************/
+
+/*
+    The tokens are taken as token_pipe_t takes them: the position before each, and any error
+    made lexing it; with errors deferred a token the lexer cannot make is eof with the error,
+    and lexing goes on past it.
+*/
+
+bool write_token_file(lex_stream_t& lexer, const std::string& source, std::ostream& out)
+{
+    token_writer_t writer;
+
+    lexer.set_defer_errors(true);
+
+    while (true) {
+        line_position_t             position(lexer.next_position());
+        const stream_lex_token_t&   token(lexer.get());
+        const char*                 error(lexer.error());
+
+        writer.write(token, position, error, lexer.error_position());
+        if (error) lexer.clear_error();
+        else if (token.first == eof_k) break;
+    }
+
+    std::string header(magic_k, magic_k + sizeof(magic_k));
+
+    header += char(token_file_format_k);
+    put_string(header, source);
+    put_unsigned(header, writer.size_m);
+    put_unsigned(header, writer.names_m.size());
+    header += writer.names_table_m;
+    put_unsigned(header, writer.messages_m.size());
+    header += writer.messages_table_m;
+    put_unsigned(header, writer.records_m.size());
+
+    out.write(header.data(), header.size());
+    out.write(writer.records_m.data(), writer.records_m.size());
+    return bool(out);
+}
+
+/*************************************************************************************************/
+
+/*
+    Every record is read once here, so a file which is cut short or corrupt is refused whole
+    and next() never meets one it cannot read.
+*/
+
+bool token_file_t::read(std::istream& in)
+{
+    std::string     content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    reader_t        reader(content.data(), content.data() + content.size());
+    boost::uint8_t  format(0);
+    boost::uint64_t count(0);
+    bool            valid(content.size() > sizeof(magic_k)
+                        && std::memcmp(content.data(), magic_k, sizeof(magic_k)) == 0);
+
+    source_m.clear();
+    size_m = 0;
+    names_m.clear();
+    messages_m.clear();
+    records_m.clear();
+
+    reader.first_m += sizeof(magic_k);
+    valid = valid && reader.get_byte(format) && format == token_file_format_k
+        && reader.get_string(source_m) && reader.get_unsigned(count)
+        && count <= content.size();
+
+    boost::uint64_t names(0);
+
+    valid = valid && reader.get_unsigned(names) && names <= content.size();
+    for (boost::uint64_t n(0); valid && n != names; ++n) {
+        std::string name;
+
+        valid = reader.get_string(name);
+        names_m.push_back(name_t(name.c_str()));
+    }
+
+    boost::uint64_t messages(0);
+
+    valid = valid && reader.get_unsigned(messages) && messages <= content.size();
+    for (boost::uint64_t n(0); valid && n != messages; ++n) {
+        messages_m.push_back(std::string());
+        valid = reader.get_string(messages_m.back());
+    }
+
+    valid = valid && reader.get_string(records_m) && reader.first_m == reader.last_m;
+
+    token_cursor_t      cursor;
+    stream_lex_token_t  token;
+    line_position_t     position;
+    const char*         error;
+    line_position_t     error_position;
+    std::size_t         decoded(0);
+
+    if (valid) size_m = std::size_t(count);
+    while (valid && next(cursor, token, position, error, error_position)) ++decoded;
+
+    if (valid && decoded == count && cursor.offset_m == records_m.size()) return true;
+
+    source_m.clear();
+    size_m = 0;
+    names_m.clear();
+    messages_m.clear();
+    records_m.clear();
+    return false;
+}
+
+/*************************************************************************************************/
+
+bool token_file_t::next(token_cursor_t& cursor, stream_lex_token_t& token,
+        line_position_t& position, const char*& error, line_position_t& error_position) const
+{
+    reader_t        reader(records_m.data() + cursor.offset_m, records_m.data() + records_m.size());
+    std::size_t     kind(0);
+    boost::uint8_t  flags(0);
+    boost::int64_t  delta(0);
+
+    if (!reader.get_index(names_m.size(), kind) || !reader.get_byte(flags)
+            || !reader.get_signed(delta)) {
+        return false;
+    }
+
+    cursor.position_m += delta;
+    if (flags & new_line_k) {
+        boost::int64_t line_delta(0);
+        boost::int64_t line_offset(0);
+
+        if (!reader.get_signed(line_delta) || !reader.get_signed(line_offset)) return false;
+        cursor.line_number_m += int(line_delta);
+        cursor.line_start_m = cursor.position_m - line_offset;
+    }
+
+    token.first = names_m[kind];
+    switch (flags & value_mask_k) {
+    case name_value_k: {
+        std::size_t name(0);
+
+        if (!reader.get_index(names_m.size(), name)) return false;
+        token.second = any_regular_t(names_m[name]);
+        break;
+    }
+    case number_value_k: {
+        double number(0);
+
+        if (!reader.get_number(number)) return false;
+        token.second = any_regular_t(number);
+        break;
+    }
+    case string_value_k: {
+        std::string text;
+
+        if (!reader.get_string(text)) return false;
+        token.second = any_regular_t(text);
+        break;
+    }
+    default:
+        token.second = any_regular_t();
+        break;
+    }
+
+    error = 0;
+    if (flags & error_k) {
+        std::size_t     message(0);
+        boost::int64_t  error_offset(0);
+        boost::int64_t  error_line(0);
+        boost::int64_t  error_line_start(0);
+
+        if (!reader.get_index(messages_m.size(), message) || !reader.get_signed(error_offset)
+                || !reader.get_signed(error_line) || !reader.get_signed(error_line_start)) {
+            return false;
+        }
+        error = messages_m[message].c_str();
+        error_position = position;
+        error_position.position_m = std::streamoff(error_offset);
+        error_position.line_number_m = int(error_line);
+        error_position.line_start_m = std::streamoff(error_line_start);
+    }
+
+    position.position_m = std::streamoff(cursor.position_m);
+    position.line_number_m = cursor.line_number_m;
+    position.line_start_m = std::streamoff(cursor.line_start_m);
+    cursor.offset_m = reader.first_m - records_m.data();
+    return true;
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
@@ -0,0 +1,118 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_TOKEN_FILE_HPP
+#define EOP_TOKEN_FILE_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <adobe/istream.hpp>
+#include <adobe/name.hpp>
+
+#include "eop_lex_stream_fwd.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    A token file holds the tokens lex_stream_t made of a source, so the source can be parsed
+    again without lexing it: lex_stream_t::reset() and expression_parser::reset() take one in
+    place of an input, and give the same tokens, positions and deferred errors as lexing would.
+
+    The layout is a header, the names and the error messages the tokens use, then one record
+    per token. Counts, lengths and differences are unsigned LEB128 varints, signed differences
+    zigzag encoded first; numbers are IEEE doubles in eight little-endian bytes.
+
+        header      - the magic "EOPTOKS", token_file_format_k as one byte, the name of the
+                      source, the count of tokens and the size of the records.
+        names       - every name_t used as a kind or a value, interned once as the file is read.
+        messages    - the text of every deferred lexer error.
+        record      - the kind, an index into the names; a byte of flags giving the type of the
+                      value and whether the token starts a new line or carries an error; the
+                      offset from the token before; then the new line number and line start,
+                      the value, and the error with its own position, as the flags say.
+
+    The keywords are fixed when the file is written: the lexer writing it must have the keyword
+    extension lookup of the parser reading it.
+*/
+
+extern const boost::uint8_t token_file_format_k;
+
+/*
+    write_token_file() lexes to the end of its input with lexer, whose errors it defers, and
+    writes the tokens to out as a token file naming source. Returns false if out fails.
+*/
+bool write_token_file(lex_stream_t& lexer, const std::string& source, std::ostream& out);
+
+/*************************************************************************************************/
+
+//  token_cursor_t is a place in the records of a token file; one made by default is the start.
+
+struct token_cursor_t
+{
+    token_cursor_t() : offset_m(0), position_m(0), line_number_m(1), line_start_m(0) { }
+
+    std::size_t     offset_m; // into the records
+    boost::int64_t  position_m; // of the token last read
+    int             line_number_m;
+    boost::int64_t  line_start_m;
+};
+
+class token_file_t : boost::noncopyable
+{
+ public:
+    token_file_t() : size_m(0) { }
+
+/*
+    read() reads a token file from in, replacing any read before; returns false, leaving it
+    empty, if in does not hold a well formed token file of this format.
+*/
+    bool read(std::istream& in);
+
+    const std::string& source() const { return source_m; }
+    std::size_t size() const { return size_m; } // in tokens
+
+/*
+    next() reads the token at cursor, and where it is and the error lexing it, if any, into the
+    arguments and advances cursor; returns false at the end of the tokens. The file name and the
+    getline proc of position are left as they were. An error is null or a message held by the
+    token file.
+*/
+    bool next(token_cursor_t& cursor, stream_lex_token_t& token, line_position_t& position,
+            const char*& error, line_position_t& error_position) const;
+
+ private:
+    std::string                 source_m;
+    std::size_t                 size_m;
+    std::vector<name_t>         names_m;
+    std::vector<std::string>    messages_m;
+    std::string                 records_m;
+};
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
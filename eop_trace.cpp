@@ -0,0 +1,244 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <cstdio>
+#include <ostream>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "eop_trace.hpp"
+
+/*************************************************************************************************/
+
+#if defined(EOP_ENABLE_TRACE)
+
+    #if defined(_MSC_VER)
+        #define EOP_THREAD_LOCAL __declspec(thread)
+    #else
+        #define EOP_THREAD_LOCAL __thread
+    #endif
+
+#endif
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+#if defined(EOP_ENABLE_TRACE)
+
+namespace {
+
+typedef boost::chrono::steady_clock steady_clock_t;
+
+struct trace_event_t
+{
+    const char*     name_m;
+    boost::uint64_t time_m; // nanoseconds of the steady clock
+    bool            enter_m;
+};
+
+/*
+    trace_ring_t holds the events of one thread; only that thread writes them. count_m is the
+    number of events written since the trace started, the latest count_m % capacity of them
+    held, and is stored with release order so that a reader sees the events it counts.
+*/
+
+struct trace_ring_t
+{
+    trace_ring_t(std::size_t thread, std::size_t capacity) :
+        events_m(capacity ? capacity : 1), count_m(0), thread_m(thread)
+    { }
+
+    std::vector<trace_event_t>  events_m;
+    boost::atomic<std::size_t>  count_m;
+    std::size_t                 thread_m; // numbered from one in the order threads record
+};
+
+/*
+    A trace is a generation of rings. A thread registers a ring the first time it records in a
+    generation; the registry is locked only then. Comparing the generation a thread last
+    registered in with the current one tells it its ring is gone without touching the ring.
+*/
+
+struct registry_t
+{
+    registry_t() : capacity_m(0), start_m(0) { }
+    ~registry_t() { clear(); }
+
+    void clear()
+    {
+        for (std::size_t n(0); n != rings_m.size(); ++n) delete rings_m[n];
+        rings_m.clear();
+    }
+
+    boost::mutex                mutex_m;
+    std::vector<trace_ring_t*>  rings_m;
+    std::size_t                 capacity_m;
+    boost::uint64_t             start_m;
+};
+
+registry_t& registry()
+{
+    static registry_t registry_s;
+    return registry_s;
+}
+
+boost::atomic<bool>             recording_g(false);
+boost::atomic<std::size_t>      generation_g(0);
+
+EOP_THREAD_LOCAL trace_ring_t*  ring_g;
+EOP_THREAD_LOCAL std::size_t    ring_generation_g;
+
+boost::uint64_t now()
+{
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+        steady_clock_t::now().time_since_epoch()).count();
+}
+
+trace_ring_t& thread_ring()
+{
+    std::size_t generation(generation_g.load(boost::memory_order_acquire));
+
+    if (!ring_g || ring_generation_g != generation) {
+        registry_t&                     trace(registry());
+        boost::lock_guard<boost::mutex> lock(trace.mutex_m);
+
+        ring_g = new trace_ring_t(trace.rings_m.size() + 1, trace.capacity_m);
+        trace.rings_m.push_back(ring_g);
+        ring_generation_g = generation;
+    }
+    return *ring_g;
+}
+
+void record(const char* name, bool enter)
+{
+    trace_ring_t&   ring(thread_ring());
+    std::size_t     count(ring.count_m.load(boost::memory_order_relaxed));
+    trace_event_t&  event(ring.events_m[count % ring.events_m.size()]);
+
+    event.name_m = name;
+    event.time_m = now();
+    event.enter_m = enter;
+    ring.count_m.store(count + 1, boost::memory_order_release);
+}
+
+void write_event(std::ostream& out, bool& first, const char* name, char phase,
+        boost::uint64_t time, boost::uint64_t start, std::size_t thread)
+{
+    char buffer[64];
+
+    // Timestamps are in microseconds; three decimals keep the nanoseconds.
+    std::sprintf(buffer, "%.3f", double(time > start ? time - start : 0) / 1000);
+    out << (first ? "\n" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"" << phase
+        << "\",\"ts\":" << buffer << ",\"pid\":1,\"tid\":" << thread << '}';
+    first = false;
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+bool trace_enabled() { return true; }
+
+void start_trace(std::size_t capacity)
+{
+    registry_t&                     trace(registry());
+    boost::lock_guard<boost::mutex> lock(trace.mutex_m);
+
+    trace.clear();
+    trace.capacity_m = capacity;
+    trace.start_m = now();
+    generation_g.fetch_add(1, boost::memory_order_release);
+    recording_g.store(true, boost::memory_order_release);
+}
+
+void stop_trace()
+{
+    recording_g.store(false, boost::memory_order_release);
+}
+
+void write_trace(std::ostream& out)
+{
+    registry_t&                     trace(registry());
+    boost::lock_guard<boost::mutex> lock(trace.mutex_m);
+    bool                            first(true);
+
+    out << "{\"traceEvents\":[";
+
+    for (std::size_t n(0); n != trace.rings_m.size(); ++n) {
+        const trace_ring_t&         ring(*trace.rings_m[n]);
+        std::size_t                 count(ring.count_m.load(boost::memory_order_acquire));
+        std::size_t                 capacity(ring.events_m.size());
+        std::vector<const char*>    open; // the entries not yet exited
+        boost::uint64_t             last(trace.start_m);
+
+        for (std::size_t k(count > capacity ? count - capacity : 0); k != count; ++k) {
+            const trace_event_t& event(ring.events_m[k % capacity]);
+
+            last = event.time_m;
+            if (event.enter_m) {
+                open.push_back(event.name_m);
+            } else {
+                if (open.empty()) continue; // its entry was overwritten
+                open.pop_back();
+            }
+            write_event(out, first, event.name_m, event.enter_m ? 'B' : 'E', event.time_m,
+                trace.start_m, ring.thread_m);
+        }
+
+        while (!open.empty()) {
+            write_event(out, first, open.back(), 'E', last, trace.start_m, ring.thread_m);
+            open.pop_back();
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+/*************************************************************************************************/
+
+trace_scope_t::trace_scope_t(const char* name) : name_m(0)
+{
+    if (!recording_g.load(boost::memory_order_relaxed)) return;
+    name_m = name;
+    record(name, true);
+}
+
+trace_scope_t::~trace_scope_t()
+{
+    if (name_m) record(name_m, false);
+}
+
+#else
+
+bool trace_enabled() { return false; }
+
+void start_trace(std::size_t) { }
+
+void stop_trace() { }
+
+void write_trace(std::ostream& out) { out << "{\"traceEvents\":[]}\n"; }
+
+trace_scope_t::trace_scope_t(const char*) : name_m(0) { }
+
+trace_scope_t::~trace_scope_t() { }
+
+#endif
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
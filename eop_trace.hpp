@@ -0,0 +1,83 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_TRACE_HPP
+#define EOP_TRACE_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+
+#include <boost/noncopyable.hpp>
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+/*
+    Tracing records a timeline of the parse: the entry to and exit from each grammar production
+    and each token taken from the lexer, marked with EOP_TRACE_SCOPE(). It is built in only with
+    EOP_ENABLE_TRACE defined; otherwise the marks compile to nothing, and starting a trace does
+    nothing.
+
+    Each thread records into a ring buffer of its own, so recording takes no lock and threads
+    do not contend; once a ring is full the oldest events are overwritten. The trace is written
+    in the Chrome trace event format, which chrome://tracing and Perfetto display.
+*/
+
+//  trace_enabled() is true if built with EOP_ENABLE_TRACE.
+bool trace_enabled();
+
+/*
+    start_trace() discards any events recorded and starts recording, keeping up to capacity
+    events per thread. stop_trace() stops; scopes already entered still record their exit.
+*/
+void start_trace(std::size_t capacity = 1 << 20);
+void stop_trace();
+
+/*
+    write_trace() writes the events recorded as Chrome trace event JSON. It must not run while
+    a traced thread is recording. The exits of entries overwritten in a ring are left out, and
+    entries not exited close at the last event of their thread, so the scopes always nest.
+*/
+void write_trace(std::ostream& out);
+
+/*************************************************************************************************/
+
+//  trace_scope_t records the entry to name, a string literal, and on destruction its exit.
+
+class trace_scope_t : boost::noncopyable
+{
+ public:
+    explicit trace_scope_t(const char* name);
+    ~trace_scope_t();
+
+ private:
+    const char* name_m; // null if not recording
+};
+
+#if defined(EOP_ENABLE_TRACE)
+    #define EOP_TRACE_SCOPE(name) ::eop::trace_scope_t eop_trace_scope_(name)
+#else
+    #define EOP_TRACE_SCOPE(name)
+#endif
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
@@ -0,0 +1,547 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && !defined(EOP_NO_INOTIFY)
+    #define EOP_WATCH_INOTIFY
+    #include <cerrno>
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "eop_watch.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+namespace {
+
+typedef std::pair<std::string, bool> root_t; // a directory, and whether watched recursively
+
+/*
+    Appends the files and the directories within directory, but for those whose names start
+    with "."; returns false if it cannot be read.
+*/
+
+bool list(const std::string& directory, std::vector<std::string>& files,
+        std::vector<std::string>& directories)
+{
+    DIR* stream(opendir(directory.c_str()));
+
+    if (!stream) return false;
+
+    while (dirent* entry = readdir(stream)) {
+        if (entry->d_name[0] == '.') continue;
+
+        std::string path(directory + "/" + entry->d_name);
+        struct stat status;
+
+        if (stat(path.c_str(), &status) != 0) continue;
+        if (S_ISDIR(status.st_mode)) directories.push_back(path);
+        else if (S_ISREG(status.st_mode)) files.push_back(path);
+    }
+
+    closedir(stream);
+    return true;
+}
+
+//  Milliseconds left until deadline, never negative; -1, without limit, if timeout was.
+
+long remaining(long timeout, boost::chrono::steady_clock::time_point deadline)
+{
+    if (timeout < 0) return -1;
+
+    boost::chrono::milliseconds left(boost::chrono::duration_cast<boost::chrono::milliseconds>(
+        deadline - boost::chrono::steady_clock::now()));
+
+    return left.count() < 0 ? 0 : static_cast<long>(left.count());
+}
+
+bool read_file(const std::string& file, std::string& result)
+{
+    std::ifstream stream(file.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!stream) return false;
+    result.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+inline bool is_word(unsigned char c) { return std::isalnum(c) || c == '_'; }
+
+//  The sorted identifiers of content, in code, comments and strings alike.
+
+void find_identifiers(const std::string& content, std::vector<std::string>& result)
+{
+    result.clear();
+
+    for (std::size_t n(0); n != content.size();) {
+        unsigned char c(static_cast<unsigned char>(content[n]));
+        std::size_t   first(n);
+
+        if (!is_word(c)) { ++n; continue; }
+
+        while (n != content.size() && is_word(static_cast<unsigned char>(content[n]))) ++n;
+
+        // A number, suffix and all, is no identifier.
+        if (!std::isdigit(c)) result.push_back(content.substr(first, n - first));
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+bool intersect(const std::vector<std::string>& x, const std::vector<std::string>& y)
+{
+    std::vector<std::string>::const_iterator first(x.begin()), second(y.begin());
+
+    while (first != x.end() && second != y.end()) {
+        if (*first < *second) ++first;
+        else if (*second < *first) ++second;
+        else return true;
+    }
+    return false;
+}
+
+//  The cache is keyed as by the command line tool, so the two share their entries.
+
+content_hash_t prelude_key(const parse_options_t& options, content_hash_t prelude)
+{
+    const char mode[] = { options.recover_m ? 'r' : 's', options.skip_bodies_m ? 'd' : 'b' };
+
+    return content_hash(prelude, mode, mode + sizeof(mode));
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
+std::string canonical_path(const std::string& path)
+{
+    char* result(realpath(path.c_str(), 0));
+
+    if (!result) return std::string();
+
+    std::string copy(result);
+
+    std::free(result);
+    return copy;
+}
+
+/*************************************************************************************************/
+
+#ifdef EOP_WATCH_INOTIFY
+
+/*
+    Each directory watched has an inotify watch of its own. A watch is dropped by the kernel
+    (IN_IGNORED) when its directory is deleted; a directory moved within the tree keeps its
+    watch under the old path, as IN_MOVE_SELF is not followed, so its files are reported under
+    that path until the tree is added again.
+*/
+
+struct directory_watch_t::implementation_t
+{
+    implementation_t() : fd_m(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) { }
+    ~implementation_t() { if (fd_m != -1) close(fd_m); }
+
+    bool add(const std::string& directory, bool recursive, std::vector<std::string>& files);
+    bool wait(std::vector<std::string>& changed, long timeout);
+    bool watch(const std::string& directory, bool recursive, std::vector<std::string>& files);
+    bool read(std::vector<std::string>& changed);
+
+    int                         fd_m;
+    std::map<int, root_t>       watches_m;
+    std::vector<root_t>         roots_m; // to list again once notifications are lost
+    std::vector<char>           buffer_m; // aligned as allocated, for inotify_event
+};
+
+bool directory_watch_t::implementation_t::add(const std::string& directory, bool recursive,
+        std::vector<std::string>& files)
+{
+    if (!watch(directory, recursive, files)) return false;
+    roots_m.push_back(root_t(canonical_path(directory), recursive));
+    return true;
+}
+
+bool directory_watch_t::implementation_t::watch(const std::string& directory, bool recursive,
+        std::vector<std::string>& files)
+{
+    std::string path(canonical_path(directory));
+
+    if (fd_m == -1 || path.empty()) return false;
+
+    int descriptor(inotify_add_watch(fd_m, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO
+                    | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR));
+
+    if (descriptor == -1) return false;
+
+    // A directory added again is the same watch; it stays recursive if it was.
+    root_t& root(watches_m[descriptor]);
+
+    root.first = path;
+    root.second = root.second || recursive;
+
+    std::vector<std::string> directories;
+
+    if (!list(path, files, directories)) return false;
+
+    if (recursive) {
+        for (std::size_t n(0); n != directories.size(); ++n) watch(directories[n], true, files);
+    }
+    return true;
+}
+
+//  Reads the events waiting; returns false if notifications were lost.
+
+bool directory_watch_t::implementation_t::read(std::vector<std::string>& changed)
+{
+    bool result(true);
+
+    buffer_m.resize(16 * 1024);
+
+    while (true) {
+        ssize_t size(::read(fd_m, &buffer_m[0], buffer_m.size()));
+
+        if (size <= 0) break;
+
+        for (const char* p(&buffer_m[0]); p < &buffer_m[0] + size;) {
+            const inotify_event& event(*reinterpret_cast<const inotify_event*>(p));
+
+            p += sizeof(inotify_event) + event.len;
+
+            if (event.mask & IN_Q_OVERFLOW) { result = false; continue; }
+
+            std::map<int, root_t>::iterator found(watches_m.find(event.wd));
+
+            if (found == watches_m.end()) continue;
+            if (event.mask & IN_IGNORED) { watches_m.erase(found); continue; }
+            if (!event.len || event.name[0] == '.') continue;
+
+            std::string path(found->second.first + "/" + event.name);
+
+            if (!(event.mask & IN_ISDIR)) {
+                if (!(event.mask & IN_CREATE)) changed.push_back(path); // reported once closed
+            } else if (found->second.second && (event.mask & (IN_CREATE | IN_MOVED_TO))) {
+                // Its files may have been written before the watch was added.
+                watch(path, true, changed);
+            }
+        }
+    }
+    return result;
+}
+
+bool directory_watch_t::implementation_t::wait(std::vector<std::string>& changed, long timeout)
+{
+    boost::chrono::steady_clock::time_point deadline(boost::chrono::steady_clock::now()
+                                                    + boost::chrono::milliseconds(timeout));
+    std::size_t                             size(changed.size());
+
+    while (changed.size() == size) {
+        pollfd descriptor = { fd_m, POLLIN, 0 };
+        int    ready(poll(&descriptor, 1, static_cast<int>(remaining(timeout, deadline))));
+
+        if (ready < 0 && errno != EINTR) return false;
+        if (ready == 0) return false;
+        if (ready < 0) continue;
+
+        if (!read(changed)) {
+            for (std::size_t n(0); n != roots_m.size(); ++n)
+                watch(roots_m[n].first, roots_m[n].second, changed);
+        }
+    }
+
+    std::sort(changed.begin() + size, changed.end());
+    changed.erase(std::unique(changed.begin() + size, changed.end()), changed.end());
+    return true;
+}
+
+#else
+
+/*
+    Without inotify the trees are listed again every poll_interval_k and the modification time
+    and size of each file compared with those last reported. A change is only reported once it
+    has been seen by two listings in a row, so a file being written is not read half done.
+    st_mtime has a resolution of a second, so a file rewritten within the second it was last
+    reported, at the same size, is not seen to change.
+*/
+
+struct directory_watch_t::implementation_t
+{
+    typedef std::map<std::string, std::pair<time_t, off_t> > stamps_t;
+
+    bool add(const std::string& directory, bool recursive, std::vector<std::string>& files);
+    bool wait(std::vector<std::string>& changed, long timeout);
+    bool scan(const std::string& directory, bool recursive, stamps_t& stamps);
+
+    std::vector<root_t> roots_m;
+    stamps_t            stamps_m; // as last reported
+    stamps_t            seen_m; // as last listed
+};
+
+const long poll_interval_k = 100; // milliseconds
+
+bool directory_watch_t::implementation_t::scan(const std::string& directory, bool recursive,
+        stamps_t& stamps)
+{
+    std::vector<std::string> files, directories;
+
+    if (!list(directory, files, directories)) return false;
+
+    for (std::size_t n(0); n != files.size(); ++n) {
+        struct stat status;
+
+        if (stat(files[n].c_str(), &status) == 0)
+            stamps[files[n]] = std::make_pair(status.st_mtime, status.st_size);
+    }
+
+    if (recursive) {
+        for (std::size_t n(0); n != directories.size(); ++n) scan(directories[n], true, stamps);
+    }
+    return true;
+}
+
+bool directory_watch_t::implementation_t::add(const std::string& directory, bool recursive,
+        std::vector<std::string>& files)
+{
+    std::string path(canonical_path(directory));
+    stamps_t    stamps;
+
+    if (path.empty() || !scan(path, recursive, stamps)) return false;
+
+    roots_m.push_back(root_t(path, recursive));
+
+    for (stamps_t::const_iterator first(stamps.begin()); first != stamps.end(); ++first) {
+        files.push_back(first->first);
+        stamps_m.insert(*first);
+        seen_m.insert(*first);
+    }
+    return true;
+}
+
+bool directory_watch_t::implementation_t::wait(std::vector<std::string>& changed, long timeout)
+{
+    boost::chrono::steady_clock::time_point deadline(boost::chrono::steady_clock::now()
+                                                    + boost::chrono::milliseconds(timeout));
+
+    while (true) {
+        stamps_t stamps;
+
+        for (std::size_t n(0); n != roots_m.size(); ++n)
+            scan(roots_m[n].first, roots_m[n].second, stamps);
+
+        std::size_t size(changed.size());
+
+        for (stamps_t::const_iterator first(stamps.begin()); first != stamps.end(); ++first) {
+            stamps_t::iterator       found(stamps_m.find(first->first));
+            stamps_t::const_iterator seen(seen_m.find(first->first));
+
+            if (found != stamps_m.end() && found->second == first->second) continue;
+            if (seen == seen_m.end() || seen->second != first->second) continue;
+
+            changed.push_back(first->first);
+            stamps_m[first->first] = first->second;
+        }
+        for (stamps_t::iterator first(stamps_m.begin()); first != stamps_m.end();) {
+            if (stamps.count(first->first)) { ++first; continue; }
+            changed.push_back(first->first);
+            stamps_m.erase(first++);
+        }
+
+        seen_m.swap(stamps);
+        if (changed.size() != size) return true;
+
+        long left(remaining(timeout, deadline));
+
+        if (left == 0) return false;
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(left < 0 ? poll_interval_k
+            : (std::min)(left, poll_interval_k)));
+    }
+}
+
+#endif
+
+/*************************************************************************************************/
+
+directory_watch_t::directory_watch_t() : object_m(new implementation_t()) { }
+
+directory_watch_t::~directory_watch_t() { delete object_m; }
+
+bool directory_watch_t::add(const std::string& directory, bool recursive,
+        std::vector<std::string>& files)
+{
+    return object_m->add(directory, recursive, files);
+}
+
+bool directory_watch_t::wait(std::vector<std::string>& changed, long timeout)
+{
+    return object_m->wait(changed, timeout);
+}
+
+/*************************************************************************************************/
+
+watch_validator_t::watch_validator_t(const parse_options_t& options,
+        const std::string& cache_directory, const report_proc_t& report) :
+    parser_m(empty_m, line_position_t("")),
+    cache_m(cache_directory),
+    caching_m(!cache_directory.empty()),
+    report_m(report),
+    prelude_hash_m(prelude_key(options, content_hash(0, 0)))
+{
+    parser_m.set_options(options);
+}
+
+/*************************************************************************************************/
+
+/*
+    The prelude is parsed as by the command line tool: on its own, with the default options.
+    Its class names are those entered by its declarations.
+*/
+
+bool watch_validator_t::set_prelude(const std::string& file)
+{
+    std::string content;
+
+    if (!read_file(file, content)) {
+        std::vector<diagnostic_t> diagnostics(1);
+
+        diagnostics.back().message_m = "Cannot open prelude.";
+        report_m(file, diagnostics);
+        return false;
+    }
+
+    content_hash_t key(prelude_key(parser_m.options(),
+        content_hash(content.data(), content.data() + content.size())));
+
+    if (prelude_m && key == prelude_hash_m) return true;
+
+    std::istringstream  stream(content);
+    expression_parser   parser(stream, line_position_t(file.c_str()));
+    parse_result_t      result;
+
+    parser.parse(result);
+    report_m(file, result.diagnostics_m);
+    if (!result.diagnostics_m.empty()) return false;
+
+    class_names_t class_names;
+
+    for (std::size_t n(0); n != result.declarations_m.size(); ++n) {
+        const declaration_t& declaration(*result.declarations_m[n]);
+
+        for (std::size_t i(0); i != declaration.class_names_m.size(); ++i) {
+            class_names[declaration.class_names_m[i].first.c_str()]
+                = declaration.class_names_m[i].second;
+        }
+    }
+
+    // The names added, removed or changed in whether a template, in order.
+
+    std::vector<std::string>        changed;
+    class_names_t::const_iterator   first(class_names_m.begin()), second(class_names.begin());
+
+    while (first != class_names_m.end() || second != class_names.end()) {
+        if (second == class_names.end() || (first != class_names_m.end()
+                && first->first < second->first)) {
+            changed.push_back((first++)->first);
+        } else if (first == class_names_m.end() || second->first < first->first) {
+            changed.push_back((second++)->first);
+        } else {
+            if (first->second != second->second) changed.push_back(first->first);
+            ++first;
+            ++second;
+        }
+    }
+
+    prelude_m = parser.snapshot();
+    prelude_hash_m = key;
+    class_names_m.swap(class_names);
+
+    std::vector<std::string> missing;
+
+    for (file_map_t::iterator file(files_m.begin()); file != files_m.end(); ++file) {
+        if (!intersect(file->second.identifiers_m, changed)) continue;
+
+        if (!read_file(file->first, content)) { missing.push_back(file->first); continue; }
+
+        file->second.hash_m = content_hash(content.data(), content.data() + content.size());
+        parse(file->first, content, file->second);
+    }
+
+    for (std::size_t n(0); n != missing.size(); ++n) remove(missing[n]);
+    return true;
+}
+
+/*************************************************************************************************/
+
+void watch_validator_t::validate(const std::string& file)
+{
+    std::string content;
+
+    if (!read_file(file, content)) { remove(file); return; }
+
+    content_hash_t       hash(content_hash(content.data(), content.data() + content.size()));
+    file_map_t::iterator found(files_m.find(file));
+
+    if (found != files_m.end() && found->second.hash_m == hash) return;
+
+    file_state_t& state(files_m[file]);
+
+    state.hash_m = hash;
+    parse(file, content, state);
+}
+
+/*************************************************************************************************/
+
+void watch_validator_t::remove(const std::string& file)
+{
+    files_m.erase(file);
+}
+
+/*************************************************************************************************/
+
+void watch_validator_t::parse(const std::string& file, const std::string& content,
+        file_state_t& state)
+{
+    content_hash_t  key(content_hash(prelude_hash_m, content.data(),
+                        content.data() + content.size()));
+    cache_entry_t   entry;
+    parse_result_t  result;
+
+    find_identifiers(content, state.identifiers_m);
+
+    if (caching_m && cache_m.find(key, content.size(), entry)) {
+        entry.get(result);
+    } else {
+        std::istringstream stream(content);
+
+        parser_m.reset(stream, line_position_t(file.c_str()), prelude_m);
+        parser_m.parse(result);
+        parser_m.reset(empty_m, line_position_t(""), prelude_m);
+        if (caching_m) cache_m.store(key, content.size(), result);
+    }
+
+    report_m(file, result.diagnostics_m);
+}
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
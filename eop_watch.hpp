@@ -0,0 +1,145 @@
+/*
+    Copyright 2005-2007 Adobe Systems Incorporated
+    Distributed under the MIT License (see accompanying file LICENSE_1_0_0.txt
+    or a copy at http://stlab.adobe.com/licenses.html)
+*/
+
+/*************************************************************************************************/
+
+#ifndef EOP_WATCH_HPP
+#define EOP_WATCH_HPP
+
+/*************************************************************************************************/
+
+#include <adobe/config.hpp>
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "eop_parse_cache.hpp"
+#include "exp_parser.hpp"
+
+/*************************************************************************************************/
+
+namespace eop {
+
+/*************************************************************************************************/
+
+//  canonical_path() is the absolute path of an existing file, without links; empty if none.
+
+std::string canonical_path(const std::string& path);
+
+/*************************************************************************************************/
+
+/*
+    directory_watch_t reports the files of the directories it watches as they change. On Linux
+    it is notified through inotify; elsewhere, or with EOP_NO_INOTIFY defined, it polls the
+    modification times and sizes of the files.
+
+    Entries whose names start with "." - version control directories, editor swap files - are
+    not watched. Directories created within a tree watched recursively are watched as they
+    appear, and their files reported as changed.
+*/
+
+class directory_watch_t : boost::noncopyable
+{
+ public:
+    directory_watch_t();
+    ~directory_watch_t();
+
+/*
+    add() watches directory, and with recursive set the directories within it, appending the
+    canonical paths of the files found to files. Returns false if directory cannot be watched.
+*/
+    bool add(const std::string& directory, bool recursive, std::vector<std::string>& files);
+
+/*
+    wait() waits up to timeout milliseconds, or without limit if timeout is negative, for files
+    to change and appends the paths of those written, created, moved or deleted to changed, each
+    once. A file is reported once its writer has closed it. If notifications were lost every
+    file is reported; a file reported may since have been deleted. Returns false on timeout.
+*/
+    bool wait(std::vector<std::string>& changed, long timeout);
+
+ private:
+    struct implementation_t;
+
+    implementation_t* object_m;
+};
+
+/*************************************************************************************************/
+
+/*
+    watch_validator_t keeps the parse of every file of a tree up to date as it changes. A file
+    whose content is unchanged is not parsed again, and a file seen in an earlier run is taken
+    from the parse cache if one is given.
+
+    A file depends on the prelude only through which of its identifiers are class names, so when
+    the prelude changes only the files using a name whose status as a class name, or as a
+    template, changed are parsed again; the results of the others stand. Identifiers are found
+    by a scan of the text which takes in comments and strings, so a file may be parsed again
+    needlessly, but never kept wrongly.
+
+    The diagnostics of each file parsed are passed to the report proc, an empty list meaning
+    the file parsed without error.
+*/
+
+class watch_validator_t : boost::noncopyable
+{
+ public:
+    typedef boost::function<void (const std::string& file,
+        const std::vector<diagnostic_t>& diagnostics)> report_proc_t;
+
+    watch_validator_t(const parse_options_t& options, const std::string& cache_directory,
+            const report_proc_t& report);
+
+/*
+    set_prelude() parses file as the prelude of the files validated and validates again those
+    it affects. If the prelude has errors they are reported and the previous prelude is kept;
+    returns false.
+*/
+    bool set_prelude(const std::string& file);
+
+//  validate() parses file if its content changed since it was last parsed.
+    void validate(const std::string& file);
+
+//  remove() forgets file, as validate() does one which no longer exists.
+    void remove(const std::string& file);
+
+ private:
+    struct file_state_t
+    {
+        content_hash_t              hash_m;
+        std::vector<std::string>    identifiers_m; // sorted
+    };
+
+    typedef std::map<std::string, bool> class_names_t; // to whether a template
+    typedef std::map<std::string, file_state_t> file_map_t;
+
+    void parse(const std::string& file, const std::string& content, file_state_t& state);
+
+    std::istringstream              empty_m;
+    expression_parser               parser_m;
+    parse_cache_t                   cache_m;
+    bool                            caching_m;
+    report_proc_t                   report_m;
+    expression_parser::snapshot_t   prelude_m;
+    content_hash_t                  prelude_hash_m; // with the options, to key the cache
+    class_names_t                   class_names_m; // of the prelude
+    file_map_t                      files_m;
+};
+
+/*************************************************************************************************/
+
+} // namespace eop
+
+/*************************************************************************************************/
+
+#endif
+
+/*************************************************************************************************/
@@ -13,13 +13,19 @@ with regards to state.
 
 /*************************************************************************************************/
 
+#include <algorithm>
+#include <cstddef>
+#include <deque>
 #include <utility>
 #include <istream>
+#include <streambuf>
 #include <sstream>
 #include <iomanip>
 #include <cassert>
 
+#include <boost/bind.hpp>
 #include <boost/config.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <adobe/array.hpp>
 #include <adobe/name.hpp>
@@ -33,7 +39,10 @@ with regards to state.
 #include <adobe/implementation/parser_shared.hpp>
 
 #include "exp_parser.hpp"
+#include "eop_allocation.hpp"
 #include "eop_lex_stream.hpp"
+#include "eop_metrics.hpp"
+#include "eop_trace.hpp"
 
 #ifdef BOOST_MSVC
 namespace std {
@@ -50,21 +59,754 @@ namespace eop {
 
 /*************************************************************************************************/
 
+typedef closed_hash_map<name_t, bool> class_name_index_t;
+
+struct expression_parser::state_t
+{
+    class_name_index_t              class_name_index_m;
+    keyword_extension_lookup_proc_t keyword_proc_m;
+};
+
+/*************************************************************************************************/
+
+const char* parse_cancelled_t::what() const throw()
+{
+    switch (reason_m) {
+    case cancelled_k:   return "parse cancelled.";
+    case deadline_k:    return "parse deadline passed.";
+    default:            return "parse token budget exhausted.";
+    }
+}
+
+/*************************************************************************************************/
+
+namespace {
+
+diagnostic_t make_diagnostic(const stream_error_t& error, std::size_t base)
+{
+    EOP_ALLOCATION_PHASE(diagnostics_phase_k);
+
+    diagnostic_t result;
+
+    result.message_m = error.what();
+
+    if (!error.line_position_set().empty()) {
+        const line_position_t& position(error.line_position_set().front());
+
+        // Stream positions are one based; the first line starts at position zero.
+
+        std::streamoff line_start(std::streamoff(base) + std::streamoff(position.line_start_m) - 1);
+
+        result.line_number_m = position.line_number_m;
+        if (line_start > 0) result.line_start_m = static_cast<std::size_t>(line_start);
+        if (position.position_m > 0)
+            result.offset_m = base + static_cast<std::size_t>(position.position_m) - 1;
+    }
+
+    return result;
+}
+
+/*************************************************************************************************/
+
+/*
+    count_lines() counts the line ends in [first, last) of text as the lexer does: a CR LF is
+    one, a CR or LF alone is one, and those in a string literal are not counted, while those in
+    comments are. line_start is set to follow the last one counted. first must not be within a
+    string or comment.
+*/
+
+std::size_t count_lines(const std::string& text, std::size_t first, std::size_t last,
+        std::size_t& line_start)
+{
+    std::size_t result(0);
+    char        within(0); // the quote of a string, '#' for a line comment, '*' for a block
+
+    for (; first < last; ++first) {
+        char c(text[first]);
+        char next(first + 1 != text.size() ? text[first + 1] : 0);
+
+        if (within == '\'' || within == '"') {
+            if (c == within) within = 0;
+        } else if (c == '\r' || c == '\n') {
+            if (c == '\r' && next == '\n') ++first;
+            ++result;
+            line_start = first + 1;
+            if (within == '#') within = 0;
+        } else if (within == '*') {
+            if (c == '*' && next == '/') { ++first; within = 0; }
+        } else if (within == '#') {
+            continue; // to the line end
+        } else if (c == '\'' || c == '"' || c == '#') {
+            within = c;
+        } else if (c == '/' && (next == '/' || next == '*')) {
+            within = next == '/' ? '#' : '*';
+            ++first;
+        }
+    }
+
+    return result;
+}
+
+//  locate() sets the position of result to offset within text.
+
+void locate(const std::string& text, std::size_t offset, diagnostic_t& result)
+{
+    std::size_t line_start(0);
+    std::size_t lines(count_lines(text, 0, offset, line_start));
+
+    result.offset_m = offset;
+    result.line_number_m = 1 + static_cast<int>(lines);
+    result.line_start_m = line_start;
+}
+
+//  Sets the position of result to offset, counting on from the position of from.
+
+void locate(const std::string& text, const diagnostic_t& from, std::size_t offset,
+        diagnostic_t& result)
+{
+    std::size_t line_start(from.line_start_m);
+    std::size_t lines(count_lines(text, from.offset_m, offset, line_start));
+
+    result.offset_m = offset;
+    result.line_number_m = from.line_number_m + static_cast<int>(lines);
+    result.line_start_m = line_start;
+}
+
+/*************************************************************************************************/
+
+/*
+    failure_t is an error deferred by parse_options_t::nothrow_m. It keeps only the parts of the
+    message; the text is formatted if and when the error is reported.
+*/
+
+struct failure_t
+{
+    failure_t() : message_m(0) { }
+
+    const char*     message_m; // a literal; 0 for an expected token
+    name_t          expected_m;
+    name_t          found_m; // empty for a lexer error
+    line_position_t position_m;
+};
+
+stream_error_t make_error(const failure_t& failure)
+{
+    std::string message;
+
+    if (!failure.message_m) {
+        message << "Expected \"" << failure.expected_m.c_str() << "\", Found \""
+            << failure.found_m.c_str() << "\"";
+    } else {
+        message = failure.message_m;
+        if (failure.found_m) message << " Found \"" << failure.found_m.c_str() << "\".";
+    }
+
+    return stream_error_t(message, failure.position_m);
+}
+
+/*************************************************************************************************/
+
+//  range_buffer_t reads a range of characters in place.
+
+class range_buffer_t : public std::streambuf
+{
+ public:
+    range_buffer_t(const char* first, const char* last)
+        { setg(const_cast<char*>(first), const_cast<char*>(first), const_cast<char*>(last)); }
+};
+
+/*************************************************************************************************/
+
+/*
+    pipeline_guard_t stops the lexing thread of a stream as a parse returns or throws. The
+    thread reads ahead in the input, which may go with the parse - a region parsed in place, or
+    a stream the caller destroys - so it must not outlive it. Declared after the input, the
+    guard is destroyed first.
+*/
+
+class pipeline_guard_t : public boost::noncopyable
+{
+ public:
+    explicit pipeline_guard_t(lex_stream_t& stream) : stream_m(stream) { }
+    ~pipeline_guard_t() { stream_m.stop_pipeline(); }
+
+ private:
+    lex_stream_t& stream_m;
+};
+
+/*************************************************************************************************/
+
+/*
+    callback_recorder_t holds back the callbacks of a declaration until it is known whether the
+    declaration is to be passed on. Only the callbacks with procs are recorded.
+*/
+
+class callback_recorder_t : public boost::noncopyable
+{
+ public:
+    explicit callback_recorder_t(const declaration_callback_suite_t& callbacks);
+
+    const declaration_callback_suite_t& suite() const { return suite_m; }
+
+    void replay(); // passes the recorded callbacks on, and forgets them
+    void clear() { events_m.clear(); }
+
+ private:
+    enum event_kind_t { begin_event_k, end_event_k, expression_event_k };
+
+    struct event_t
+    {
+        event_kind_t    kind_m;
+        name_t          scope_m;
+        name_t          name_m;
+        array_t         expression_m;
+    };
+
+    void begin(name_t kind, name_t name);
+    void end(name_t kind);
+    void expression(const array_t& expression);
+
+    const declaration_callback_suite_t& callbacks_m;
+    declaration_callback_suite_t        suite_m;
+    std::vector<event_t>                events_m;
+};
+
+callback_recorder_t::callback_recorder_t(const declaration_callback_suite_t& callbacks) :
+    callbacks_m(callbacks)
+{
+    if (callbacks.begin_proc_m)
+        suite_m.begin_proc_m = boost::bind(&callback_recorder_t::begin, this, _1, _2);
+    if (callbacks.end_proc_m)
+        suite_m.end_proc_m = boost::bind(&callback_recorder_t::end, this, _1);
+    if (callbacks.expression_proc_m)
+        suite_m.expression_proc_m = boost::bind(&callback_recorder_t::expression, this, _1);
+}
+
+void callback_recorder_t::begin(name_t kind, name_t name)
+{
+    events_m.push_back(event_t());
+    events_m.back().kind_m = begin_event_k;
+    events_m.back().scope_m = kind;
+    events_m.back().name_m = name;
+}
+
+void callback_recorder_t::end(name_t kind)
+{
+    events_m.push_back(event_t());
+    events_m.back().kind_m = end_event_k;
+    events_m.back().scope_m = kind;
+}
+
+void callback_recorder_t::expression(const array_t& expression)
+{
+    events_m.push_back(event_t());
+    events_m.back().kind_m = expression_event_k;
+    events_m.back().expression_m = expression;
+}
+
+void callback_recorder_t::replay()
+{
+    for (std::size_t n(0); n != events_m.size(); ++n) {
+        const event_t& event(events_m[n]);
+
+        switch (event.kind_m) {
+        case begin_event_k:         callbacks_m.begin_proc_m(event.scope_m, event.name_m); break;
+        case end_event_k:           callbacks_m.end_proc_m(event.scope_m); break;
+        case expression_event_k:    callbacks_m.expression_proc_m(event.expression_m); break;
+        }
+    }
+    events_m.clear();
+}
+
+//  Passes diagnostics to the callbacks, and forgets them.
+
+void report(const declaration_callback_suite_t& callbacks, std::vector<diagnostic_t>& diagnostics)
+{
+    for (std::size_t n(0); n != diagnostics.size(); ++n) {
+        if (callbacks.diagnostic_proc_m) callbacks.diagnostic_proc_m(diagnostics[n]);
+    }
+    diagnostics.clear();
+}
+
+/*************************************************************************************************/
+
+typedef std::vector<declaration_ptr_t>::const_iterator declaration_iterator_t;
+
+bool same_class_names(declaration_iterator_t first1, declaration_iterator_t last1,
+        declaration_iterator_t first2, declaration_iterator_t last2)
+{
+    std::vector<std::pair<name_t, bool> > x, y;
+
+    for (; first1 != last1; ++first1)
+        x.insert(x.end(), (*first1)->class_names_m.begin(), (*first1)->class_names_m.end());
+    for (; first2 != last2; ++first2)
+        y.insert(y.end(), (*first2)->class_names_m.begin(), (*first2)->class_names_m.end());
+
+    std::sort(x.begin(), x.end());
+    std::sort(y.begin(), y.end());
+
+    return x == y;
+}
+
+/*************************************************************************************************/
+
+/*
+    Expressions are parsed by operator precedence over explicit stacks. A frame is pushed for
+    each bracketed sub-expression and for the right operand of "&&" and "||", which is built in
+    an array of its own. Binary operators wait on the operator stack until an operator of lower
+    precedence (or the end of the frame) arrives; unary operators wait, with precedence zero,
+    until their operand and its postfix operators are complete.
+*/
+
+enum frame_kind_t
+{
+    expression_frame_k,     // expression
+    list_frame_k,           // expression_list
+    template_frame_k,       // "<" expression_additive_list ">"
+    parenthesis_frame_k,    // "(" expression ")"
+    index_frame_k,          // "[" expression "]"
+    call_frame_k,           // "(" [expression_list] ")"
+    and_frame_k,            // "&&" expression_equality
+    or_frame_k              // "||" expression_and
+};
+
+struct expression_frame_t
+{
+    expression_frame_t(frame_kind_t kind, array_t& output, std::size_t operators) :
+        kind_m(kind), output_m(&output), operators_m(operators), count_m(0)
+    { }
+
+    frame_kind_t    kind_m;
+    array_t*        output_m;
+    std::size_t     operators_m; // size of the operator stack on entry
+    std::size_t     count_m; // items in a list before the current one
+};
+
+struct expression_operator_t
+{
+    expression_operator_t(name_t name, int precedence) :
+        name_m(name), precedence_m(precedence)
+    { }
+
+    name_t  name_m;
+    int     precedence_m; // zero for a unary operator
+};
+
+enum
+{
+    or_precedence_k = 1,
+    and_precedence_k,
+    equality_precedence_k,
+    relational_precedence_k,
+    additive_precedence_k,
+    multiplicative_precedence_k
+};
+
+int binary_precedence(name_t name)
+{
+    if (name == or_k) return or_precedence_k;
+    if (name == and_k) return and_precedence_k;
+    if (name == equal_k || name == not_equal_k) return equality_precedence_k;
+    if (name == less_k || name == greater_k || name == less_equal_k || name == greater_equal_k)
+        return relational_precedence_k;
+    if (name == add_k || name == subtract_k) return additive_precedence_k;
+    if (name == multiply_k || name == divide_k || name == modulus_k)
+        return multiplicative_precedence_k;
+    return 0;
+}
+
+//  The lowest precedence of a binary operator within a frame; any other ends it.
+
+int minimum_precedence(frame_kind_t kind)
+{
+    switch (kind) {
+    case template_frame_k:  return additive_precedence_k;
+    case and_frame_k:       return equality_precedence_k;
+    case or_frame_k:        return and_precedence_k;
+    default:                return or_precedence_k;
+    }
+}
+
+} // namespace
+
+/*************************************************************************************************/
+
 class expression_parser::implementation
 {
  public:
+
     implementation(std::istream& in, const line_position_t& position) :
-        token_stream_m(in, position)
-        { }
+        token_stream_m(in, position),
+        declaration_m(0),
+        declaration_first_m(0),
+        diagnostics_m(0),
+        inserted_m(0),
+        reached_end_m(false),
+        tokens_m(0),
+        polls_m(0),
+        metrics_tokens_m(0),
+        base_m(0),
+        depth_m(0),
+        callbacks_m(0),
+        entered_count_m(0),
+        failed_m(false),
+        eof_token_m(eof_k, any_regular_t())
+    {
+        token_stream_m.set_defer_errors(true);
+    }
+
+    void set_keyword_extension_lookup(const keyword_extension_lookup_proc_t& proc)
+    {
+        keyword_proc_m = proc;
+        token_stream_m.set_keyword_extension_lookup(proc);
+    }
+
+    void reset(std::istream& in, const line_position_t& position, bool keep_class_names)
+    {
+        token_stream_m.reset(in, position);
+        clear_parse_state(0);
+        entered_m.reset();
+        if (keep_class_names) return;
+        class_name_index_m.clear();
+        prelude_m.reset();
+    }
+
+    void reset(std::istream& in, const line_position_t& position, const snapshot_t& prelude)
+    {
+        token_stream_m.reset(in, position);
+        restart(prelude);
+    }
+
+    void reset(const token_file_t& tokens, const line_position_t& position,
+            const snapshot_t& prelude)
+    {
+        token_stream_m.reset(tokens, position);
+        restart(prelude);
+    }
+
+    //  Forgets the last input, forking the class names from prelude.
+
+    void restart(const snapshot_t& prelude)
+    {
+        clear_parse_state(0);
+        entered_m.reset();
+        set_prelude(prelude);
+    }
+
+    /*
+        reset_region() starts a parse part way into a text at offset base, keeping the prelude.
+        The class names declared before base are entered by the caller, unless those already
+        entered are kept.
+    */
+
+    void reset_region(std::istream& in, const line_position_t& position, std::size_t base,
+            bool keep_class_names = false)
+    {
+        token_stream_m.reset(in, position);
+        clear_parse_state(base);
+        if (keep_class_names) return;
+        entered_m.reset();
+        class_name_index_m.clear();
+    }
+
+    /*
+        clear_parse_state() forgets what one parse leaves for the next, for a parse of a stream
+        at offset base; every reset goes through it, so a field added here is reset by all.
+    */
+
+    void clear_parse_state(std::size_t base)
+    {
+        declaration_m = 0;
+        diagnostics_m = 0;
+        failed_m = false;
+        reached_end_m = false;
+        tokens_m = 0;
+        base_m = base;
+        depth_m = 0;
+        open_m.clear();
+    }
+
+    void set_prelude(const snapshot_t& prelude)
+    {
+        class_name_index_m.clear();
+        prelude_m = prelude;
+        if (prelude_m && !prelude_m->keyword_proc_m.empty())
+            set_keyword_extension_lookup(prelude_m->keyword_proc_m);
+    }
+
+    /*
+        Class names are looked up in the names declared since the last reset first and then in
+        the prelude snapshot. The snapshot is shared and never written, so forking a parser from
+        it costs only a reference count.
+    */
+
+    bool find_class_name(name_t name, bool& is_template) const
+    {
+        class_name_index_t::const_iterator f = class_name_index_m.find(name);
+        if (f != class_name_index_m.end()) { is_template = f->second; return true; }
+        if (!prelude_m) return false;
+        f = prelude_m->class_name_index_m.find(name);
+        if (f == prelude_m->class_name_index_m.end()) return false;
+        is_template = f->second;
+        return true;
+    }
+
+    bool is_class_name(name_t name) const
+    {
+        return class_name_index_m.count(name)
+            || (prelude_m && prelude_m->class_name_index_m.count(name));
+    }
+
+    void insert_class_name(name_t name, bool is_template)
+    {
+        EOP_ALLOCATION_PHASE(class_index_phase_k);
+
+        if (failed_m) return;
+        if (prelude_m && prelude_m->class_name_index_m.count(name)) return;
+        if (!class_name_index_m.insert(make_pair(name, is_template)).second) return;
+        if (inserted_m) inserted_m->push_back(name);
+        if (declaration_m) declaration_m->class_names_m.push_back(make_pair(name, is_template));
+    }
+
+    void set_declaration(name_t kind, name_t name, bool is_template)
+    {
+        if (!declaration_m || failed_m) return;
+        declaration_m->kind_m = kind;
+        declaration_m->name_m = name;
+        declaration_m->template_m = is_template;
+    }
+
+    //  Records a skipped body spanning [first, last) of the text.
+
+    void add_body(std::size_t first, std::size_t last)
+    {
+        if (!declaration_m || failed_m) return;
+        declaration_m->bodies_m.push_back(std::make_pair(first - declaration_first_m,
+            last - first));
+    }
+
+    std::size_t next_offset()
+        { return base_m + static_cast<std::size_t>(token_stream_m.next_position().position_m) - 1; }
+
+    snapshot_t snapshot() const;
+
+    bool recovering() const { return options_m.recover_m && diagnostics_m; }
+
+    /*
+        begin() opens a scope for the callbacks and returns the depth to end() it at; end()
+        closes every scope opened since, innermost first. Nothing is opened after a failure
+        under nothrow_m, as nothing would be after a throw.
+    */
+
+    std::size_t begin(name_t kind, name_t name)
+    {
+        std::size_t result(open_m.size());
+
+        if (!callbacks_m || failed_m) return result;
+        open_m.push_back(kind);
+        if (callbacks_m->begin_proc_m) callbacks_m->begin_proc_m(kind, name);
+        return result;
+    }
+
+    void end(std::size_t depth)
+    {
+        while (open_m.size() > depth) {
+            name_t kind(open_m.back());
+
+            open_m.pop_back();
+            if (callbacks_m->end_proc_m) callbacks_m->end_proc_m(kind);
+        }
+    }
+
+    std::size_t depth() const { return open_m.size(); }
+
+    //  Passes the elements of expression from first on to the callbacks.
+
+    void expression(const array_t& expression, std::size_t first = 0)
+    {
+        if (!callbacks_m || failed_m || !callbacks_m->expression_proc_m) return;
+        if (!first) { callbacks_m->expression_proc_m(expression); return; }
+        callbacks_m->expression_proc_m(array_t(expression.begin() + first, expression.end()));
+    }
+
+    //  Frees what an unusually large declaration left in the scratch stacks.
+
+    void release_scratch()
+    {
+        const std::size_t limit(1024);
+
+        if (frames_m.capacity() > limit) std::vector<expression_frame_t>().swap(frames_m);
+        if (operators_m.capacity() > limit) std::vector<expression_operator_t>().swap(operators_m);
+        std::deque<array_t>().swap(operands_m);
+        if (open_m.capacity() > limit) std::vector<name_t>().swap(open_m);
+    }
+
+    /*
+        poll() throws parse_cancelled_t once the parse is cancelled, past its deadline or over
+        its token budget. With none of them set it costs three tests.
+    */
+
+    void poll()
+    {
+        const std::size_t clock_interval(32);
+
+        if (options_m.cancel_m && options_m.cancel_m->cancelled())
+            throw parse_cancelled_t(parse_cancelled_t::cancelled_k);
+        if (options_m.token_budget_m && tokens_m > options_m.token_budget_m)
+            throw parse_cancelled_t(parse_cancelled_t::token_budget_k);
+        if (options_m.deadline_m == boost::chrono::steady_clock::time_point::max()) return;
+        if (++polls_m != clock_interval) return;
+
+        polls_m = 0;
+        if (boost::chrono::steady_clock::now() >= options_m.deadline_m)
+            throw parse_cancelled_t(parse_cancelled_t::deadline_k);
+    }
+
+    /*
+        start_metrics() and end_metrics() bracket a parse which ran to its end, counted in the
+        metrics with the bytes and tokens it took and the diagnostics it found. count_abandoned()
+        counts, by its kind, the exception being handled which ended a parse early.
+    */
+
+    void start_metrics()
+    {
+        metrics_start_m = boost::chrono::steady_clock::now();
+        metrics_tokens_m = tokens_m;
+    }
+
+    void end_metrics(std::size_t diagnostics)
+    {
+        boost::chrono::steady_clock::duration time(boost::chrono::steady_clock::now()
+            - metrics_start_m);
+
+        count_parse(next_offset() - base_m, tokens_m - metrics_tokens_m,
+            boost::chrono::duration_cast<boost::chrono::microseconds>(time).count());
+        count_error(syntax_error_k, diagnostics);
+    }
+
+    static void count_abandoned()
+    {
+        try {
+            throw;
+        } catch (const parse_cancelled_t& error) {
+            switch (error.reason()) {
+            case parse_cancelled_t::cancelled_k:    count_error(cancelled_error_k); break;
+            case parse_cancelled_t::deadline_k:     count_error(deadline_error_k); break;
+            default:                                count_error(token_budget_error_k); break;
+            }
+        } catch (...) {
+            count_error(internal_error_k);
+        }
+    }
+
+    //  Drops what a parse left part way through leaves behind.
+
+    void abandon()
+    {
+        declaration_m = 0;
+        diagnostics_m = 0;
+        callbacks_m = 0;
+        inserted_m = 0;
+        open_m.clear();
+        failed_m = false;
+    }
+
+    /*
+        With nothrow_m set an error is recorded by fail() in place of a throw. The first one
+        wins; until it is taken the token stream yields only eof, so every production fails
+        fast and returns to the nearest point able to report or recover from it.
+    */
+
+    void fail(const char* message, name_t expected, name_t found, const line_position_t& position)
+    {
+        failed_m = true;
+        failure_m.message_m = message;
+        failure_m.expected_m = expected;
+        failure_m.found_m = found;
+        failure_m.position_m = position;
+    }
+
+    stream_error_t take_failure()
+    {
+        EOP_ALLOCATION_PHASE(diagnostics_phase_k);
+
+        failed_m = false;
+        return make_error(failure_m);
+    }
+
+    lex_stream_t                    token_stream_m;
+    keyword_extension_lookup_proc_t keyword_proc_m;
+    snapshot_t                      prelude_m;
+    class_name_index_t              class_name_index_m;
+    declaration_t*                  declaration_m; // being recorded by parse(parse_result_t&)
+    std::size_t                     declaration_first_m; // offset of declaration_m
+    std::vector<diagnostic_t>*      diagnostics_m; // for errors recovered from
+    std::vector<name_t>*            inserted_m; // class names entered, for parse_available()
+    bool                            reached_end_m; // the parse has taken the eof of the input
+    std::size_t                     tokens_m; // taken, for parse_options_t::token_budget_m
+    std::size_t                     polls_m; // since the clock was last read
+    boost::chrono::steady_clock::time_point metrics_start_m; // of the parse, for the metrics
+    std::size_t                     metrics_tokens_m; // tokens_m at metrics_start_m
+    std::size_t                     base_m; // offset of the stream within the text
+    parse_options_t                 options_m;
+    std::size_t                     depth_m; // of nested statements and declarations
+    const declaration_callback_suite_t* callbacks_m; // during parse(callbacks)
+    std::vector<name_t>             open_m; // kinds of the scopes begun for callbacks_m
+    declaration_ptr_t               entered_m; // the last whose class names parse_body() entered
+    std::size_t                     entered_count_m; // declarations entered through entered_m
+    diagnostic_t                    located_m; // the position of the last body parsed
+    declaration_ptr_t               region_m; // the first declaration the last reparse() parsed
+    diagnostic_t                    region_located_m; // the position of the region it starts
+    bool                            failed_m;
+    failure_t                       failure_m;
+    stream_lex_token_t              eof_token_m;
+
+    // Reused by parse_expression() to save allocations; a deque keeps the arrays in place.
+
+    std::vector<expression_frame_t>     frames_m;
+    std::vector<expression_operator_t>  operators_m;
+    std::deque<array_t>                 operands_m;
+};
+
+/*************************************************************************************************/
+
+/*
+    nesting_guard_t counts the depth of a recursive production for the life of the guard. Past
+    parse_options_t::nesting_limit_m it fails the production rather than recursing further.
+*/
+
+class expression_parser::nesting_guard_t : public boost::noncopyable
+{
+ public:
+    explicit nesting_guard_t(expression_parser& parser) :
+        depth_m(parser.object->depth_m)
+    {
+        if (depth_m == parser.object->options_m.nesting_limit_m)
+            parser.throw_exception("nesting limit exceeded.");
+        ++depth_m;
+    }
+
+    ~nesting_guard_t() { --depth_m; }
+
+ private:
+    std::size_t& depth_m;
+};
+
+
+/*************************************************************************************************/
+
+expression_parser::snapshot_t expression_parser::implementation::snapshot() const
+{
+    boost::shared_ptr<state_t> result(new state_t);
 
-    void set_keyword_extension_lookup(const keyword_extension_lookup_proc_t& proc)
-        { token_stream_m.set_keyword_extension_lookup(proc); }
+    if (prelude_m) result->class_name_index_m = prelude_m->class_name_index_m;
+    result->class_name_index_m.insert(class_name_index_m.begin(), class_name_index_m.end());
+    result->keyword_proc_m = keyword_proc_m;
 
-    lex_stream_t token_stream_m;
+    return result;
+}
 
-    typedef closed_hash_map<name_t, bool> class_name_index_t;
-    class_name_index_t class_name_index_m;
-};
+/*************************************************************************************************/
 
 aggregate_name_t template_k     = { "template" };
 aggregate_name_t typename_k     = { "typename" };
@@ -84,6 +826,15 @@ aggregate_name_t enum_k         = { "enum" };
 aggregate_name_t case_k         = { "case" };
 aggregate_name_t switch_k       = { "switch" };
 aggregate_name_t goto_k         = { "goto" };
+aggregate_name_t function_k     = { "function" };
+aggregate_name_t compound_k     = { "compound" };
+aggregate_name_t simple_k       = { "simple" };
+
+//  Operators of the postfix form without a token of their own; see expression_operator_arity().
+
+aggregate_name_t unary_dereference_k    = { ".dereference" };
+aggregate_name_t unary_reference_k      = { ".reference" };
+aggregate_name_t instantiate_k          = { ".instantiate" };
 
 
 bool keyword_lookup(const name_t& x)
@@ -109,21 +860,76 @@ bool keyword_lookup(const name_t& x)
     return false;
 }
 
+/*************************************************************************************************/
+
+std::size_t expression_operator_arity(name_t name)
+{
+    if (name == unary_negate_k || name == not_k || name == const_k
+            || name == unary_dereference_k || name == unary_reference_k || name == array_k)
+        return 1;
+    if (binary_precedence(name) || name == index_k || name == instantiate_k) return 2;
+    return 0;
+}
+
+/*************************************************************************************************/
+
 expression_parser::expression_parser(std::istream& in, const line_position_t& position) :
         object(new implementation(in, position))
 {
     set_keyword_extension_lookup(&keyword_lookup);
 }
 
+expression_parser::expression_parser(std::istream& in, const line_position_t& position,
+        const snapshot_t& prelude) :
+        object(new implementation(in, position))
+{
+    set_keyword_extension_lookup(&keyword_lookup);
+    object->set_prelude(prelude);
+}
+
 expression_parser::~expression_parser()
     { delete object; }
 
+void expression_parser::reset(std::istream& in, const line_position_t& position,
+        bool keep_class_names)
+    { object->reset(in, position, keep_class_names); }
+
+void expression_parser::reset(std::istream& in, const line_position_t& position,
+        const snapshot_t& prelude)
+    { object->reset(in, position, prelude); }
+
+void expression_parser::reset(const token_file_t& tokens, const line_position_t& position,
+        const snapshot_t& prelude)
+    { object->reset(tokens, position, prelude); }
+
+expression_parser::snapshot_t expression_parser::snapshot() const
+    { return object->snapshot(); }
+
+void expression_parser::set_options(const parse_options_t& options)
+{
+    object->options_m = options;
+    object->token_stream_m.set_pipelined(options.pipeline_m);
+}
+
+const parse_options_t& expression_parser::options() const
+    { return object->options_m; }
+
 /*************************************************************************************************/
 
 /* REVISIT (sparent) : Should this be const? And is there a way to specify the class to throw? */
 
 void expression_parser::throw_exception(const char* errorString)
 {
+    if (object->options_m.nothrow_m) {
+        if (object->failed_m) return;
+
+        name_t found(get_token().first);
+
+        putback();
+        if (!object->failed_m) object->fail(errorString, name_t(), found, next_position());
+        return;
+    }
+
     std::string error = errorString;
 
     error << " Found \"" << get_token().first.c_str() << "\".";
@@ -137,7 +943,10 @@ void expression_parser::throw_exception(const char* errorString)
 /* REVISIT (sparent) : Should this be const? And is there a way to specify the class to throw? */
 
 void expression_parser::throw_exception(const name_t& found, const name_t& expected)
-    { throw_parser_exception(found, expected, next_position()); }
+{
+    if (!object->options_m.nothrow_m) throw_parser_exception(found, expected, next_position());
+    if (!object->failed_m) object->fail(0, found, expected, next_position());
+}
 
 /*************************************************************************************************/
 
@@ -158,10 +967,656 @@ void expression_parser::set_keyword_extension_lookup(const keyword_extension_loo
 //  translation_unit            = { declaration } eof.
 void expression_parser::parse()
 {
-    name_t name;
+    pipeline_guard_t    pipeline(object->token_stream_m);
+    name_t              name;
 
     while (is_declaration(name)) ;
     require_token(eof_k);
+    if (object->failed_m) throw object->take_failure();
+}
+
+/*************************************************************************************************/
+
+void expression_parser::parse(parse_result_t& result)
+{
+    pipeline_guard_t pipeline(object->token_stream_m);
+
+    result = parse_result_t();
+    object->diagnostics_m = &result.diagnostics_m;
+    object->start_metrics();
+
+    try {
+        result.offset_m = object->next_offset();
+
+        while (parse_declaration(result.declarations_m)) ;
+        require_token(eof_k);
+
+    } catch (const stream_error_t& error) {
+        object->declaration_m = 0;
+        result.diagnostics_m.push_back(make_diagnostic(error, object->base_m));
+    } catch (...) {
+        object->count_abandoned();
+        object->abandon();
+        throw;
+    }
+
+    if (object->failed_m)
+        result.diagnostics_m.push_back(make_diagnostic(object->take_failure(), object->base_m));
+
+    object->diagnostics_m = 0;
+    object->end_metrics(result.diagnostics_m.size());
+}
+
+/*************************************************************************************************/
+
+/*
+    The declarations are recorded by parse_declaration() as for parse(result) but dropped once
+    the callbacks have seen them; diagnostics are passed on after each declaration.
+*/
+
+void expression_parser::parse(const declaration_callback_suite_t& callbacks)
+{
+    std::vector<declaration_ptr_t>  declarations;
+    std::vector<diagnostic_t>       diagnostics;
+
+    std::size_t                     diagnostic_count(0);
+    pipeline_guard_t                pipeline(object->token_stream_m);
+
+    object->callbacks_m = &callbacks;
+    object->diagnostics_m = &diagnostics;
+    object->start_metrics();
+
+    try {
+        try {
+            while (parse_declaration(declarations)) {
+                declarations.clear();
+                object->release_scratch();
+                for (std::size_t n(0); n != diagnostics.size(); ++n) {
+                    if (callbacks.diagnostic_proc_m) callbacks.diagnostic_proc_m(diagnostics[n]);
+                }
+                diagnostic_count += diagnostics.size();
+                diagnostics.clear();
+            }
+            require_token(eof_k);
+
+        } catch (const stream_error_t& error) {
+            object->declaration_m = 0;
+            object->end(0);
+            diagnostics.push_back(make_diagnostic(error, object->base_m));
+        }
+
+        object->end(0);
+        if (object->failed_m)
+            diagnostics.push_back(make_diagnostic(object->take_failure(), object->base_m));
+
+        for (std::size_t n(0); n != diagnostics.size(); ++n) {
+            if (callbacks.diagnostic_proc_m) callbacks.diagnostic_proc_m(diagnostics[n]);
+        }
+        diagnostic_count += diagnostics.size();
+    } catch (...) {
+        object->count_abandoned();
+        object->abandon();
+        throw;
+    }
+
+    object->callbacks_m = 0;
+    object->diagnostics_m = 0;
+    object->end_metrics(diagnostic_count);
+}
+
+/*************************************************************************************************/
+
+/*
+    In recovery mode a declaration in error, or text which is not a declaration, is still
+    recorded - with whatever kind it got before the error - so the declarations continue to
+    tile the source.
+*/
+
+bool expression_parser::parse_declaration(std::vector<declaration_ptr_t>& declarations)
+{
+    boost::shared_ptr<declaration_t> declaration(new declaration_t);
+    std::size_t first = object->next_offset();
+    int         line(object->token_stream_m.next_position().line_number_m);
+    std::size_t diagnostic_count(object->diagnostics_m ? object->diagnostics_m->size() : 0);
+    std::size_t depth(object->depth());
+
+    object->declaration_m = declaration.get();
+    object->declaration_first_m = first;
+
+    try {
+        if (!is_declaration(false) && !object->failed_m) {
+            bool at_eof(get_token().first == eof_k);
+
+            putback();
+            if (!object->options_m.recover_m || at_eof) {
+                object->declaration_m = 0;
+                return false;
+            }
+            throw_exception("declaration required.");
+        }
+    } catch (const stream_error_t& error) {
+        object->declaration_m = 0;
+        object->end(depth);
+        if (!recover(error, true)) throw;
+        if (object->next_offset() == first) get_recovery_token(); // always make progress
+    }
+
+    object->declaration_m = 0;
+    object->end(depth);
+
+    if (object->failed_m) {
+        if (!object->recovering()) return false; // the caller reports it
+        recover(object->take_failure(), true);
+        if (object->next_offset() == first) get_recovery_token();
+    }
+    declaration->length_m = object->next_offset() - first;
+    declaration->lines_m = object->token_stream_m.next_position().line_number_m - line;
+    if (object->diagnostics_m)
+        declaration->diagnostic_count_m = object->diagnostics_m->size() - diagnostic_count;
+    declarations.push_back(declaration);
+    return true;
+}
+
+/*************************************************************************************************/
+
+/*
+    recover() records error and skips to the end of the declaration or statement in error: past
+    a ";" or a balanced "{}" block, or up to a "}" closing the enclosing block. At the top level
+    it also stops ahead of a declaration keyword. Returns false if recovery is off.
+*/
+
+bool expression_parser::recover(const stream_error_t& error, bool at_declaration)
+{
+    if (!object->recovering()) return false;
+
+    object->diagnostics_m->push_back(make_diagnostic(error, object->base_m));
+
+    std::size_t depth(0);
+
+    while (true) {
+        const stream_lex_token_t&   result(get_recovery_token());
+        name_t                      token(result.first);
+
+        if (token == keyword_k && depth == 0 && at_declaration) {
+            name_t keyword(result.second.cast<name_t>());
+            if (keyword == struct_k || keyword == enum_k || keyword == template_k) {
+                putback();
+                return true;
+            }
+        }
+
+        if (token == eof_k) { putback(); return true; }
+        if (token == semicolon_k && depth == 0) return true;
+        if (token == open_brace_k) ++depth;
+        if (token != close_brace_k) continue;
+
+        if (depth == 0 && !at_declaration) { putback(); return true; }
+        if (depth == 0 || --depth == 0) {
+            if (at_declaration && get_recovery_token().first != semicolon_k) putback();
+            return true;
+        }
+    }
+}
+
+/*************************************************************************************************/
+
+//  Gets a token while recovering; lexer errors are recorded and the text in error skipped.
+
+const stream_lex_token_t& expression_parser::get_recovery_token()
+{
+    object->poll();
+
+    while (true) {
+        try {
+            const stream_lex_token_t& result(get_token());
+
+            if (!object->failed_m) return result;
+            object->diagnostics_m->push_back(make_diagnostic(object->take_failure(),
+                object->base_m));
+        } catch (const stream_error_t& error) {
+            object->diagnostics_m->push_back(make_diagnostic(error, object->base_m));
+        }
+    }
+}
+
+/*************************************************************************************************/
+
+/*
+    Parses a statement; in recovery mode an error is recorded and the statement skipped. A
+    failure pending on entry belongs to an enclosing production and is left to it, as the
+    exception would have been.
+*/
+
+bool expression_parser::is_statement_or_recover()
+{
+    EOP_TRACE_SCOPE("is_statement_or_recover");
+    if (object->failed_m) return false;
+
+    std::size_t depth(object->depth());
+
+    try {
+        bool result(is_statement());
+
+        if (!object->failed_m || !object->recovering()) return result;
+        object->end(depth);
+        return recover(object->take_failure(), false);
+    } catch (const stream_error_t& error) {
+        object->end(depth);
+        if (!recover(error, false)) throw;
+        return true;
+    }
+}
+
+bool expression_parser::is_class_member_or_recover(name_t this_class)
+{
+    EOP_TRACE_SCOPE("is_class_member_or_recover");
+    if (object->failed_m) return false;
+
+    std::size_t depth(object->depth());
+
+    try {
+        bool result(is_class_member(this_class));
+
+        if (!object->failed_m || !object->recovering()) return result;
+        object->end(depth);
+        return recover(object->take_failure(), false);
+    } catch (const stream_error_t& error) {
+        object->end(depth);
+        if (!recover(error, false)) throw;
+        return true;
+    }
+}
+
+/*************************************************************************************************/
+
+/*
+    reparse() keeps the declarations which end before the first edit, parses from there, and
+    after each new declaration checks whether it ends where an undamaged declaration of the
+    previous result now starts. If so, and the parsed declarations entered the same class names
+    as the ones they replace, the remaining declarations parse exactly as before and are reused
+    together with their diagnostics.
+*/
+
+void expression_parser::reparse(const parse_result_t& previous, const std::string& text,
+        const std::vector<text_edit_t>& edits, const line_position_t& position,
+        parse_result_t& result)
+{
+    const std::vector<declaration_ptr_t>& old(previous.declarations_m);
+
+    if (edits.empty()) { result = previous; return; }
+
+    std::size_t     damage_first(edits.front().offset_m);
+    std::size_t     damage_last(0);
+    std::ptrdiff_t  delta(0);
+
+    for (std::size_t n(0); n != edits.size(); ++n) {
+        damage_first = (std::min)(damage_first, edits[n].offset_m);
+        damage_last = (std::max)(damage_last, edits[n].offset_m + edits[n].length_m);
+        delta += static_cast<std::ptrdiff_t>(edits[n].text_m.size())
+            - static_cast<std::ptrdiff_t>(edits[n].length_m);
+    }
+
+    std::vector<std::size_t> starts(1, previous.offset_m);
+
+    for (std::size_t n(0); n != old.size(); ++n) starts.push_back(starts.back() + old[n]->length_m);
+
+    std::size_t kept(0);
+
+    /*
+        Where a declaration ends can depend on the token after it - the first token of the next
+        declaration - so that declaration must be undamaged as well.
+    */
+
+    while (kept != old.size() && starts[kept + 1] < damage_first) ++kept;
+    if (kept != 0) --kept;
+
+    std::size_t         first(kept == 0 ? 0 : starts[kept]);
+    diagnostic_t        region;
+    line_position_t     region_position(position);
+    range_buffer_t      buffer(text.data() + first, text.data() + text.size());
+    std::istream        in(&buffer);
+    pipeline_guard_t    pipeline(object->token_stream_m);
+    bool                anchored(false);
+
+    /*
+        The region is located from where the last reparse() started, if that was a declaration
+        kept here: the text before it is unchanged, and its declaration is only ever in results
+        which followed that parse, as each reparse() moves the anchor.
+    */
+
+    for (std::size_t n(0); n <= kept && n != old.size(); ++n) {
+        if (old[n] != object->region_m) continue;
+        anchored = (n == 0 ? 0 : starts[n]) == object->region_located_m.offset_m;
+        break;
+    }
+
+    // The lexer counts line starts from the start of the region.
+    if (anchored) locate(text, object->region_located_m, first, region);
+    else locate(text, first, region);
+    region_position.line_number_m = region.line_number_m;
+    region_position.line_start_m = std::streamoff(region.line_start_m) - std::streamoff(first) + 1;
+
+    object->reset_region(in, region_position, first);
+    object->start_metrics();
+
+    for (std::size_t n(0); n != kept; ++n) {
+        const declaration_t& declaration(*old[n]);
+        for (std::size_t i(0); i != declaration.class_names_m.size(); ++i) {
+            object->insert_class_name(declaration.class_names_m[i].first,
+                declaration.class_names_m[i].second);
+        }
+    }
+
+    result = parse_result_t();
+    result.offset_m = previous.offset_m;
+    result.declarations_m.assign(old.begin(), old.begin() + kept);
+
+    std::size_t kept_diagnostics(0);
+
+    for (std::size_t n(0); n != kept; ++n) kept_diagnostics += old[n]->diagnostic_count_m;
+
+    result.diagnostics_m.assign(previous.diagnostics_m.begin(),
+        previous.diagnostics_m.begin() + kept_diagnostics);
+
+    object->diagnostics_m = &result.diagnostics_m;
+
+    std::size_t next(kept);
+
+    object->region_m.reset();
+
+    try {
+        if (kept == 0) result.offset_m = object->next_offset();
+
+        while (parse_declaration(result.declarations_m)) {
+            std::size_t last(object->next_offset());
+
+            while (next != old.size()
+                    && (starts[next] < damage_last
+                    || static_cast<std::ptrdiff_t>(starts[next]) + delta < static_cast<std::ptrdiff_t>(last))) {
+                ++next;
+            }
+
+            /*
+                A declaration at the end of the text is only the error of its eof token, which
+                may come from a comment or string started before, so it is never reused.
+            */
+            if (next == old.size() || last == text.size()
+                    || static_cast<std::ptrdiff_t>(starts[next]) + delta != static_cast<std::ptrdiff_t>(last)
+                    || !same_class_names(old.begin() + kept, old.begin() + next,
+                        result.declarations_m.begin() + kept, result.declarations_m.end())) {
+                continue;
+            }
+
+            std::size_t found(result.diagnostics_m.size() - kept_diagnostics);
+
+            result.declarations_m.insert(result.declarations_m.end(), old.begin() + next, old.end());
+
+            // Those past the last declaration stopped the previous parse.
+            std::size_t skipped(kept_diagnostics);
+
+            for (std::size_t n(kept); n != next; ++n) skipped += old[n]->diagnostic_count_m;
+
+            /*
+                The text from here on is the text from the old declaration on, moved by delta
+                bytes and by as many lines as the declarations parsed span more than those they
+                replace. The line the old one started on is known from the lines of those
+                declarations unless the edits reach before the first; then the diagnostics are
+                located by counting on from here.
+            */
+
+            const line_position_t&  join(object->token_stream_m.next_position());
+            diagnostic_t            located;
+            bool                    shifted(kept != 0 || previous.offset_m <= damage_first);
+            int                     old_line(region.line_number_m);
+
+            located.offset_m = last;
+            located.line_number_m = join.line_number_m;
+            located.line_start_m = static_cast<std::size_t>(std::streamoff(first)
+                + std::streamoff(join.line_start_m) - 1);
+
+            if (shifted && kept == 0) {
+                std::size_t ignored(0);
+                old_line += static_cast<int>(count_lines(text, 0, previous.offset_m, ignored));
+            }
+            for (std::size_t n(kept); n != next; ++n) old_line += static_cast<int>(old[n]->lines_m);
+
+            for (std::size_t n(skipped); n != previous.diagnostics_m.size(); ++n) {
+                diagnostic_t diagnostic(previous.diagnostics_m[n]);
+
+                if (!shifted) {
+                    locate(text, located, diagnostic.offset_m + delta, diagnostic);
+                    located = diagnostic;
+                } else {
+                    diagnostic.line_number_m += join.line_number_m - old_line;
+                    if (diagnostic.line_start_m >= starts[next]) diagnostic.line_start_m += delta;
+                    else diagnostic.line_start_m = located.line_start_m;
+                    diagnostic.offset_m += delta;
+                }
+                result.diagnostics_m.push_back(diagnostic);
+            }
+
+            object->region_m = result.declarations_m[kept];
+            object->region_located_m = region;
+            object->diagnostics_m = 0;
+            object->end_metrics(found);
+            return;
+        }
+        require_token(eof_k);
+
+    } catch (const stream_error_t& error) {
+        object->declaration_m = 0;
+        result.diagnostics_m.push_back(make_diagnostic(error, first));
+    } catch (...) {
+        object->count_abandoned();
+        object->abandon();
+        throw;
+    }
+
+    if (object->failed_m)
+        result.diagnostics_m.push_back(make_diagnostic(object->take_failure(), first));
+
+    if (kept != result.declarations_m.size()) {
+        object->region_m = result.declarations_m[kept];
+        object->region_located_m = region;
+    }
+    object->diagnostics_m = 0;
+    object->end_metrics(result.diagnostics_m.size() - kept_diagnostics);
+}
+
+/*************************************************************************************************/
+
+/*
+    A declaration is passed on once the token after it is a token of the text, as it ends where
+    that token starts. The one running into the end of the text is held back, its callbacks and
+    diagnostics with it. An error without recovery ends the parse unless the parse had reached
+    the end of the text, where the error may be no more than the text ending early.
+*/
+
+std::size_t expression_parser::parse_available(const char* first, const char* last,
+        diagnostic_t& start, const line_position_t& position, bool at_end,
+        const declaration_callback_suite_t& callbacks, bool& stopped)
+{
+    std::size_t         base(start.offset_m);
+    std::size_t         end(base + static_cast<std::size_t>(last - first));
+    line_position_t     region_position(position);
+    range_buffer_t      buffer(first, last);
+    std::istream        in(&buffer);
+    pipeline_guard_t    pipeline(object->token_stream_m);
+
+    // The lexer counts line starts from the start of the region.
+    region_position.line_number_m = start.line_number_m;
+    region_position.line_start_m = std::streamoff(start.line_start_m) - std::streamoff(base) + 1;
+
+    object->reset_region(in, region_position, base, true);
+
+    if (at_end) { parse(callbacks); stopped = true; return end - base; }
+
+    stopped = false;
+
+    callback_recorder_t             recorder(callbacks);
+    std::vector<declaration_ptr_t>  declarations;
+    std::vector<diagnostic_t>       diagnostics;
+    std::vector<name_t>             inserted;
+    std::size_t                     result(0);
+    line_position_t                 next(region_position); // of the text held back
+
+    object->callbacks_m = &recorder.suite();
+    object->diagnostics_m = &diagnostics;
+    object->inserted_m = &inserted;
+
+    try {
+        try {
+            bool held(false);
+
+            while (parse_declaration(declarations)) {
+                if (object->next_offset() == end) { held = true; break; }
+
+                recorder.replay();
+                report(callbacks, diagnostics);
+                declarations.clear();
+                inserted.clear();
+                object->release_scratch();
+                result = object->next_offset() - base;
+                next = object->token_stream_m.next_position();
+            }
+
+            if (!held && !object->failed_m) require_token(eof_k);
+            if (object->failed_m && !object->reached_end_m) throw object->take_failure();
+
+        } catch (const stream_error_t& error) {
+            object->declaration_m = 0;
+            if (object->reached_end_m) throw;
+
+            object->end(0);
+            recorder.replay();
+            diagnostics.push_back(make_diagnostic(error, base));
+            report(callbacks, diagnostics);
+            inserted.clear();
+            stopped = true;
+            result = end - base;
+        }
+    } catch (const stream_error_t&) {
+        // Held back with the declaration it is in.
+    } catch (...) {
+        for (std::size_t n(0); n != inserted.size(); ++n)
+            object->class_name_index_m.erase(inserted[n]);
+        object->abandon();
+        throw;
+    }
+
+    for (std::size_t n(0); n != inserted.size(); ++n) object->class_name_index_m.erase(inserted[n]);
+
+    object->open_m.clear();
+    object->callbacks_m = 0;
+    object->diagnostics_m = 0;
+    object->inserted_m = 0;
+
+    // Lines are counted as the lexer counts them, which is not within strings and comments.
+
+    std::streamoff line_start(std::streamoff(base) + std::streamoff(next.line_start_m) - 1);
+
+    start.offset_m = base + result;
+    start.line_number_m = next.line_number_m;
+    start.line_start_m = line_start > 0 ? static_cast<std::size_t>(line_start) : 0;
+
+    return result;
+}
+
+/*************************************************************************************************/
+
+void expression_parser::parse_body(const parse_result_t& result, std::size_t declaration,
+        std::size_t body, const std::string& text, const line_position_t& position,
+        std::vector<diagnostic_t>& diagnostics)
+{
+    parse_body(result, declaration, body, text, position, diagnostics, 0);
+}
+
+void expression_parser::parse_body(const parse_result_t& result, std::size_t declaration,
+        std::size_t body, const std::string& text, const line_position_t& position,
+        const declaration_callback_suite_t& callbacks)
+{
+    std::vector<diagnostic_t> diagnostics;
+
+    parse_body(result, declaration, body, text, position, diagnostics, &callbacks);
+
+    for (std::size_t n(0); n != diagnostics.size(); ++n) {
+        if (callbacks.diagnostic_proc_m) callbacks.diagnostic_proc_m(diagnostics[n]);
+    }
+}
+
+/*************************************************************************************************/
+
+/*
+    A body is parsed as a region of text, as reparse() parses from a declaration, entering the
+    class names the declarations before it and its own declaration entered. Bodies are usually
+    asked for in order, so the names entered for the last body are kept if they are a prefix of
+    those needed; the result is recognized by the last declaration entered. Statements enter no
+    class names, and reparse() only shares declarations which follow the same class names, so
+    the names entered are those the declarations before it entered.
+*/
+
+void expression_parser::parse_body(const parse_result_t& result, std::size_t declaration,
+        std::size_t body, const std::string& text, const line_position_t& position,
+        std::vector<diagnostic_t>& diagnostics, const declaration_callback_suite_t* callbacks)
+{
+    const std::vector<declaration_ptr_t>& declarations(result.declarations_m);
+
+    std::size_t first(result.offset_m);
+
+    for (std::size_t n(0); n != declaration; ++n) first += declarations[n]->length_m;
+
+    const std::pair<std::size_t, std::size_t>& span(declarations[declaration]->bodies_m[body]);
+
+    first += span.first;
+
+    std::size_t entered(object->entered_count_m);
+    bool        keep(object->entered_m && entered <= declaration + 1
+                    && declarations[entered - 1] == object->entered_m);
+
+    diagnostic_t        region;
+    line_position_t     region_position(position);
+    range_buffer_t      buffer(text.data() + first, text.data() + first + span.second);
+    std::istream        in(&buffer);
+    pipeline_guard_t    pipeline(object->token_stream_m);
+
+    if (keep && object->located_m.offset_m <= first) locate(text, object->located_m, first, region);
+    else locate(text, first, region);
+    region_position.line_number_m = region.line_number_m;
+    region_position.line_start_m = std::streamoff(region.line_start_m) - std::streamoff(first) + 1;
+
+    object->reset_region(in, region_position, first, keep);
+
+    for (std::size_t n(keep ? entered : 0); n <= declaration; ++n) {
+        const declaration_t& item(*declarations[n]);
+        for (std::size_t i(0); i != item.class_names_m.size(); ++i)
+            object->insert_class_name(item.class_names_m[i].first, item.class_names_m[i].second);
+    }
+
+    object->entered_m = declarations[declaration];
+    object->entered_count_m = declaration + 1;
+    object->located_m = region;
+
+    object->callbacks_m = callbacks;
+    object->diagnostics_m = &diagnostics;
+
+    try {
+        try {
+            if (!is_statement_compound()) throw_exception("statement_compound required.");
+        } catch (const stream_error_t& error) {
+            object->end(0);
+            diagnostics.push_back(make_diagnostic(error, first));
+        }
+
+        object->end(0);
+        if (object->failed_m)
+            diagnostics.push_back(make_diagnostic(object->take_failure(), first));
+    } catch (...) {
+        object->abandon();
+        throw;
+    }
+
+    object->callbacks_m = 0;
+    object->diagnostics_m = 0;
 }
 
 /*************************************************************************************************/
@@ -170,6 +1625,9 @@ void expression_parser::parse()
 //                                  | template_declaration.
 bool expression_parser::is_declaration(bool in_template)
 {
+    EOP_TRACE_SCOPE("is_declaration");
+    object->poll();
+
     return is_function_declaration(in_template) || is_class_declaration(in_template)
             || is_enum_declaration() || is_template_declaration();
 }
@@ -178,8 +1636,15 @@ bool expression_parser::is_declaration(bool in_template)
 //  template_declaration        = template_declarator declaration.
 bool expression_parser::is_template_declaration()
 {
-    if (!is_template_declarator()) return false;
+    EOP_TRACE_SCOPE("is_template_declaration");
+    std::size_t depth(object->depth());
+
+    if (!is_template_declarator()) return false; // begins the template
+
+    nesting_guard_t guard(*this);
+
     if (!is_declaration(true)) throw_exception("declaration required.");
+    object->end(depth);
     return true;
 }
 
@@ -187,7 +1652,9 @@ bool expression_parser::is_template_declaration()
 //  template_declarator         = "template" "<" [ function_parameter_list ] ">" [ template_constraint ].
 bool expression_parser::is_template_declarator()
 {
+    EOP_TRACE_SCOPE("is_template_declarator");
     if (!is_keyword(template_k)) return false;
+    object->begin(template_k, name_t());
     require_token(less_k);
     is_function_parameter_list();
     require_token(greater_k);
@@ -200,6 +1667,7 @@ bool expression_parser::is_template_declarator()
 //  constraint                  = "requires" "(" expression ")".
 bool expression_parser::is_template_constraint()
 {
+    EOP_TRACE_SCOPE("is_template_constraint");
     array_t tmp;
 
     if (!is_keyword(requires_k)) return false;
@@ -213,13 +1681,19 @@ bool expression_parser::is_template_constraint()
 //  class_declaration           = "struct" class_declarator [ class_body ] ";".
 bool expression_parser::is_class_declaration(bool in_template, bool in_class)
 {
+    EOP_TRACE_SCOPE("is_class_declaration");
     name_t name;
 
     if (!is_keyword(struct_k)) return false;
     if (!is_class_declarator(name)) throw_exception("class_name required.");
-    if (name && !in_class) object->class_name_index_m.insert(make_pair(name, in_template));
+    if (!in_class) object->set_declaration(struct_k, name, in_template);
+    if (name && !in_class) object->insert_class_name(name, in_template);
+
+    std::size_t depth(object->begin(struct_k, name));
+
     is_class_body(name);
     require_token(semicolon_k);
+    object->end(depth);
     return true;
 }
 
@@ -227,6 +1701,7 @@ bool expression_parser::is_class_declaration(bool in_template, bool in_class)
 //  class_declarator            = identifier | expression_template.
 bool expression_parser::is_class_declarator(name_t& name)
 {
+    EOP_TRACE_SCOPE("is_class_declarator");
     return is_identifier(name) || is_expression_template();
 }
 
@@ -234,13 +1709,12 @@ bool expression_parser::is_class_declarator(name_t& name)
 //  class_name                  = identifier.
 bool expression_parser::is_class_name(name_t& class_name, bool& is_template)
 {
+    EOP_TRACE_SCOPE("is_class_name");
     any_regular_t x;
     if (!is_token(identifier_k, x)) return false;
 
-    implementation::class_name_index_t::const_iterator f = object->class_name_index_m.find(x.cast<name_t>());
-    if (f == object->class_name_index_m.end()) { putback(); return false; }
-    class_name = f->first;
-    is_template = f->second;
+    if (!object->find_class_name(x.cast<name_t>(), is_template)) { putback(); return false; }
+    class_name = x.cast<name_t>();
     return true;
 }
 
@@ -248,8 +1722,9 @@ bool expression_parser::is_class_name(name_t& class_name, bool& is_template)
 //  class_body                  = "{" { class_member } "}".
 bool expression_parser::is_class_body(name_t this_class)
 {
+    EOP_TRACE_SCOPE("is_class_body");
     if (!is_token(open_brace_k)) return false;
-    while (is_class_member(this_class)) ;
+    while (is_class_member_or_recover(this_class)) ;
     require_token(close_brace_k);
     return true;
 }
@@ -259,6 +1734,7 @@ bool expression_parser::is_class_body(name_t this_class)
 //                                  | statement_typedef.
 bool expression_parser::is_class_member(name_t this_class)
 {
+    EOP_TRACE_SCOPE("is_class_member");
     return is_class_constructor(this_class) || is_class_destructor(this_class)
         || is_class_typed_member() || is_statement_typedef();
         /* || is_class_member_template(this_class) || is_class_declaration(false, true); */
@@ -268,13 +1744,21 @@ bool expression_parser::is_class_member(name_t this_class)
 //  enum_declaration            = "enum" identifier "{" identifier { "," identifier } "}" ";"
 bool expression_parser::is_enum_declaration()
 {
+    EOP_TRACE_SCOPE("is_enum_declaration");
+    name_t name;
+
     if (!is_keyword(enum_k)) return false;
-    require_identifier();
+    if (!is_identifier(name)) throw_exception("identifier required.");
+    object->set_declaration(enum_k, name, false);
+
+    std::size_t depth(object->begin(enum_k, name));
+
     require_token(open_brace_k);
     require_identifier();
     while (is_token(comma_k)) require_identifier();
     require_token(close_brace_k);
     require_token(semicolon_k);
+    object->end(depth);
     return true;
 }
 
@@ -282,6 +1766,7 @@ bool expression_parser::is_enum_declaration()
 //  class_typed_member          = expression ((identifier [ "[" expression "]" ] ";") | class_operator).
 bool expression_parser::is_class_typed_member()
 {
+    EOP_TRACE_SCOPE("is_class_typed_member");
     array_t tmp;
 
     if (!is_expression(tmp)) return false;
@@ -302,18 +1787,23 @@ bool expression_parser::is_class_typed_member()
 //                                  [ ":" class_initializer_list ] statement_compound.
 bool expression_parser::is_class_constructor(name_t this_class)
 {
+    EOP_TRACE_SCOPE("is_class_constructor");
     bool tmp;
     name_t class_name;
 
     if (!is_class_name(class_name, tmp)) return false;
     if (class_name != this_class) { putback(); return false; }
+
+    std::size_t depth(object->begin(function_k, class_name));
+
     require_token(open_parenthesis_k);
     is_function_parameter_list();
     require_token(close_parenthesis_k);
     if (is_token(colon_k)) {
         if (!is_class_initializer_list()) throw_exception("class_initializer_list required.");
     }
-    if (!is_statement_compound()) throw_exception("statement_compound required.");
+    if (!is_function_body()) throw_exception("statement_compound required.");
+    object->end(depth);
     return true;
 }
 
@@ -321,15 +1811,20 @@ bool expression_parser::is_class_constructor(name_t this_class)
 //  class_destructor            = "~" class_name "(" ")" statement_compound.
 bool expression_parser::is_class_destructor(name_t this_class)
 {
+    EOP_TRACE_SCOPE("is_class_destructor");
     bool tmp;
     name_t class_name;
 
     if (!is_token(destructor_k)) return false;
+
+    std::size_t depth(object->begin(function_k, name_t()));
+
     if (!is_class_name(class_name, tmp)) throw_exception("class_name required.");
     if (class_name != this_class) { putback(); throw_exception(class_name, this_class); }
     require_token(open_parenthesis_k);
     require_token(close_parenthesis_k);
-    if (!is_statement_compound()) throw_exception("statement_compound required.");
+    if (!is_function_body()) throw_exception("statement_compound required.");
+    object->end(depth);
     return true;
 }
 
@@ -337,19 +1832,26 @@ bool expression_parser::is_class_destructor(name_t this_class)
 //  class_operator              = "operator" ( class_assignment | class_index | class_apply ).
 bool expression_parser::is_class_operator()
 {
+    EOP_TRACE_SCOPE("is_class_operator");
     if (!is_keyword(operator_k)) return false;
-    return is_class_assignment() || is_class_index() || is_class_apply();
+
+    std::size_t depth(object->begin(function_k, name_t()));
+    bool        result(is_class_assignment() || is_class_index() || is_class_apply());
+
+    object->end(depth);
+    return result;
 }
 
 /*************************************************************************************************/
 //  class_assignment            = "=" "(" function_parameter ")" statement_compound.
 bool expression_parser::is_class_assignment()
 {
+    EOP_TRACE_SCOPE("is_class_assignment");
     if (!is_token(assign_k)) return false;
     require_token(open_parenthesis_k);
     if (!is_function_parameter()) throw_exception("function_parameter required.");
     require_token(close_parenthesis_k);
-    if (!is_statement_compound()) throw_exception("statement_compound required.");
+    if (!is_function_body()) throw_exception("statement_compound required.");
     return true;
 }
 
@@ -357,12 +1859,13 @@ bool expression_parser::is_class_assignment()
 //  class_index                 = "[" "]" "(" function_parameter ")" statement_compound.
 bool expression_parser::is_class_index()
 {
+    EOP_TRACE_SCOPE("is_class_index");
     if (!is_token(open_bracket_k)) return false;
     require_token(close_bracket_k);
     require_token(open_parenthesis_k);
     if (!is_function_parameter()) throw_exception("function_parameter required.");
     require_token(close_parenthesis_k);
-    if (!is_statement_compound()) throw_exception("statement_compound required.");
+    if (!is_function_body()) throw_exception("statement_compound required.");
     return true;
 }
 
@@ -370,12 +1873,13 @@ bool expression_parser::is_class_index()
 //  class_apply                 = "(" ")" "(" [ function_parameter_list ] ")" statement_compound.
 bool expression_parser::is_class_apply()
 {
+    EOP_TRACE_SCOPE("is_class_apply");
     if (!is_token(open_parenthesis_k)) return false;
     require_token(close_parenthesis_k);
     require_token(open_parenthesis_k);
     is_function_parameter_list();
     require_token(close_parenthesis_k);
-    if (!is_statement_compound()) throw_exception("statement_compound required.");
+    if (!is_function_body()) throw_exception("statement_compound required.");
     return true;
 }
 
@@ -383,6 +1887,7 @@ bool expression_parser::is_class_apply()
 //  class_initializer_list      = class_initializer { "," class_initializer }.
 bool expression_parser::is_class_initializer_list()
 {
+    EOP_TRACE_SCOPE("is_class_initializer_list");
     if (!is_class_initializer()) return false;
     while (is_token(comma_k)) {
         if (!is_class_initializer()) throw_exception("class_initializer required.");
@@ -394,6 +1899,7 @@ bool expression_parser::is_class_initializer_list()
 //  class_initializer           = identifer "(" [expression_list] ")".
 bool expression_parser::is_class_initializer()
 {
+    EOP_TRACE_SCOPE("is_class_initializer");
     array_t tmp;
 
     if (!is_identifier()) return false;
@@ -409,6 +1915,7 @@ bool expression_parser::is_class_initializer()
 //  class_friend                = "friend" function_declaration.
 bool expression_parser::is_class_friend()
 {
+    EOP_TRACE_SCOPE("is_class_friend");
     if (!is_keyword(friend_k)) return false;
     if (!is_function_declaration(false)) throw_exception("function_declaration required.");
     return true;
@@ -421,6 +1928,7 @@ bool expression_parser::is_class_friend()
 //  class_member_template       = template_declarator class_member.
 bool expression_parser::is_class_member_template(name_t this_class)
 {
+    EOP_TRACE_SCOPE("is_class_member_template");
     if (!is_template_declarator()) return false;
     if (!is_class_member(this_class)) throw_exception("class_member required.");
     return true;
@@ -433,18 +1941,25 @@ bool expression_parser::is_class_member_template(name_t this_class)
 //                                  (statement_compound | ";").
 bool expression_parser::is_function_declaration(bool in_template)
 {
+    EOP_TRACE_SCOPE("is_function_declaration");
     array_t tmp;
     name_t name;
 
-    if (!is_expression(tmp)) return false;
+    if (!parse_expression(expression_k, tmp)) return false;
     if (!is_function_name(name)) throw_exception("function_name required.");
-    if (name) object->class_name_index_m.insert(make_pair(name, in_template));
+    object->set_declaration(function_k, name, in_template);
+    if (name) object->insert_class_name(name, in_template);
+
+    std::size_t depth(object->begin(function_k, name));
+
+    object->expression(tmp);
     require_token(open_parenthesis_k);
     is_function_parameter_list();
     require_token(close_parenthesis_k);
-    if (!(is_statement_compound() || is_token(semicolon_k))) {
+    if (!(is_function_body() || is_token(semicolon_k))) {
         throw_exception("statement_compound or semicolon required.");
     }
+    object->end(depth);
     return true;
 }
 
@@ -452,6 +1967,7 @@ bool expression_parser::is_function_declaration(bool in_template)
 //  function_name               = identifier | class_name |function_operator.
 bool expression_parser::is_function_name(name_t& name)
 {
+    EOP_TRACE_SCOPE("is_function_name");
     name_t tmp;
     bool is_template;
 
@@ -462,6 +1978,7 @@ bool expression_parser::is_function_name(name_t& name)
 //  function_operator           = "operator" ("==" | "<" | "+" | "-" | "*" | "/" | "%").
 bool expression_parser::is_function_operator()
 {
+    EOP_TRACE_SCOPE("is_function_operator");
     if (!is_keyword(operator_k)) return false;
     if (!(is_token(equal_k) || is_token(less_k) || is_token(add_k) || is_token(subtract_k)
             || is_token(multiply_k) || is_token(divide_k) || is_token(modulus_k))) {
@@ -474,6 +1991,7 @@ bool expression_parser::is_function_operator()
 //  function_parameter_list     = function_parameter { "," function_parameter }.
 bool expression_parser::is_function_parameter_list()
 {
+    EOP_TRACE_SCOPE("is_function_parameter_list");
     if (!is_function_parameter()) return false;
     while (is_token(comma_k)) {
         if (!is_function_parameter()) throw_exception("function_parameter required.");
@@ -485,6 +2003,7 @@ bool expression_parser::is_function_parameter_list()
 //  function_parameter          = expression [ identifier ].
 bool expression_parser::is_function_parameter()
 {
+    EOP_TRACE_SCOPE("is_function_parameter");
     array_t tmp;
 
     if (!is_expression(tmp)) return false;
@@ -492,6 +2011,42 @@ bool expression_parser::is_function_parameter()
     return true;
 }
 
+/*************************************************************************************************/
+
+/*
+    A function body is a statement_compound. Under skip_bodies_m only its braces are matched,
+    which is enough to find its end, and its span is recorded for parse_body().
+*/
+
+bool expression_parser::is_function_body()
+{
+    EOP_TRACE_SCOPE("is_function_body");
+    if (!object->options_m.skip_bodies_m) return is_statement_compound();
+
+    std::size_t first(object->next_offset());
+
+    if (!is_token(open_brace_k)) return false;
+
+    std::size_t depth(1);
+    std::size_t last(first);
+    bool        recovering(object->recovering());
+
+    // Recovering, a lexer error is recorded as the parse of the body would and skipped.
+
+    while (depth != 0) {
+        last = object->next_offset();
+
+        name_t token((recovering ? get_recovery_token() : get_token()).first);
+
+        if (token == open_brace_k) { ++depth; object->poll(); }
+        else if (token == close_brace_k) { --depth; object->poll(); }
+        else if (token == eof_k) { putback(); require_token(close_brace_k); return true; }
+    }
+
+    object->add_body(first, last + 1);
+    return true;
+}
+
 /*************************************************************************************************/
 //  statement                   = [identifier ":"] statement_expression | statement_return
 //                                  | statement_typedef | statement_conditional | statement_while
@@ -499,8 +2054,11 @@ bool expression_parser::is_function_parameter()
 //                                  | statement_goto.
 bool expression_parser::is_statement()
 {
+    EOP_TRACE_SCOPE("is_statement");
     bool has_label = false;
 
+    object->poll();
+
     if (is_identifier()) {
         if (is_token(colon_k)) has_label = true;
         else putback(); // LL(2)
@@ -523,11 +2081,17 @@ bool expression_parser::is_statement()
 //  statement_expression        = expression [ statement_assignment |  statement_constructor] ";".
 bool expression_parser::is_statement_expression()
 {
+    EOP_TRACE_SCOPE("is_statement_expression");
     array_t tmp;
 
-    if (!is_expression(tmp)) return false;
+    if (!parse_expression(expression_k, tmp)) return false;
+
+    std::size_t depth(object->begin(simple_k, name_t()));
+
+    object->expression(tmp);
     is_statement_assignment() || is_statement_constructor();
     require_token(semicolon_k);
+    object->end(depth);
     return true;
 }
 
@@ -535,6 +2099,7 @@ bool expression_parser::is_statement_expression()
 // statement_assignment        = "=" expression.
 bool expression_parser::is_statement_assignment()
 {
+    EOP_TRACE_SCOPE("is_statement_assignment");
     array_t tmp;
 
     if (!is_token(assign_k)) return false;
@@ -547,6 +2112,7 @@ bool expression_parser::is_statement_assignment()
 //                                              | ("[" expression "]") ].
 bool expression_parser::is_statement_constructor()
 {
+    EOP_TRACE_SCOPE("is_statement_constructor");
     array_t tmp;
 
     if (!is_identifier()) return false;
@@ -565,11 +2131,16 @@ bool expression_parser::is_statement_constructor()
 //  statement_return            = "return" [ expression ] ";".
 bool expression_parser::is_statement_return()
 {
+    EOP_TRACE_SCOPE("is_statement_return");
     array_t tmp;
 
     if (!is_keyword(return_k)) return false;
+
+    std::size_t depth(object->begin(return_k, name_t()));
+
     is_expression(tmp);
     require_token(semicolon_k);
+    object->end(depth);
     return true;
 }
 
@@ -577,12 +2148,17 @@ bool expression_parser::is_statement_return()
 //  statement_typedef           = "typedef" expression identifier ";".
 bool expression_parser::is_statement_typedef()
 {
+    EOP_TRACE_SCOPE("is_statement_typedef");
     array_t tmp;
 
     if (!is_keyword(typedef_k)) return false;
+
+    std::size_t depth(object->begin(typedef_k, name_t()));
+
     require_expression(tmp);
     require_identifier();
     require_token(semicolon_k);
+    object->end(depth);
     return true;
 }
 
@@ -590,9 +2166,14 @@ bool expression_parser::is_statement_typedef()
 //  statement_conditional       = "if" "(" expression ")" statement [ "else" statement ].
 bool expression_parser::is_statement_conditional()
 {
+    EOP_TRACE_SCOPE("is_statement_conditional");
     array_t tmp;
 
     if (!is_keyword(if_k)) return false;
+
+    nesting_guard_t guard(*this);
+    std::size_t     depth(object->begin(if_k, name_t()));
+
     require_token(open_parenthesis_k);
     require_expression(tmp);
     require_token(close_parenthesis_k);
@@ -600,6 +2181,7 @@ bool expression_parser::is_statement_conditional()
     if (is_keyword(else_k)) {
         if (!is_statement()) throw_exception("statement required.");
     }
+    object->end(depth);
     return true;
 }
 
@@ -607,13 +2189,19 @@ bool expression_parser::is_statement_conditional()
 //  statement_while             = "while" "(" expression ")" statement.
 bool expression_parser::is_statement_while()
 {
+    EOP_TRACE_SCOPE("is_statement_while");
     array_t tmp;
 
     if (!is_keyword(while_k)) return false;
+
+    nesting_guard_t guard(*this);
+    std::size_t     depth(object->begin(while_k, name_t()));
+
     require_token(open_parenthesis_k);
     require_expression(tmp);
     require_token(close_parenthesis_k);
     if (!is_statement()) throw_exception("statement required.");
+    object->end(depth);
     return true;
 }
 
@@ -621,15 +2209,21 @@ bool expression_parser::is_statement_while()
 //  statement_do                = "do" statement "while" "(" expression ")" ";".
 bool expression_parser::is_statement_do()
 {
+    EOP_TRACE_SCOPE("is_statement_do");
     array_t tmp;
 
     if (!is_keyword(do_k)) return false;
+
+    nesting_guard_t guard(*this);
+    std::size_t     depth(object->begin(do_k, name_t()));
+
     if (!is_statement()) throw_exception("statement required.");
     require_keyword(while_k);
     require_token(open_parenthesis_k);
     require_expression(tmp);
     require_token(close_parenthesis_k);
     require_token(semicolon_k);
+    object->end(depth);
     return true;
 }
 
@@ -637,9 +2231,15 @@ bool expression_parser::is_statement_do()
 //  statement_compound          = "{" { statement } "}".
 bool expression_parser::is_statement_compound()
 {
+    EOP_TRACE_SCOPE("is_statement_compound");
     if (!is_token(open_brace_k)) return false;
-    while (is_statement()) ;
+
+    nesting_guard_t guard(*this);
+    std::size_t     depth(object->begin(compound_k, name_t()));
+
+    while (is_statement_or_recover()) ;
     require_token(close_brace_k);
+    object->end(depth);
     return true;
 }
 
@@ -647,15 +2247,21 @@ bool expression_parser::is_statement_compound()
 //  statement_switch            = "switch" "(" expression ")" "{" { statement_case } "}".
 bool expression_parser::is_statement_switch()
 {
+    EOP_TRACE_SCOPE("is_statement_switch");
     array_t tmp;
 
     if (!is_keyword(switch_k)) return false;
+
+    nesting_guard_t guard(*this);
+    std::size_t     depth(object->begin(switch_k, name_t()));
+
     require_token(open_parenthesis_k);
     require_expression(tmp);
     require_token(close_parenthesis_k);
     require_token(open_brace_k);
     while (is_statement_case());
     require_token(close_brace_k);
+    object->end(depth);
     return true;
 }
 
@@ -663,12 +2269,17 @@ bool expression_parser::is_statement_switch()
 //  statement_case              = "case" expression ":" { statement }.
 bool expression_parser::is_statement_case()
 {
+    EOP_TRACE_SCOPE("is_statement_case");
     array_t tmp;
 
     if (!is_keyword(case_k)) return false;
+
+    std::size_t depth(object->begin(case_k, name_t()));
+
     require_expression(tmp);
     require_token(colon_k);
-    while (is_statement()) ;
+    while (is_statement_or_recover()) ;
+    object->end(depth);
     return true;
 }
 
@@ -676,9 +2287,14 @@ bool expression_parser::is_statement_case()
 //  statement_goto              = "goto" identifier ";"
 bool expression_parser::is_statement_goto()
 {
+    EOP_TRACE_SCOPE("is_statement_goto");
     if (!is_keyword(goto_k)) return false;
+
+    std::size_t depth(object->begin(goto_k, name_t()));
+
     require_identifier();
     require_token(semicolon_k);
+    object->end(depth);
     return true;
 }
 
@@ -686,16 +2302,11 @@ bool expression_parser::is_statement_goto()
 //  expression                  = expression_and { "||" expression_and }.
 bool expression_parser::is_expression(array_t& expression_stack)
 {
-    if (!is_expression_and(expression_stack)) return false;
-    
-    while (is_token(or_k))
-        {
-        array_t operand2;
-        if (!is_expression_and(operand2)) throw_exception("expression_and required.");
-        push_back(expression_stack, operand2);
-        expression_stack.push_back(any_regular_t(or_k));
-        }
-    
+    EOP_TRACE_SCOPE("is_expression");
+    std::size_t first(expression_stack.size());
+
+    if (!parse_expression(expression_k, expression_stack)) return false;
+    object->expression(expression_stack, first);
     return true;
 }
 
@@ -708,225 +2319,262 @@ void expression_parser::require_expression(array_t& expression_stack)
 }
 
 /*************************************************************************************************/
+//  expression_template         = class_name [ "<" expression_additive_list ">" ].
+bool expression_parser::is_expression_template()
+{
+    EOP_TRACE_SCOPE("is_expression_template");
+    bool    is_template;
+    name_t  class_name;
+    array_t tmp;
 
-//  expression_and              = expression_equality { "&&" expression_equality }.
-bool expression_parser::is_expression_and(array_t& expression_stack)
-    {
-    if (!is_expression_equality(expression_stack)) return false;
-    
-    while (is_token(and_k))
-        {
-        array_t operand2;
-        if (!is_expression_equality(operand2)) throw_exception("expression_bit_and required.");
-        push_back(expression_stack, operand2);
-        expression_stack.push_back(any_regular_t(and_k));
-        }
-    
+    if (!is_class_name(class_name, is_template)) return false;
+    if (is_template && is_token(less_k)) parse_expression(expression_template_k, tmp);
     return true;
-    }
+}
 
 /*************************************************************************************************/
+//  expression_list = expression { "," expression }.
+bool expression_parser::is_expression_list(array_t& expression_stack)
+{
+    EOP_TRACE_SCOPE("is_expression_list");
+    std::size_t first(expression_stack.size());
 
-//  expression_equality = expression_relational { ("==" | "!=") expression_relational }.
-bool expression_parser::is_expression_equality(array_t& expression_stack)
-    {
-    if (!is_expression_relational(expression_stack)) return false;
-    
-    bool is_equal = false;
-    while ((is_equal = is_token(equal_k)) || is_token(not_equal_k))
-        {
-        if (!is_expression_relational(expression_stack)) throw_exception("Primary required.");
-        expression_stack.push_back(is_equal ? any_regular_t(equal_k) : any_regular_t(not_equal_k));
-        }
-    
+    if (!parse_expression(expression_list_k, expression_stack)) return false;
+    object->expression(expression_stack, first);
     return true;
-    }
+}
 
 /*************************************************************************************************/
 
-//  expression_relational       = expression_additive { ("<" | ">" | "<=" | ">=") expression_additive }.
-bool expression_parser::is_expression_relational(array_t& expression_stack)
+/*
+    parse_expression() parses an expression, an expression_list or, following its "<", the
+    arguments of an expression_template into result. It alternates between reading an operand
+    (with any unary operators before it), the postfix operators after it, and the binary
+    operator or closing token after that. The result and the diagnostics are those of the
+    recursive descent the grammar describes.
+*/
+
+bool expression_parser::parse_expression(expression_kind_t kind, array_t& result)
 {
-    if (!is_expression_additive(expression_stack)) return false;
-    
-    name_t operator_l;
-    
-    while (is_relational_operator(operator_l))
-        {
-        if (!is_expression_additive(expression_stack)) throw_exception("expression_shift required.");
-        expression_stack.push_back(any_regular_t(operator_l));
-        }
-    
-    return true;
-}
-/*************************************************************************************************/
-//  expression_additive = expression_multiplicative { additive_operator expression_multiplicative }.
-bool expression_parser::is_expression_additive(array_t& expression_stack)
-    {
-    if (!is_expression_multiplicative(expression_stack)) return false;
-    
-    name_t operator_l;
-    
-    while (is_additive_operator(operator_l))
-        {
-        if (!is_expression_multiplicative(expression_stack)) throw_exception("Primary required.");
-        expression_stack.push_back(any_regular_t(operator_l));
+    EOP_TRACE_SCOPE("parse_expression");
+    EOP_ALLOCATION_PHASE(expression_phase_k);
 
-        }
-    
-    return true;
-    }
+    std::vector<expression_frame_t>&    frames(object->frames_m);
+    std::vector<expression_operator_t>& operators(object->operators_m);
+    std::deque<array_t>&                operands(object->operands_m);
 
-/*************************************************************************************************/
-//  expression_multiplicative = expression_unary { ("*" | "/" | "%") expression_unary }.
-bool expression_parser::is_expression_multiplicative(array_t& expression_stack)
-    {
-    if (!is_expression_unary(expression_stack)) return false;
-    
-    name_t operator_l;
-    
-    while (is_multiplicative_operator(operator_l))
-        {
-        if (!is_expression_unary(expression_stack)) throw_exception("Primary required.");
-        expression_stack.push_back(any_regular_t(operator_l));
+    frames.clear();
+    operators.clear();
+    operands.clear();
 
-        }
-    
-    return true;
-    }
+    frames.push_back(expression_frame_t(kind == expression_list_k ? list_frame_k
+            : kind == expression_template_k ? template_frame_k : expression_frame_k, result, 0));
 
-/*************************************************************************************************/
-//  expression_unary = expression_postfix | ( ("+" | "-" | "!" | "*" | "&" | "const") expression_unary).
-bool expression_parser::is_expression_unary(array_t& expression_stack)
-    {
-    if (is_expression_postfix(expression_stack)) return true;
-    
-    name_t operator_l;
-    
-    if (is_unary_operator(operator_l))
-        {
-        if (!is_expression_unary(expression_stack)) throw_exception("Unary expression required.");
-        if (operator_l != add_k)
-            {
-            expression_stack.push_back(any_regular_t(operator_l));
+    enum { operand_state, postfix_state, operator_state } state(operand_state);
 
-            }
-        return true;
+    int     precedence(0); // of the binary operator before the operand; zero for none
+    bool    unary(false); // a unary operator is before the operand
+
+    const std::size_t limit(object->options_m.expression_nesting_limit_m); // of the frames
+
+    while (!object->failed_m) {
+        if (limit && frames.size() > limit) {
+            throw_exception("nesting limit exceeded.");
+            break;
         }
-        
-    return false;
-    }
-    
-/*************************************************************************************************/
-//  expression_postfix          = expression_primary { ("[" expression "]") | ("." identifier) | ("(" [expression_list] ")") | "&" }.
-bool expression_parser::is_expression_postfix(array_t& expression_stack)
-    {
-    if (!is_expression_primary(expression_stack)) return false;
-    
-    while (true)
-        {
-        if (is_token(open_bracket_k))
-            {
-            require_expression(expression_stack);
-            require_token(close_bracket_k);
+
+        expression_frame_t& frame(frames.back());
+        array_t&            output(*frame.output_m);
+
+        if (state == operand_state) {
+            any_regular_t   value; // empty result used if is_keyword(empty_k)
+            name_t          name;
+            bool            is_template;
+
+            if (is_token(number_k, value)
+                    || is_boolean(value)
+                    || is_token(string_k, value)
+                    || is_identifier(value)) {
+                output.push_back(move(value));
+                state = postfix_state;
+            } else if (is_keyword(typename_k)) {
+                output.push_back(any_regular_t(typename_k));
+                state = postfix_state;
+            } else if (is_class_name(name, is_template)) {
+                output.push_back(any_regular_t(name));
+                if (is_template && is_token(less_k)) {
+                    frames.push_back(expression_frame_t(template_frame_k, output,
+                        operators.size()));
+                    precedence = 0;
+                    unary = false;
+                } else {
+                    state = postfix_state;
+                }
+            } else if (is_token(open_parenthesis_k)) {
+                frames.push_back(expression_frame_t(parenthesis_frame_k, output, operators.size()));
+                precedence = 0;
+                unary = false;
+            } else if (is_unary_operator(name)) {
+                operators.push_back(expression_operator_t(name, 0));
+                unary = true;
+            } else {
+                const char* message("expression required.");
+
+                if (unary) message = "Unary expression required.";
+                else if (precedence == relational_precedence_k) message = "expression_shift required.";
+                else if (precedence) message = "Primary required.";
+                else switch (frame.kind_m) {
+                case expression_frame_k:
+                    return false;
+                case list_frame_k:
+                    if (!frame.count_m) return false;
+                    break;
+                case template_frame_k:
+                    message = frame.count_m ? "expression_additive required."
+                        : "expression_additive_list required.";
+                    break;
+                case call_frame_k:
+                    if (frame.count_m) break;
+                    require_token(close_parenthesis_k);
+                    output.push_back(any_regular_t(std::size_t(0)));
+                    output.push_back(any_regular_t(array_k));
+                    output.push_back(any_regular_t(index_k));
+                    frames.pop_back();
+                    state = postfix_state;
+                    continue;
+                case and_frame_k:
+                    message = "expression_bit_and required.";
+                    break;
+                case or_frame_k:
+                    message = "expression_and required.";
+                    break;
+                default:
+                    break;
+                }
+
+                throw_exception(message);
+                break;
             }
-        else if (is_token(dot_k))
-            {
-            any_regular_t result;
-            require_identifier(result);
-            expression_stack.push_back(result);
+            continue;
+        }
+
+        if (state == postfix_state) {
+            if (is_token(open_bracket_k)) {
+                frames.push_back(expression_frame_t(index_frame_k, output, operators.size()));
+                state = operand_state;
+                precedence = 0;
+                unary = false;
+            } else if (is_token(dot_k)) {
+                any_regular_t value;
+                require_identifier(value);
+                output.push_back(value);
+                output.push_back(any_regular_t(index_k));
+            } else if (is_token(open_parenthesis_k)) {
+                frames.push_back(expression_frame_t(call_frame_k, output, operators.size()));
+                state = operand_state;
+                precedence = 0;
+                unary = false;
+            } else if (is_token(reference_k)) {
+                output.push_back(any_regular_t(unary_reference_k));
+            } else {
+                while (operators.size() != frame.operators_m && !operators.back().precedence_m) {
+                    if (operators.back().name_m != add_k)
+                        output.push_back(any_regular_t(operators.back().name_m));
+                    operators.pop_back();
+                }
+                state = operator_state;
             }
-        else if (is_token(open_parenthesis_k))
-            {
-            is_expression_list(expression_stack);
-            require_token(close_parenthesis_k);
+            continue;
+        }
+
+        name_t  name(get_token().first);
+        int     level(binary_precedence(name));
+
+        if (level && level >= minimum_precedence(frame.kind_m)) {
+            while (operators.size() != frame.operators_m && operators.back().precedence_m >= level) {
+                output.push_back(any_regular_t(operators.back().name_m));
+                operators.pop_back();
             }
-        else if (is_token(reference_k)) { }
-        else break;
-        
-        expression_stack.push_back(any_regular_t(index_k));
 
+            if (level == or_precedence_k || level == and_precedence_k) {
+                operands.push_back(array_t());
+                frames.push_back(expression_frame_t(level == or_precedence_k ? or_frame_k
+                        : and_frame_k, operands.back(), operators.size()));
+                precedence = 0;
+            } else {
+                operators.push_back(expression_operator_t(name, level));
+                precedence = level;
+            }
+            state = operand_state;
+            unary = false;
+            continue;
         }
-    
-    return true;
-    }
-    
-/*************************************************************************************************/
-//  expression_primary          = number | "true" | "false" | string | identifier | "typename"
-//                                  | expression_template | ("(" expression ")").
 
-bool expression_parser::is_expression_primary(array_t& expression_stack)
-    {
-    any_regular_t result; // empty result used if is_keyword(empty_k)
-    
-    if (is_token(number_k, result)
-            || is_boolean(result)
-            || is_token(string_k, result)
-            || is_identifier(result))
-        {
-        expression_stack.push_back(move(result));
-        return true;
+        // The token ends the current item of the frame.
+
+        while (operators.size() != frame.operators_m) {
+            output.push_back(any_regular_t(operators.back().name_m));
+            operators.pop_back();
         }
-    if (is_keyword(typename_k)) return true;
-    if (is_expression_template()) return true;
-    if (is_token(open_parenthesis_k)) {
-        require_expression(expression_stack);
-        require_token(close_parenthesis_k);
-        return true;
-    }
-    
-    return false;
-    }
-    
-/*************************************************************************************************/
-//  expression_template         = class_name [ "<" expression_list ">" ].
-bool expression_parser::is_expression_template()
-{
-    bool    is_template;
-    name_t  class_name;
 
-    if (!is_class_name(class_name, is_template)) return false;
-    if (is_template) {
-        if (!is_token(less_k)) return true;
-        if (!is_expression_additive_list()) throw_exception("expression_additive_list required.");
-        require_token(greater_k);
-    }
-    return true;
-}
+        if (name == comma_k && (frame.kind_m == list_frame_k || frame.kind_m == template_frame_k
+                || frame.kind_m == call_frame_k)) {
+            ++frame.count_m;
+            state = operand_state;
+            precedence = 0;
+            unary = false;
+            continue;
+        }
 
-/*************************************************************************************************/
-//  expression_additive_list    = expression_additive { "," expression_additive }.
-bool expression_parser::is_expression_additive_list()
-{
-    array_t tmp;
+        putback();
+        state = postfix_state;
 
-    if (!is_expression_additive(tmp)) return false;
-        
-    while (is_token(comma_k))
-    {
-        if (!is_expression_additive(tmp)) throw_exception("expression_additive required.");
+        switch (frame.kind_m) {
+        case expression_frame_k:
+            return true;
+        case list_frame_k:
+            output.push_back(any_regular_t(frame.count_m + 1));
+            output.push_back(any_regular_t(array_k));
+            return true;
+        case template_frame_k:
+            require_token(greater_k);
+            if (frames.size() == 1) return true;
+            output.push_back(any_regular_t(frame.count_m + 1));
+            output.push_back(any_regular_t(array_k));
+            output.push_back(any_regular_t(instantiate_k));
+            frames.pop_back();
+            break;
+        case parenthesis_frame_k:
+            require_token(close_parenthesis_k);
+            frames.pop_back();
+            break;
+        case index_frame_k:
+            require_token(close_bracket_k);
+            output.push_back(any_regular_t(index_k));
+            frames.pop_back();
+            break;
+        case call_frame_k:
+            require_token(close_parenthesis_k);
+            output.push_back(any_regular_t(frame.count_m + 1));
+            output.push_back(any_regular_t(array_k));
+            output.push_back(any_regular_t(index_k));
+            frames.pop_back();
+            break;
+        case and_frame_k:
+        case or_frame_k: {
+            name_t operation(frame.kind_m == and_frame_k ? and_k : or_k);
+
+            frames.pop_back();
+            push_back(*frames.back().output_m, output);
+            frames.back().output_m->push_back(any_regular_t(operation));
+            operands.pop_back();
+            state = operator_state;
+            break;
+        }
+        }
     }
-    return true;
-}
 
-/*************************************************************************************************/
-//  expression_list = expression { "," expression }.
-bool expression_parser::is_expression_list(array_t& expression_stack)
-{
-    if (!is_expression(expression_stack)) return false;
-    
-    std::size_t count = 1;
-    
-    while (is_token(comma_k))
-    {
-        require_expression(expression_stack);
-        ++count;
-    }
-    
-    expression_stack.push_back(any_regular_t(count));
-    expression_stack.push_back(any_regular_t(array_k));
-    
-    return true;
+    return false; // failed under parse_options_t::nothrow_m
 }
 
 /*************************************************************************************************/
@@ -941,23 +2589,6 @@ bool expression_parser::is_boolean(any_regular_t& result)
     return false;
     }
 
-/*************************************************************************************************/
-
-//  relational_operator = "<" | ">" | "<=" | ">=".
-bool expression_parser::is_relational_operator(name_t& name_result)
-    {
-    const stream_lex_token_t& result (get_token());
-    
-    name_t name = result.first;
-    if (name == less_k || name == greater_k || name == less_equal_k || name == greater_equal_k)
-        {
-        name_result = name;
-        return true;
-        }
-    putback();
-    return false;
-    }
-
 /*************************************************************************************************/
 bool expression_parser::is_operator_shift(name_t& name_result)
 {
@@ -974,40 +2605,6 @@ bool expression_parser::is_operator_shift(name_t& name_result)
 }
 
 /*************************************************************************************************/
-
-//  additive_operator = "+" | "-".
-bool expression_parser::is_additive_operator(name_t& name_result)
-    {
-    const stream_lex_token_t& result (get_token());
-    
-    name_t name = result.first;
-    if (name == add_k || name == subtract_k)
-        {
-        name_result = name;
-        return true;
-        }
-    putback();
-    return false;
-    }
-
-/*************************************************************************************************/
-
-//  multiplicative_operator = "*" | "/" | "%".
-bool expression_parser::is_multiplicative_operator(name_t& name_result)
-    {
-    const stream_lex_token_t& result (get_token());
-    
-    name_t name = result.first;
-    if (name == multiply_k || name == divide_k || name == modulus_k)
-        {
-        name_result = name;
-        return true;
-        }
-    putback();
-    return false;
-    }
-    
-/*************************************************************************************************/
     
 //  unary_operator = "+" | "-" | "!" | "*" | "&" | "const".
 bool expression_parser::is_unary_operator(name_t& name_result)
@@ -1020,11 +2617,16 @@ bool expression_parser::is_unary_operator(name_t& name_result)
         name_result = unary_negate_k;
         return true;
         }
-    else if (name == not_k || name == add_k || name == multiply_k /* || name == reference_k */)
+    else if (name == not_k || name == add_k /* || name == reference_k */)
         {
         name_result = name;
         return true;
         }
+    else if (name == multiply_k)
+        {
+        name_result = unary_dereference_k;
+        return true;
+        }
     else if (name == keyword_k && result.second.cast<name_t>() == const_k) {
         name_result = const_k;
         return true;
@@ -1045,7 +2647,7 @@ bool expression_parser::is_identifier(any_regular_t& result)
     
     if (token.first == identifier_k)
     {
-        if (!object->class_name_index_m.count(token.second.cast<adobe::name_t>())) {
+        if (!object->is_class_name(token.second.cast<adobe::name_t>())) {
             result = token.second;
             return true;
         }
@@ -1067,7 +2669,7 @@ bool expression_parser::is_identifier(name_t& name_result)
     if (result.first == identifier_k)
     {
         name_result = result.second.cast<adobe::name_t>();
-        if (!object->class_name_index_m.count(name_result)) return true;
+        if (!object->is_class_name(name_result)) return true;
     }
     
     putback();
@@ -1155,13 +2757,35 @@ bool expression_parser::is_keyword(name_t keyword_name)
 
 const stream_lex_token_t& expression_parser::get_token()
 {
-    return object->token_stream_m.get();
+    if (object->failed_m) return object->eof_token_m;
+
+    const stream_lex_token_t& result(object->token_stream_m.get());
+
+    ++object->tokens_m;
+
+    if (!object->token_stream_m.error()) {
+        if (result.first == eof_k) object->reached_end_m = true;
+        return result;
+    }
+
+    /*
+        The lexer always defers its errors, so priming the lookahead never throws. The error is
+        raised here, once the token standing in for the malformed text is reached.
+    */
+
+    object->fail(object->token_stream_m.error(), name_t(), name_t(),
+        object->token_stream_m.error_position());
+    object->token_stream_m.clear_error();
+
+    if (!object->options_m.nothrow_m) throw object->take_failure();
+    return object->eof_token_m;
 }
 
 /*************************************************************************************************/
 
 void expression_parser::putback()
 {
+    if (object->failed_m) return;
     object->token_stream_m.putback();
 }
 
@@ -15,7 +15,16 @@
 #include <adobe/istream.hpp>
 #include <adobe/dictionary_fwd.hpp>
 
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "eop_lex_stream_fwd.hpp"
 
@@ -154,19 +163,318 @@ class_friend                = "friend" function_declaration.
 
 /*************************************************************************************************/
 
+extern aggregate_name_t struct_k;
+extern aggregate_name_t enum_k;
+extern aggregate_name_t function_k;
+extern aggregate_name_t compound_k;
+extern aggregate_name_t simple_k;
+
+//  keyword_lookup() is the keyword extension the parser installs in its lexer.
+bool keyword_lookup(const name_t& x);
+
+/*
+    The postfix form in which expression_proc_m receives an expression follows the virtual
+    machine of ASL: each operator, a name_t, follows its operands. A number, boolean or string
+    is its value; an identifier, class name or member name is its name_t, and "typename" is
+    typename_k.
+
+        unary           - unary_negate_k, not_k, const_k and unary_dereference_k ("*"); after
+                          its operand, unary_reference_k ("&"). A unary "+" is left out.
+        binary          - the names of the tokens "||" through "%", and index_k for a[i], a.m
+                          and f(x).
+        array_k         - follows its elements and their count; an expression_list, and the
+                          arguments of a call or a template, are arrays.
+        instantiate_k   - follows a template name and the array of its arguments.
+
+    So pointer(T) is [pointer T 1 array_k index_k], and pair<T0, T1> is [pair T0 T1 2 array_k
+    instantiate_k]. expression_operator_arity() is the number of operands operator name takes,
+    counting the count of array_k as its one, or zero if name is not an operator.
+*/
+
+extern aggregate_name_t const_k;
+extern aggregate_name_t typename_k;
+extern aggregate_name_t unary_dereference_k;
+extern aggregate_name_t unary_reference_k;
+extern aggregate_name_t instantiate_k;
+
+std::size_t expression_operator_arity(name_t name);
+
+/*************************************************************************************************/
+
+/*
+    declaration_t records one top-level declaration. kind_m is struct_k, enum_k or function_k and
+    name_m is empty for operators and specializations. length_m spans from the first token of
+    the declaration to the first token of whatever follows it, so the declarations of a result
+    tile the source, and lines_m counts the line ends within it as the lexer counts them.
+    class_names_m lists the entries the declaration added to the class index
+    and diagnostic_count_m the errors recovered from within it. bodies_m holds the offset, from
+    the start of the declaration, and the length of each function body skipped under
+    parse_options_t::skip_bodies_m, from its "{" through its "}".
+*/
+
+struct declaration_t
+{
+    declaration_t() : length_m(0), lines_m(0), template_m(false), diagnostic_count_m(0) { }
+
+    name_t                                              kind_m;
+    name_t                                              name_m;
+    std::size_t                                         length_m;
+    std::size_t                                         lines_m;
+    bool                                                template_m;
+    std::vector<std::pair<name_t, bool> >               class_names_m;
+    std::size_t                                         diagnostic_count_m;
+    std::vector<std::pair<std::size_t, std::size_t> >   bodies_m;
+};
+
+typedef boost::shared_ptr<const declaration_t> declaration_ptr_t;
+
+/*************************************************************************************************/
+
+//  Offsets are zero based byte offsets into the parsed input.
+
+struct diagnostic_t
+{
+    diagnostic_t() : line_number_m(0), line_start_m(0), offset_m(0) { }
+
+    std::string     message_m;
+    int             line_number_m;
+    std::size_t     line_start_m;
+    std::size_t     offset_m;
+};
+
+/*************************************************************************************************/
+
+struct parse_result_t
+{
+    parse_result_t() : offset_m(0) { }
+
+    std::size_t                     offset_m; // of the first declaration
+    std::vector<declaration_ptr_t>  declarations_m;
+    std::vector<diagnostic_t>       diagnostics_m;
+};
+
+/*************************************************************************************************/
+
+/*
+    declaration_callback_suite_t receives the structure of the input as parse() reaches it, so
+    nothing is retained from one declaration to the next. begin_proc_m and end_proc_m bracket
+    each template, struct, enum, function (member functions included) and statement. kind is
+    template_k, struct_k, enum_k or function_k; for a statement it is the leading keyword,
+    compound_k or simple_k (an expression statement). name is the declared name, empty where
+    declaration_t's would be. expression_proc_m receives each expression, in the postfix form
+    above, once it is parsed; a function's result type follows the begin of the function. When
+    an error is recovered from the scopes it interrupted are ended first, so begins and ends
+    always pair. Empty procs are skipped.
+*/
+
+struct declaration_callback_suite_t
+{
+    typedef boost::function<void (name_t kind, name_t name)>    begin_proc_t;
+    typedef boost::function<void (name_t kind)>                 end_proc_t;
+    typedef boost::function<void (const array_t& expression)>   expression_proc_t;
+    typedef boost::function<void (const diagnostic_t&)>         diagnostic_proc_t;
+
+    begin_proc_t        begin_proc_m;
+    end_proc_t          end_proc_m;
+    expression_proc_t   expression_proc_m;
+    diagnostic_proc_t   diagnostic_proc_m;
+};
+
+/*************************************************************************************************/
+
+//  text_edit_t replaces length_m bytes at offset_m of the previous text with text_m.
+
+struct text_edit_t
+{
+    text_edit_t(std::size_t offset = 0, std::size_t length = 0, const std::string& text = std::string()) :
+        offset_m(offset), length_m(length), text_m(text)
+    { }
+
+    std::size_t offset_m;
+    std::size_t length_m;
+    std::string text_m;
+};
+
+/*************************************************************************************************/
+
+/*
+    cancel_token_t asks the parses given it through parse_options_t::cancel_m to stop. cancel()
+    may be called from any thread; a parse notices at its next declaration or statement.
+*/
+
+class cancel_token_t : public boost::noncopyable
+{
+ public:
+    cancel_token_t() : cancelled_m(false) { }
+
+    void cancel() { cancelled_m.store(true, boost::memory_order_relaxed); }
+    void reset() { cancelled_m.store(false, boost::memory_order_relaxed); }
+    bool cancelled() const { return cancelled_m.load(boost::memory_order_relaxed); }
+
+ private:
+    boost::atomic<bool> cancelled_m;
+};
+
+/*
+    parse_cancelled_t is thrown out of a parse stopped by its cancel token, deadline or token
+    budget. It is not a stream_error_t, so it is never taken for an error in the input: it is
+    thrown whatever recover_m and nothrow_m are, and the result of the parse is incomplete.
+*/
+
+class parse_cancelled_t : public std::exception
+{
+ public:
+    enum reason_t { cancelled_k, deadline_k, token_budget_k };
+
+    explicit parse_cancelled_t(reason_t reason) : reason_m(reason) { }
+
+    reason_t reason() const { return reason_m; }
+    const char* what() const throw();
+
+ private:
+    reason_t reason_m;
+};
+
+/*************************************************************************************************/
+
+/*
+    parse_options_t selects how parse() and reparse() proceed. With recover_m set an error is
+    recorded and the parser resynchronizes on the next ";", "}" or declaration keyword, so a
+    single pass reports every error together with the declarations it could parse.
+
+    With nothrow_m set errors are not thrown within the parser: a failed production records the
+    error and the parse returns up through the productions as if the input had ended. The
+    message is only formatted if the error is reported. This is much cheaper on mostly invalid
+    input; the diagnostics are the same either way.
+
+    nesting_limit_m bounds how deeply statements and template declarations may nest; deeper
+    input is an error rather than a stack overflow. Expressions are parsed on a heap allocated
+    stack, which grows with the input as the parse would anyway, so they have a limit of their
+    own, expression_nesting_limit_m, which only bounds memory; zero, the default, is no limit.
+
+    With skip_bodies_m set function bodies (member functions included) are not parsed: their
+    tokens are only matched up to the closing brace and the span of the body recorded in the
+    declaration, to be parsed later, if at all, by parse_body(). Signatures, class members and
+    template constraints are parsed as usual. Errors within a skipped body, other than lexical
+    ones, and the callbacks for its statements are left to parse_body().
+
+    With pipeline_m set the input is lexed ahead on a second thread while it is parsed (see
+    lex_stream_t::set_pipelined()); the results are the same. It pays on large inputs - each
+    reset starts a thread.
+
+    cancel_m, deadline_m and token_budget_m stop a parse which is no longer wanted, or is taking
+    too long, by throwing parse_cancelled_t. They are checked at each declaration and statement
+    (and brace of a skipped body, and token skipped in recovery), the clock only at every 32nd
+    check. token_budget_m counts the tokens taken since the parser was last reset, or began
+    the region reparse(), parse_body() or parse_available() parses; zero is no budget. After
+    a cancelled parse the parser is as after a reset but for its input, ready to be reset.
+*/
+
+struct parse_options_t
+{
+    parse_options_t() :
+        recover_m(false), nothrow_m(false), nesting_limit_m(256), expression_nesting_limit_m(0),
+        skip_bodies_m(false), pipeline_m(false), cancel_m(0),
+        deadline_m(boost::chrono::steady_clock::time_point::max()), token_budget_m(0)
+    { }
+
+    bool                                    recover_m;
+    bool                                    nothrow_m;
+    std::size_t                             nesting_limit_m;
+    std::size_t                             expression_nesting_limit_m; // zero for none
+    bool                                    skip_bodies_m;
+    bool                                    pipeline_m;
+    const cancel_token_t*                   cancel_m;
+    boost::chrono::steady_clock::time_point deadline_m; // time_point::max() for none
+    std::size_t                             token_budget_m;
+};
+
+/*************************************************************************************************/
+
 class expression_parser : public boost::noncopyable
 {
  public:
+    struct state_t;
+
+/*
+    A snapshot is an immutable copy of the parser's semantic state (class names and keyword
+    extensions). Parsers constructed or reset from a snapshot share it rather than copy it.
+*/
+    typedef boost::shared_ptr<const state_t> snapshot_t;
         
     expression_parser(std::istream& in, const line_position_t& position);
+    expression_parser(std::istream& in, const line_position_t& position, const snapshot_t& prelude);
         
     ~expression_parser();
+
+/*
+    reset() rebinds the parser to a new input, reusing the lexer buffers and lookahead queue.
+    If keep_class_names is true the class names declared so far remain visible, so a prelude
+    parsed once can be shared by every following input.
+*/
+    void reset(std::istream& in, const line_position_t& position, bool keep_class_names = false);
+    void reset(std::istream& in, const line_position_t& position, const snapshot_t& prelude);
+//  Rebinds the parser to the tokens of a token file, which are parsed without lexing.
+    void reset(const token_file_t& tokens, const line_position_t& position,
+            const snapshot_t& prelude);
+
+//  snapshot() captures the state after, typically, a shared prelude has been parsed.
+    snapshot_t snapshot() const;
+
+    void set_options(const parse_options_t& options);
+    const parse_options_t& options() const;
     
     const line_position_t& next_position();
 
 
 //  translation_unit            = { declaration } eof.
     void parse();
+/*
+    Records each top-level declaration in result. Parse errors are reported as diagnostics
+    rather than thrown; without recovery the parse stops at the first.
+*/
+    void parse(parse_result_t& result);
+/*
+    Passes the declarations to callbacks as they are parsed, and the errors as diagnostics
+    (recovered from as by parse(result)). Memory use is bounded by the largest declaration
+    rather than by the input.
+*/
+    void parse(const declaration_callback_suite_t& callbacks);
+/*
+    Incrementally parses text, the result of applying edits to the text previous was parsed
+    from. Edits are non-overlapping and their offsets refer to the previous text. Only the
+    declarations touched by the edits are lexed and parsed again; the others are shared with
+    previous. The parser's prelude is used, as for parse().
+*/
+    void reparse(const parse_result_t& previous, const std::string& text,
+            const std::vector<text_edit_t>& edits, const line_position_t& position,
+            parse_result_t& result);
+/*
+    parse_body() parses the body'th body skipped within result.declarations_m[declaration], where
+    result was parsed from text with skip_bodies_m set. The class names are those of the prelude
+    and of the declarations up to and including the one given. Errors are appended to
+    diagnostics, or passed to the callbacks, as by parse(result) and parse(callbacks).
+*/
+    void parse_body(const parse_result_t& result, std::size_t declaration, std::size_t body,
+            const std::string& text, const line_position_t& position,
+            std::vector<diagnostic_t>& diagnostics);
+    void parse_body(const parse_result_t& result, std::size_t declaration, std::size_t body,
+            const std::string& text, const line_position_t& position,
+            const declaration_callback_suite_t& callbacks);
+/*
+    parse_available() parses [first, last), text from start.offset_m on of an input of which more
+    is to follow, and passes to callbacks, as parse(callbacks) would, each declaration followed
+    by a token of the text - what follows the text cannot change those. It returns the length of
+    the text they span; the rest is to be passed again with what follows it, and the class names
+    its declarations entered are withdrawn meanwhile. With at_end set the text ends the input and
+    is parsed through. The text must not end within a token other than a string or comment.
+    start holds the position of first, and is moved on to that of the rest; position holds the
+    name and getline of the input. stopped is set once the parse is over: at the end, or at an
+    error which ends it without recovery.
+*/
+    std::size_t parse_available(const char* first, const char* last, diagnostic_t& start,
+            const line_position_t& position, bool at_end,
+            const declaration_callback_suite_t& callbacks, bool& stopped);
 
 //  template_declaration        = template_declarator declaration.
     bool is_template_declaration();
@@ -264,35 +572,30 @@ class expression_parser : public boost::noncopyable
 //  statement_goto              = "goto" identifier ";"
     bool is_statement_goto();
 
+/*
+    The expression grammar below is parsed iteratively by parse_expression(), with operator
+    precedence taking the place of the recursion through the levels; only the entry points
+    remain as productions.
+
+    expression                  = expression_and { "||" expression_and }.
+    expression_and              = expression_equality { "&&" expression_equality }.
+    expression_equality         = expression_relational { ("==" | "!=") expression_relational }.
+    expression_relational       = expression_additive { ("<" | ">" | "<=" | ">=") expression_additive }.
+    expression_additive         = expression_multiplicative { ("+" | "-") expression_multiplicative }.
+    expression_multiplicative   = expression_unary { ("*" | "/" | "%") expression_unary }.
+    expression_unary            = expression_postfix | ( ("+" | "-" | "!" | "*" | "const") expression_unary).
+    expression_postfix          = expression_primary { ("[" expression "]") | ("." identifier)
+                                    | ("(" [expression_list] ")") | "&" }.
+    expression_primary          = number | "true" | "false" | string | identifier | "typename"
+                                    | expression_template | ("(" expression ")").
+    expression_additive_list    = expression_additive { "," expression_additive }.
+*/
+
 //  expression                  = expression_and { "||" expression_and }.
     bool is_expression(array_t&);
     void require_expression(array_t&);
-    
-//  expression_and              = expression_equality { "&&" expression_equality }.
-    bool is_expression_and(array_t&);
-//  expression_bit_and          = expression_equality { "bitand" expression_equality }.
-    bool is_expression_bit_and(array_t&);
-//  expression_equality         = expression_relational { ("==" | "!=") expression_relational }.
-    bool is_expression_equality(array_t&);
-//  expression_relational       = expression_additive { ("<" | ">" | "<=" | ">=") expression_additive }.
-    bool is_expression_relational(array_t&);
-//  expression_additive = expression_multiplicative { ("+" | "-") expression_multiplicative }.
-    bool is_expression_additive(array_t&);
-    bool is_additive_operator(name_t&);
-//  expression_multiplicative = expression_unary { ("*" | "/" | "%") expression_unary }.
-    bool is_expression_multiplicative(array_t&);
-    bool is_multiplicative_operator(name_t&);
-//  expression_unary = expression_postfix | ( ("+" | "-" | "!" | "*" | "&" | "const") expression_unary).
-    bool is_expression_unary(array_t&);
-    bool is_unary_operator(name_t&); // helper
-//  expression_postfix          = expression_primary { ("[" expression "]") | ("." identifier) | ("(" [expression_list] ")") | "&" }.
-    bool is_expression_postfix(array_t&);
-//  expression_primary          = number | "true" | "false" | string | identifier | "typename" | expression_template | ("(" expression ")").
-    bool is_expression_primary(array_t&);
-//  expression_template         = class_name [ "<" expression_list ">" ].
+//  expression_template         = class_name [ "<" expression_additive_list ">" ].
     bool is_expression_template();
-//  expression_additive_list    = expression_additive { "," expression_additive }.
-    bool is_expression_additive_list();
 //  expression_list             = expression { "," expression }.
     bool is_expression_list(array_t&);
     
@@ -300,7 +603,7 @@ class expression_parser : public boost::noncopyable
     bool is_boolean(any_regular_t&);
         
 //  helper functions
-    bool is_relational_operator(name_t&);
+    bool is_unary_operator(name_t&);
     bool is_operator_shift(name_t&);
     
 //  lexical tokens:
@@ -336,6 +639,21 @@ class expression_parser : public boost::noncopyable
 
 private:
     void set_keyword_extension_lookup(const keyword_extension_lookup_proc_t& proc);
+    bool parse_declaration(std::vector<declaration_ptr_t>& declarations);
+    bool recover(const stream_error_t& error, bool at_declaration);
+    const stream_lex_token_t& get_recovery_token();
+    bool is_statement_or_recover();
+    bool is_class_member_or_recover(name_t this_class);
+    bool is_function_body();
+    void parse_body(const parse_result_t& result, std::size_t declaration, std::size_t body,
+            const std::string& text, const line_position_t& position,
+            std::vector<diagnostic_t>& diagnostics, const declaration_callback_suite_t* callbacks);
+
+    enum expression_kind_t { expression_k, expression_list_k, expression_template_k };
+
+    bool parse_expression(expression_kind_t kind, array_t& result);
+
+    class nesting_guard_t;
 
     class implementation;
     implementation*     object;
@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include "eop_allocation.hpp"
+#include "eop_corpus.hpp"
+#include "eop_metrics.hpp"
+#include "exp_parser.hpp"
+
+/*
+    fuzz_parser is a libFuzzer harness looking for inputs on which expression_parser takes
+    more than linear time - backtracking among the alternatives of is_statement(), say, or
+    copying operands in is_expression(). Each input is parsed, with recovery so the parse
+    runs on past errors, from memory by one parser reset between inputs, and its cost per
+    byte measured three ways:
+
+        tokens          - taken from the lexer, counting each taken again after a putback;
+                          the surest sign of backtracking, and deterministic.
+        allocations     - made during the parse; deterministic, and counted only in a build
+                          with EOP_ENABLE_ALLOCATION_ACCOUNTING.
+        time            - in nanoseconds; noisy, so its limit is generous.
+
+    Costs are taken per byte of the input or of 64 bytes, whichever is more, as any parse has
+    a fixed cost. An input costing more than a limit is reported and aborts, so libFuzzer saves
+    it as a crash, and -minimize_crash=1 shrinks it while it still exceeds the limit:
+
+        clang++ -fsanitize=fuzzer -O2 -DEOP_ENABLE_ALLOCATION_ACCOUNTING fuzz_parser.cpp
+            exp_parser.cpp eop_lex_stream.cpp eop_allocation.cpp eop_corpus.cpp eop_metrics.cpp
+            ... -o fuzz_parser
+        fuzz_parser --seeds seeds
+        fuzz_parser -max_len=4096 -timeout=10 corpus seeds
+        fuzz_parser -minimize_crash=1 -runs=100000 crash-<hash>
+
+    Allocation accounting replaces operator new, so it cannot be combined with
+    -fsanitize=address; look for crashes in a separate build. The limits are set from the
+    environment: EOP_FUZZ_TOKENS_PER_BYTE (16), EOP_FUZZ_ALLOCATIONS_PER_BYTE (64) and
+    EOP_FUZZ_NANOSECONDS_PER_BYTE (50000); zero disables a limit.
+
+    Built with EOP_FUZZ_MAIN defined it has a main of its own, for running without libFuzzer:
+
+    usage: fuzz_parser --seeds <directory>
+           fuzz_parser --minimize <file> <output>
+           fuzz_parser file...
+
+        --seeds <directory>         writes the seed corpus to directory, which must exist
+        --minimize <file> <output>  removes from file what it can while it still exceeds a
+                                    limit, and writes what is left to output
+        file...                     reports the cost of each file; the exit code is non-zero
+                                    if any exceeds a limit
+
+    With libFuzzer, the --seeds option is taken before libFuzzer sees the command line.
+*/
+
+namespace {
+
+typedef boost::chrono::steady_clock steady_clock_t;
+
+const std::size_t floor_bytes_k = 64;
+
+struct limits_t
+{
+    double tokens_m; // per byte; zero for no limit
+    double allocations_m;
+    double nanoseconds_m;
+};
+
+limits_t limits_g = { 16, 64, 50000 };
+
+struct cost_t
+{
+    std::size_t     bytes_m;
+    boost::uint64_t tokens_m;
+    std::size_t     allocations_m;
+    double          nanoseconds_m;
+};
+
+/*************************************************************************************************/
+
+double limit_from(const char* variable, double value)
+{
+    const char* text(std::getenv(variable));
+    return text ? std::atof(text) : value;
+}
+
+void read_limits()
+{
+    limits_g.tokens_m = limit_from("EOP_FUZZ_TOKENS_PER_BYTE", limits_g.tokens_m);
+    limits_g.allocations_m = limit_from("EOP_FUZZ_ALLOCATIONS_PER_BYTE", limits_g.allocations_m);
+    limits_g.nanoseconds_m = limit_from("EOP_FUZZ_NANOSECONDS_PER_BYTE", limits_g.nanoseconds_m);
+}
+
+/*
+    One parser serves every input, as one does every file in main; reset() drops the class
+    names the last input declared. The tokens come from the metrics the parser keeps.
+*/
+
+eop::expression_parser& parser()
+{
+    static std::istringstream       empty_s;
+    static eop::expression_parser   parser_s(empty_s, adobe::line_position_t("fuzz"));
+    static bool                     configured_s(false);
+
+    if (!configured_s) {
+        eop::parse_options_t options;
+
+        options.recover_m = true;
+        parser_s.set_options(options);
+        configured_s = true;
+    }
+    return parser_s;
+}
+
+cost_t measure(const char* data, std::size_t size)
+{
+    eop::expression_parser& target(parser());
+    std::istringstream      stream(std::string(data, size));
+    eop::parse_result_t     result;
+    cost_t                  cost;
+
+    target.reset(stream, adobe::line_position_t("fuzz"));
+
+    boost::uint64_t             tokens(eop::read_metrics().tokens_m);
+    steady_clock_t::time_point  start(steady_clock_t::now());
+
+    eop::reset_allocation_report();
+    target.parse(result);
+
+    eop::allocation_report_t allocations(eop::allocation_report());
+
+    cost.nanoseconds_m = boost::chrono::duration<double, boost::nano>(
+        steady_clock_t::now() - start).count();
+    cost.bytes_m = size;
+    cost.tokens_m = eop::read_metrics().tokens_m - tokens;
+    cost.allocations_m = allocations.total().count_m;
+    return cost;
+}
+
+//  excessive() names the first limit cost exceeds; null if none.
+
+const char* excessive(const cost_t& cost)
+{
+    double bytes(double(cost.bytes_m < floor_bytes_k ? floor_bytes_k : cost.bytes_m));
+
+    if (limits_g.tokens_m && double(cost.tokens_m) / bytes > limits_g.tokens_m)
+        return "tokens";
+    if (limits_g.allocations_m && double(cost.allocations_m) / bytes > limits_g.allocations_m)
+        return "allocations";
+    if (limits_g.nanoseconds_m && cost.nanoseconds_m / bytes > limits_g.nanoseconds_m)
+        return "time";
+    return 0;
+}
+
+void report(std::FILE* out, const char* name, const cost_t& cost)
+{
+    double      bytes(double(cost.bytes_m ? cost.bytes_m : 1));
+    const char* exceeded(excessive(cost));
+
+    std::fprintf(out, "%s: %lu bytes, %.2f tokens/byte, %.2f allocations/byte, %.0f ns/byte%s%s\n",
+        name, static_cast<unsigned long>(cost.bytes_m), double(cost.tokens_m) / bytes,
+        double(cost.allocations_m) / bytes, cost.nanoseconds_m / bytes,
+        exceeded ? ", exceeds the limit of " : "", exceeded ? exceeded : "");
+}
+
+/*************************************************************************************************/
+
+/*
+    The seed corpus is drawn from the grammar through the corpus generator: every shape, at
+    sizes libFuzzer mutates readily, and a run of each class of token. The generator writes
+    only valid source, so the seeds reach deep into the grammar before mutation breaks them.
+*/
+
+bool write_file(const std::string& file, const std::string& content)
+{
+    std::ofstream stream(file.c_str(), std::ios_base::out | std::ios_base::binary);
+    return stream.write(content.data(), content.size()) && stream.flush();
+}
+
+bool write_seeds(const std::string& directory)
+{
+    const std::size_t sizes[] = { 64, 256, 1024, 4096 };
+    const std::size_t seed_count(8);
+
+    for (std::size_t shape(0); shape != eop::corpus_shape_count_k; ++shape) {
+        for (std::size_t size(0); size != sizeof(sizes) / sizeof(sizes[0]); ++size) {
+            for (std::size_t seed(1); seed <= seed_count; ++seed) {
+                eop::corpus_options_t   options;
+                std::string             content;
+                std::ostringstream      name;
+
+                options.shape_m = eop::corpus_shape_t(shape);
+                options.size_m = sizes[size];
+                options.seed_m = boost::uint32_t(seed);
+                options.depth_m = 1 + seed % 4;
+                options.length_m = 2 + seed;
+                eop::generate_corpus(options, content);
+
+                name << directory << '/' << eop::corpus_shape_name(options.shape_m) << '-'
+                    << sizes[size] << '-' << seed << ".eop";
+                if (!write_file(name.str(), content)) {
+                    std::cerr << "Cannot write " << name.str() << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    for (std::size_t token_class(0); token_class != eop::token_class_count_k; ++token_class) {
+        std::string         content;
+        std::ostringstream  name;
+
+        eop::generate_tokens(eop::token_class_t(token_class), 256, 1, content);
+        name << directory << '/' << eop::token_class_name(eop::token_class_t(token_class))
+            << ".eop";
+        if (!write_file(name.str(), content)) {
+            std::cerr << "Cannot write " << name.str() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*************************************************************************************************/
+
+#if defined(EOP_FUZZ_MAIN)
+
+bool read_file(const char* file, std::string& result)
+{
+    std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+    if (!stream) return false;
+    result.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/*
+    Removes from content, a chunk at a time, whatever it can while the rest still exceeds the
+    limit it first exceeded: halves first, then ever smaller chunks down to single bytes, until
+    a pass over the chunks of each size removes nothing. If the limit is of time the noise may
+    keep bytes which could go, or let go some which made it slow; minimize against tokens or
+    allocations where they are exceeded too.
+*/
+
+void minimize(std::string& content)
+{
+    const char* limit(excessive(measure(content.data(), content.size())));
+
+    for (std::size_t chunk(content.size() / 2); chunk; chunk /= 2) {
+        bool removed(true);
+
+        while (removed) {
+            removed = false;
+
+            for (std::size_t first(0); first < content.size(); ) {
+                std::string candidate(content.substr(0, first)
+                    + content.substr((std::min)(first + chunk, content.size())));
+
+                const char* exceeded(excessive(measure(candidate.data(), candidate.size())));
+
+                if (exceeded && std::strcmp(exceeded, limit) == 0) {
+                    content.swap(candidate);
+                    removed = true;
+                } else {
+                    first += chunk;
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+} // namespace
+
+/*************************************************************************************************/
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    read_limits();
+    if (!eop::allocation_accounting_enabled()) limits_g.allocations_m = 0;
+
+    // Taken before libFuzzer, which would take the directory for a corpus, sees the line.
+    if (*argc == 3 && std::strcmp((*argv)[1], "--seeds") == 0)
+        std::exit(write_seeds((*argv)[2]) ? 0 : 1);
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const boost::uint8_t* data, std::size_t size)
+{
+    cost_t cost(measure(reinterpret_cast<const char*>(data), size));
+
+    if (excessive(cost)) {
+        report(stderr, "input", cost);
+        std::abort();
+    }
+    return 0;
+}
+
+/*************************************************************************************************/
+
+#if defined(EOP_FUZZ_MAIN)
+
+int main (int argc, char * const argv[]) {
+    const char* const*  first(argv + 1);
+    const char* const*  last(argv + argc);
+    int                 arguments(argc);
+    char**              arguments_vector(const_cast<char**>(argv));
+
+    LLVMFuzzerInitialize(&arguments, &arguments_vector);
+
+    if (last - first == 3 && std::strcmp(*first, "--minimize") == 0) {
+        std::string content;
+
+        if (!read_file(first[1], content)) {
+            std::cerr << "Cannot open " << first[1] << std::endl;
+            return 1;
+        }
+        if (!excessive(measure(content.data(), content.size()))) {
+            std::cerr << first[1] << " exceeds no limit" << std::endl;
+            return 1;
+        }
+        minimize(content);
+        report(stdout, first[2], measure(content.data(), content.size()));
+        if (!write_file(first[2], content)) {
+            std::cerr << "Cannot write " << first[2] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    bool exceeded(false);
+
+    for (; first != last; ++first) {
+        std::string content;
+
+        if (!read_file(*first, content)) {
+            std::cerr << "Cannot open " << *first << std::endl;
+            continue;
+        }
+        try {
+            cost_t cost(measure(content.data(), content.size()));
+
+            report(stdout, *first, cost);
+            if (excessive(cost)) exceeded = true;
+        } catch (const std::exception& error) {
+            std::cerr << *first << ": " << error.what() << std::endl;
+            exceeded = true;
+        }
+    }
+
+    return exceeded ? 1 : 0;
+}
+
+#endif
@@ -1,7 +1,25 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <adobe/array.hpp>
 #include "exp_parser.hpp"
+#include "eop_parse_cache.hpp"
+#include "eop_lex_stream.hpp"
+#include "eop_lsp_server.hpp"
+#include "eop_metrics.hpp"
+#include "eop_push_parser.hpp"
+#include "eop_token_file.hpp"
+#include "eop_trace.hpp"
+#include "eop_watch.hpp"
 
 namespace {
 
@@ -21,28 +39,563 @@ std::string get_line(adobe::name_t n, std::streampos p)
     return result;
 }
 
+adobe::line_position_t file_position(const char* file)
+{
+    return adobe::line_position_t(adobe::name_t(file),
+        adobe::line_position_t::getline_proc_t(new adobe::line_position_t::getline_proc_impl_t(&get_line)));
+}
+
+void report(const char* file, const eop::diagnostic_t& diagnostic)
+{
+    adobe::line_position_t position(file_position(file));
+    position.line_number_m = diagnostic.line_number_m;
+    position.line_start_m = diagnostic.line_start_m + 1;
+    position.position_m = diagnostic.offset_m + 1;
+
+    std::cerr << format_stream_error(adobe::stream_error_t(diagnostic.message_m, position));
+}
+
+void report(const char* file, const eop::parse_result_t& result)
+{
+    for (std::size_t n(0); n != result.diagnostics_m.size(); ++n)
+        report(file, result.diagnostics_m[n]);
+}
+
+//  Reports a diagnostic of a streaming parse as it is found.
+
+void report_streamed(const char* file, bool& success, const eop::diagnostic_t& diagnostic)
+{
+    report(file, diagnostic);
+    success = false;
+}
+
+//  Reports straight from the mapped cache entry - nothing is deserialized.
+
+void report(const char* file, const eop::cache_entry_t& entry)
+{
+    for (std::size_t n(0); n != entry.header().diagnostic_count_m; ++n) {
+        const eop::cache_diagnostic_t& diagnostic(entry.diagnostic(n));
+
+        adobe::line_position_t position(file_position(file));
+        position.line_number_m = diagnostic.line_number_m;
+        position.line_start_m = diagnostic.line_start_m + 1;
+        position.position_m = diagnostic.offset_m + 1;
+
+        std::cerr << format_stream_error(adobe::stream_error_t(entry.string(diagnostic.message_m),
+            position));
+    }
+}
+
+bool read_file(const char* file, std::string& result)
+{
+    std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+    if (!stream) return false;
+    result.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool same_diagnostic(const eop::diagnostic_t& x, const eop::diagnostic_t& y)
+{
+    return x.message_m == y.message_m && x.line_number_m == y.line_number_m
+        && x.line_start_m == y.line_start_m && x.offset_m == y.offset_m;
+}
+
+bool same_result(const eop::parse_result_t& x, const eop::parse_result_t& y)
+{
+    if (x.offset_m != y.offset_m || x.declarations_m.size() != y.declarations_m.size()
+            || x.diagnostics_m.size() != y.diagnostics_m.size()) {
+        return false;
+    }
+    for (std::size_t n(0); n != x.declarations_m.size(); ++n) {
+        if (x.declarations_m[n]->length_m != y.declarations_m[n]->length_m) return false;
+    }
+    for (std::size_t n(0); n != x.diagnostics_m.size(); ++n) {
+        if (!same_diagnostic(x.diagnostics_m[n], y.diagnostics_m[n])) return false;
+    }
+    return true;
+}
+
+/*
+    Checks reparse() against parse(): a line end is put at the start and in the middle of each
+    declaration in turn, and the edited text reparsed from result, the parse of content, must
+    give the declarations and diagnostics a parse of the edited text does. A second pass keeps
+    each line end and reparses from the result of the reparse before, as an editor would.
+    Reports each edit where they differ; false if any does.
+*/
+
+bool check_reparse(eop::expression_parser& parser, const char* file, const std::string& content,
+        const eop::parse_result_t& result, const eop::expression_parser::snapshot_t& prelude)
+{
+    std::vector<std::size_t>    offsets;
+    std::size_t                 start(result.offset_m);
+    std::istringstream          empty;
+    std::string                 edited(content);
+    eop::parse_result_t         chained(result);
+    bool                        success(true);
+
+    if (start != 0) offsets.push_back(0); // within what comes before the first declaration
+
+    for (std::size_t n(0); n != result.declarations_m.size(); ++n) {
+        offsets.push_back(start);
+        offsets.push_back(start + result.declarations_m[n]->length_m / 2);
+        start += result.declarations_m[n]->length_m;
+    }
+
+    for (std::size_t pass(0); pass != 2; ++pass) {
+        for (std::size_t n(0); n != offsets.size(); ++n) {
+            // Each line end kept by the second pass moves those after it on by one.
+            std::size_t                     offset(offsets[n] + (pass ? n : 0));
+            std::vector<eop::text_edit_t>   edits(1, eop::text_edit_t(offset, 0, "\n"));
+            std::string                     text(pass ? edited : content);
+            eop::parse_result_t             parsed;
+            eop::parse_result_t             reparsed;
+
+            text.insert(offset, 1, '\n');
+
+            std::istringstream stream(text);
+
+            parser.reset(stream, file_position(file), prelude);
+            parser.parse(parsed);
+            parser.reset(empty, file_position(file), prelude);
+            parser.reparse(pass ? chained : result, text, edits, file_position(file), reparsed);
+
+            if (!same_result(parsed, reparsed)) {
+                std::cerr << file << ": Reparse differs from parse with a line end at offset "
+                    << offset << (pass ? ", after those before it" : "") << std::endl;
+                success = false;
+            }
+            if (pass) { edited.swap(text); chained = reparsed; }
+        }
+    }
+
+    return success;
+}
+
+bool before(const eop::diagnostic_t& x, const eop::diagnostic_t& y)
+{
+    return x.offset_m < y.offset_m;
+}
+
+/*
+    Checks parse_body() against parse(), for result of a recovering parse skipping bodies: its
+    diagnostics with those of parse_body() for each body, in order, must be those of a parse of
+    the bodies. A lexer error in a body is reported by both the parse skipping it and
+    parse_body(), so each is counted once. Without recovery a parse stops at its first error while
+    each body is still parsed, so there is nothing to compare.
+*/
+
+bool check_bodies(eop::expression_parser& parser, const char* file, const std::string& content,
+        const eop::parse_result_t& result, const eop::expression_parser::snapshot_t& prelude)
+{
+    eop::parse_options_t                options(parser.options());
+    eop::parse_options_t                parsing(options);
+    eop::parse_result_t                 parsed;
+    std::vector<eop::diagnostic_t>      diagnostics(result.diagnostics_m);
+    std::istringstream                  stream(content);
+    std::istringstream                  empty;
+
+    parsing.skip_bodies_m = false;
+    parser.set_options(parsing);
+    parser.reset(stream, file_position(file), prelude);
+    parser.parse(parsed);
+    parser.set_options(options);
+    parser.reset(empty, file_position(file), prelude);
+
+    for (std::size_t n(0); n != result.declarations_m.size(); ++n) {
+        for (std::size_t i(0); i != result.declarations_m[n]->bodies_m.size(); ++i)
+            parser.parse_body(result, n, i, content, file_position(file), diagnostics);
+    }
+
+    std::stable_sort(diagnostics.begin(), diagnostics.end(), &before);
+    diagnostics.erase(std::unique(diagnostics.begin(), diagnostics.end(), &same_diagnostic),
+        diagnostics.end());
+    std::stable_sort(parsed.diagnostics_m.begin(), parsed.diagnostics_m.end(), &before);
+    parsed.diagnostics_m.erase(std::unique(parsed.diagnostics_m.begin(),
+        parsed.diagnostics_m.end(), &same_diagnostic), parsed.diagnostics_m.end());
+
+    if (diagnostics.size() == parsed.diagnostics_m.size()
+            && std::equal(diagnostics.begin(), diagnostics.end(), parsed.diagnostics_m.begin(),
+                &same_diagnostic)) {
+        return true;
+    }
+    std::cerr << file << ": Parsing bodies differs from parse" << std::endl;
+    return false;
+}
+
+//  Reports a file validated by the watch, each time it is parsed.
+
+void report_watched(const std::string& file, const std::vector<eop::diagnostic_t>& diagnostics)
+{
+    for (std::size_t n(0); n != diagnostics.size(); ++n) report(file.c_str(), diagnostics[n]);
+    if (diagnostics.empty()) std::cout << file << ": Success!" << std::endl;
+}
+
+//  The files of a watched tree which are validated, by extension.
+
+bool is_source(const std::string& file)
+{
+    const char* const extensions[] = { ".eop", ".hpp", ".h" };
+
+    for (std::size_t n(0); n != sizeof(extensions) / sizeof(extensions[0]); ++n) {
+        std::size_t size(std::strlen(extensions[n]));
+
+        if (file.size() > size && file.compare(file.size() - size, size, extensions[n]) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+    Validates the sources of the tree under directory, then again each as it is saved - and
+    those the prelude affects as it is - until interrupted. Only the changed files are parsed.
+*/
+
+int watch(const char* directory, const char* prelude_file, const eop::parse_options_t& options,
+        const char* cache_directory)
+{
+    eop::directory_watch_t      watch;
+    eop::watch_validator_t      validator(options, cache_directory ? cache_directory : "",
+                                    &report_watched);
+    std::vector<std::string>    files;
+    std::string                 prelude;
+
+    if (!watch.add(directory, true, files)) {
+        std::cerr << "Cannot watch " << directory << std::endl;
+        return 1;
+    }
+
+    if (prelude_file) {
+        std::vector<std::string> ignored;
+
+        // The prelude may lie outside the tree, so its directory is watched for it.
+        prelude = eop::canonical_path(prelude_file);
+        if (prelude.empty() || !watch.add(prelude.substr(0, prelude.rfind('/')), false, ignored)) {
+            std::cerr << "Cannot open " << prelude_file << std::endl;
+            return 1;
+        }
+        if (!validator.set_prelude(prelude)) return 1;
+    }
+
+    for (std::size_t n(0); n != files.size(); ++n) {
+        if (files[n] != prelude && is_source(files[n])) validator.validate(files[n]);
+    }
+
+    while (true) {
+        std::vector<std::string> changed;
+
+        watch.wait(changed, -1);
+
+        for (std::size_t n(0); n != changed.size(); ++n) {
+            try {
+                if (changed[n] == prelude) validator.set_prelude(prelude);
+                else if (is_source(changed[n])) validator.validate(changed[n]);
+            } catch (const std::exception& error) {
+                std::cerr << error.what();
+            }
+        }
+    }
+}
+
 } // namespace
 
 int main (int argc, char * const argv[]) {
-    const char* file((argc > 1) ? argv[1] : "/Users/sparent/Development/projects/eop_code/eop.hpp");
+    const char* default_file("/Users/sparent/Development/projects/eop_code/eop.hpp");
+
+    const char* const*  first(argv + 1);
+    const char* const*  last(argv + argc);
+
+    const char*                         prelude_file(0);
+    const char*                         cache_directory(0);
+    const char*                         watch_directory(0);
+    const char*                         trace_file(0);
+    const char*                         metrics_file(0);
+    double                              metrics_interval(10); // seconds
+    eop::expression_parser::snapshot_t  prelude;
+    eop::content_hash_t                 prelude_hash(eop::content_hash(0, 0));
+    eop::parse_options_t                options;
+    bool                                streaming(false);
+    bool                                pushing(false);
+    bool                                serving(false);
+    bool                                writing_tokens(false);
+    bool                                replaying(false);
+    bool                                checking_reparse(false);
+    long                                timeout(0); // milliseconds per file
+
+    while (first != last) {
+        std::string option(*first);
+
+        if (option == "--recover") { options.recover_m = true; ++first; continue; }
+        if (option == "--stream") { streaming = true; ++first; continue; }
+        if (option == "--push") { pushing = true; ++first; continue; }
+        if (option == "--lsp") { serving = true; ++first; continue; }
+        if (option == "--write-tokens") { writing_tokens = true; ++first; continue; }
+        if (option == "--replay") { replaying = true; ++first; continue; }
+        if (option == "--skip-bodies") { options.skip_bodies_m = true; ++first; continue; }
+        if (option == "--pipeline") { options.pipeline_m = true; ++first; continue; }
+        if (option == "--check-reparse") { checking_reparse = true; ++first; continue; }
+        if (last - first < 2) break;
+
+        if (option == "--prelude") prelude_file = first[1];
+        else if (option == "--cache") cache_directory = first[1];
+        else if (option == "--timeout") timeout = std::atol(first[1]);
+        else if (option == "--nesting-limit") options.nesting_limit_m = std::atol(first[1]);
+        else if (option == "--watch") watch_directory = first[1];
+        else if (option == "--trace") trace_file = first[1];
+        else if (option == "--metrics") metrics_file = first[1];
+        else if (option == "--metrics-interval") metrics_interval = std::atof(first[1]);
+        else break;
+
+        first += 2;
+    }
+
+    if (first == last) { first = &default_file; last = first + 1; }
+
+    /*
+        The metrics are written for scraping while the files are parsed, and once more as the
+        writer is destroyed on return; a watch runs until interrupted, so only the former.
+    */
+
+    boost::scoped_ptr<eop::metrics_writer_t> metrics;
+
+    if (metrics_file) metrics.reset(new eop::metrics_writer_t(metrics_file, metrics_interval));
+
+    if (watch_directory) return watch(watch_directory, prelude_file, options, cache_directory);
+
+    if (prelude_file) {
+        std::string             content;
+        eop::parse_result_t     result;
+
+        if (!read_file(prelude_file, content)) {
+            std::cerr << "Cannot open " << prelude_file << std::endl;
+            return 1;
+        }
+
+        std::istringstream      stream(content);
+        eop::expression_parser  parser(stream, file_position(prelude_file));
+
+        parser.parse(result);
+        if (!result.diagnostics_m.empty()) { report(prelude_file, result); return 1; }
+
+        prelude = parser.snapshot();
+        prelude_hash = eop::content_hash(content.data(), content.data() + content.size());
+    }
+
+    // As a language server the documents come from the client over stdin; no file is read.
+
+    if (serving) {
+        std::ios_base::sync_with_stdio(false);
+
+        eop::lsp_server_t server(prelude, options);
+        return server.run(std::cin, std::cout);
+    }
+
+    /*
+        One parser instance serves every file; reset() keeps its buffers warm between files and
+        forks each one from the prelude state. Cached results are keyed by the content of the file
+        and of the prelude it was parsed against.
+    */
+
+    bool                    several_files(last - first > 1);
+    std::istringstream      empty;
+    eop::expression_parser  parser(empty, file_position(""), prelude);
+    eop::parse_cache_t      cache(cache_directory ? cache_directory : "");
+    const char              mode[] = {
+                                options.recover_m ? 'r' : 's', options.skip_bodies_m ? 'd' : 'b'
+                            };
+
+    parser.set_options(options);
+    // A recovering parse records more, and one skipping bodies less, so each is cached apart.
+    prelude_hash = eop::content_hash(prelude_hash, mode, mode + sizeof(mode));
+
+    // A trace covers the files, not the prelude; it shows where a slow file spends its time.
+
+    if (trace_file) {
+        if (!eop::trace_enabled()) {
+            std::cerr << "Tracing is not built in; define EOP_ENABLE_TRACE" << std::endl;
+            return 1;
+        }
+        eop::start_trace();
+    }
 
-    try {
-        std::ifstream stream(file);
+    for (const char* const* file(first); file != last; ++file) {
+        try {
+            bool success(true);
 
-        eop::expression_parser parser(stream,
-            adobe::line_position_t(adobe::name_t(file),
-                adobe::line_position_t::getline_proc_t(new adobe::line_position_t::getline_proc_impl_t(&get_line))));
+            if (timeout) {
+                options.deadline_m = boost::chrono::steady_clock::now()
+                    + boost::chrono::milliseconds(timeout);
+                parser.set_options(options);
+            }
 
-        parser.parse();
-        std::cout << "Success!" << std::endl;
+            /*
+                Writing tokens, each file is lexed - with the parser's keywords - to a token file
+                beside it, and not parsed; replaying, each file named is such a token file, and
+                is parsed without lexing. Diagnostics name the source the tokens came from.
+            */
 
-    } catch (const adobe::stream_error_t& error) {
+            if (writing_tokens) {
+                std::ifstream   stream(*file, std::ios_base::in | std::ios_base::binary);
+                std::string     output(std::string(*file) + ".tokens");
 
-        std::cerr << format_stream_error(error);
+                if (!stream) {
+                    std::cerr << "Cannot open " << *file << std::endl;
+                    eop::count_error(eop::read_error_k);
+                    continue;
+                }
+
+                eop::lex_stream_t   lexer(stream, file_position(*file));
+                std::ofstream       out(output.c_str(), std::ios_base::out | std::ios_base::binary);
+
+                lexer.set_keyword_extension_lookup(&eop::keyword_lookup);
+                if (!eop::write_token_file(lexer, *file, out)) {
+                    std::cerr << "Cannot write " << output << std::endl;
+                    continue;
+                }
+                std::cout << *file << ": Wrote " << output << std::endl;
+                continue;
+            }
+
+            if (replaying) {
+                std::ifstream       stream(*file, std::ios_base::in | std::ios_base::binary);
+                eop::token_file_t   tokens;
+                eop::parse_result_t result;
+
+                if (!stream || !tokens.read(stream)) {
+                    std::cerr << "Cannot read tokens from " << *file << std::endl;
+                    eop::count_error(eop::read_error_k);
+                    continue;
+                }
+
+                const char* source(tokens.source().c_str());
+
+                parser.reset(tokens, file_position(source), prelude);
+                parser.parse(result);
+                report(source, result);
+
+                if (!result.diagnostics_m.empty()) continue;
+                if (several_files) std::cout << source << ": ";
+                std::cout << "Success!" << std::endl;
+                continue;
+            }
+
+            /*
+                A streamed file is parsed straight from disk through the callbacks and never
+                held in memory, whatever its size; it bypasses the cache.
+            */
+
+            if (streaming) {
+                std::ifstream stream(*file, std::ios_base::in | std::ios_base::binary);
+
+                if (!stream) {
+                    std::cerr << "Cannot open " << *file << std::endl;
+                    eop::count_error(eop::read_error_k);
+                    continue;
+                }
+
+                eop::declaration_callback_suite_t callbacks;
+
+                callbacks.diagnostic_proc_m = boost::bind(&report_streamed, *file,
+                    boost::ref(success), _1);
+
+                parser.reset(stream, file_position(*file), prelude);
+                parser.parse(callbacks);
+
+                if (!success) continue;
+                if (several_files) std::cout << *file << ": ";
+                std::cout << "Success!" << std::endl;
+                continue;
+            }
+
+            // A pushed file is fed to the parser a block at a time, as if arriving over a socket.
+
+            if (pushing) {
+                std::ifstream stream(*file, std::ios_base::in | std::ios_base::binary);
+
+                if (!stream) {
+                    std::cerr << "Cannot open " << *file << std::endl;
+                    eop::count_error(eop::read_error_k);
+                    continue;
+                }
+
+                eop::declaration_callback_suite_t callbacks;
+
+                callbacks.diagnostic_proc_m = boost::bind(&report_streamed, *file,
+                    boost::ref(success), _1);
+
+                eop::push_parser_t  push(file_position(*file), callbacks, prelude);
+                char                block[4096];
+
+                push.set_options(options);
+
+                while (!push.finished() && stream.read(block, sizeof(block)).gcount())
+                    push.feed(block, block + stream.gcount());
+                push.finish();
+
+                if (!success) continue;
+                if (several_files) std::cout << *file << ": ";
+                std::cout << "Success!" << std::endl;
+                continue;
+            }
+
+            std::string content;
+
+            if (!read_file(*file, content)) {
+                std::cerr << "Cannot open " << *file << std::endl;
+                eop::count_error(eop::read_error_k);
+                continue;
+            }
+
+            eop::content_hash_t key(eop::content_hash(prelude_hash,
+                content.data(), content.data() + content.size()));
+            eop::cache_entry_t  entry;
+
+            // Checking reparse() needs the declarations, so the cache is not read.
+
+            if (cache_directory && !checking_reparse && cache.find(key, content.size(), entry)) {
+                report(*file, entry);
+                success = entry.header().diagnostic_count_m == 0;
+            } else {
+                std::istringstream  stream(content);
+                eop::parse_result_t result;
+
+                parser.reset(stream, file_position(*file), prelude);
+                parser.parse(result);
+                if (cache_directory) cache.store(key, content.size(), result);
+
+                report(*file, result);
+                success = result.diagnostics_m.empty();
+
+                if (checking_reparse && !check_reparse(parser, *file, content, result, prelude))
+                    success = false;
+                if (checking_reparse && options.skip_bodies_m && options.recover_m
+                        && !check_bodies(parser, *file, content, result, prelude)) {
+                    success = false;
+                }
+            }
+
+            if (!success) continue;
+            if (several_files) std::cout << *file << ": ";
+            std::cout << "Success!" << std::endl;
+
+        } catch (const eop::parse_cancelled_t& error) {
+
+            std::cerr << *file << ": " << error.what() << std::endl;
+
+        } catch (const std::exception& error) {
+
+            std::cerr << error.what();
+        }
+    }
 
-    } catch (const std::exception& error) {
+    if (trace_file) {
+        std::ofstream stream(trace_file);
 
-        std::cerr << error.what();
+        eop::stop_trace();
+        eop::write_trace(stream);
+        if (!stream) {
+            std::cerr << "Cannot write " << trace_file << std::endl;
+            return 1;
+        }
     }
 
     return 0;
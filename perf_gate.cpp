@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#include "eop_bench.hpp"
+#include "eop_corpus.hpp"
+
+/*
+    perf_gate fails when lexing or parsing has become slower. It runs a fixed workload - the
+    lexer and the parser over a generated corpus of each shape - and compares the median
+    throughput of each against a baseline recorded earlier on the same machine.
+
+    usage: perf_gate [--record | --allocations] [--baseline <file>] [--size <bytes>]
+                [--runs <n>] [--warmup <n>] [--tolerance <percent>]
+
+        --record            measures the workload and writes it as the baseline
+        --allocations       checks the allocations of a parse of each corpus against fixed
+                            ceilings instead; needs a build with EOP_ENABLE_ALLOCATION_ACCOUNTING
+        --baseline <file>   the baseline to compare against or record (perf_baseline.txt)
+        --size <bytes>      of each corpus (256 KiB); must match the baseline
+        --runs <n>          timed runs of each workload, of which the median is taken (11)
+        --warmup <n>        untimed runs of each workload first (2)
+        --tolerance <pct>   the least slowdown reported as a regression (5)
+
+    Each workload is a regression if its median throughput fell by more than the tolerance,
+    or by more than three times the noise of the runs if that is greater. The noise is the
+    spread of the runs of the baseline and of the current measurement, each their median
+    absolute deviation relative to the median, scaled to estimate a standard deviation and
+    added in quadrature; a noisy machine widens the threshold rather than failing the gate.
+
+    The input is generated from fixed seeds in memory; nothing is read but the baseline and
+    nothing needs the network. On Linux the process is kept on one processor. A baseline is
+    only meaningful for the machine and the build it was recorded with, so it should be
+    recorded again, and checked in, when either changes.
+
+    Allocations, unlike times, do not depend on the machine, so their ceilings are fixed here
+    rather than recorded: a parse of each corpus may make at most so many allocations per KiB
+    of input.
+
+    The exit code is 0 if no workload regressed, 1 if any did, and 2 if the gate could not run:
+    the baseline is missing or was recorded with another size, the corpus failed to parse, or
+    allocation accounting is not built in.
+*/
+
+namespace {
+
+const boost::uint32_t seed_k = 1;
+
+/*
+    The most allocations per KiB of input a parse of each corpus shape may make, in the order
+    of corpus_shape_t. They were set a tenth above the counts measured when introduced; lower
+    them as allocations are removed, so that the savings are kept.
+*/
+
+const double allocation_ceilings_g[eop::corpus_shape_count_k] = {
+    1910,   // mixed
+    2540,   // templates
+    3420,   // expressions
+    2100,   // statements
+    1580,   // comments
+    2040    // structs
+};
+
+struct statistics_t
+{
+    statistics_t() : median_m(0), spread_m(0) { }
+
+    double median_m; // in MB/s
+    double spread_m; // median absolute deviation over the median
+};
+
+typedef std::map<std::string, statistics_t> statistics_map_t;
+
+double median(std::vector<double> x)
+{
+    std::sort(x.begin(), x.end());
+
+    std::size_t half(x.size() / 2);
+
+    return x.size() % 2 ? x[half] : (x[half - 1] + x[half]) / 2;
+}
+
+statistics_t summarize(const std::vector<double>& rates)
+{
+    statistics_t        result;
+    std::vector<double> deviations;
+
+    result.median_m = median(rates);
+    for (std::size_t n(0); n != rates.size(); ++n)
+        deviations.push_back(std::fabs(rates[n] - result.median_m));
+    if (result.median_m > 0) result.spread_m = median(deviations) / result.median_m;
+    return result;
+}
+
+/*
+    Measures the lexer and the parser over the corpus of each shape. Returns false if a corpus
+    fails to parse - a workload which stops early would look fast.
+*/
+
+bool measure(std::size_t size, std::size_t runs, std::size_t warmup, statistics_map_t& result)
+{
+    eop::parse_options_t options;
+
+    for (std::size_t shape(0); shape != eop::corpus_shape_count_k; ++shape) {
+        eop::corpus_options_t   corpus;
+        std::string             content;
+        std::string             name(eop::corpus_shape_name(eop::corpus_shape_t(shape)));
+
+        corpus.shape_m = eop::corpus_shape_t(shape);
+        corpus.size_m = size;
+        corpus.seed_m = seed_k;
+        eop::generate_corpus(corpus, content);
+
+        std::vector<double> lex_rates;
+        std::vector<double> parse_rates;
+        double              megabytes(double(content.size()) / 1e6);
+
+        for (std::size_t n(0); n != warmup + runs; ++n) {
+            std::size_t         tokens;
+            eop::parse_result_t parse;
+            double              lex_time(eop::time_lex(content, tokens));
+            double              parse_time(eop::time_parse(content, options, parse));
+
+            if (!parse.diagnostics_m.empty()) {
+                std::cerr << "The " << name << " corpus does not parse: "
+                    << parse.diagnostics_m.front().message_m << std::endl;
+                return false;
+            }
+            if (n < warmup) continue;
+            lex_rates.push_back(megabytes / std::max(lex_time, 1e-9));
+            parse_rates.push_back(megabytes / std::max(parse_time, 1e-9));
+        }
+
+        result["lex." + name] = summarize(lex_rates);
+        result["parse." + name] = summarize(parse_rates);
+    }
+    return true;
+}
+
+/*
+    Checks the allocations of a parse of the corpus of each shape against its ceiling, printing
+    a row for each. Returns the number over their ceiling, or -1 if a corpus fails to parse.
+*/
+
+int check_allocations(std::size_t size)
+{
+    int result(0);
+
+    std::printf("%-20s %12s %12s %12s %12s\n", "workload", "allocations", "per KiB", "ceiling",
+        "peak bytes");
+
+    for (std::size_t shape(0); shape != eop::corpus_shape_count_k; ++shape) {
+        eop::corpus_options_t       corpus;
+        std::string                 content;
+        eop::parse_result_t         parse;
+
+        corpus.shape_m = eop::corpus_shape_t(shape);
+        corpus.size_m = size;
+        corpus.seed_m = seed_k;
+        eop::generate_corpus(corpus, content);
+
+        eop::allocation_report_t    report(eop::count_parse_allocations(content,
+                                        eop::parse_options_t(), parse));
+        std::size_t                 count(report.total().count_m);
+        double                      per_kilobyte(double(count) * 1024 / double(content.size()));
+        bool                        over(per_kilobyte > allocation_ceilings_g[shape]);
+
+        if (!parse.diagnostics_m.empty()) {
+            std::cerr << "The " << eop::corpus_shape_name(corpus.shape_m)
+                << " corpus does not parse: " << parse.diagnostics_m.front().message_m
+                << std::endl;
+            return -1;
+        }
+
+        std::printf("%-20s %12lu %12.1f %12.1f %12lu%s\n",
+            ("parse." + std::string(eop::corpus_shape_name(corpus.shape_m))).c_str(),
+            static_cast<unsigned long>(count), per_kilobyte, allocation_ceilings_g[shape],
+            static_cast<unsigned long>(report.peak_m), over ? "  OVER THE CEILING" : "");
+        if (over) ++result;
+    }
+    return result;
+}
+
+/*
+    The baseline is a text file: comment lines starting with "#", the size of the corpora as
+    "size <bytes>", then a line per workload of its name, median MB/s and relative spread.
+*/
+
+bool write_baseline(const char* file, std::size_t size, const statistics_map_t& statistics)
+{
+    std::ofstream out(file);
+
+    out << "# perf_gate baseline: workload, median MB/s, median absolute deviation / median\n"
+        << "size " << size << '\n';
+    for (statistics_map_t::const_iterator first(statistics.begin()); first != statistics.end();
+            ++first) {
+        char buffer[64];
+
+        std::sprintf(buffer, " %.4f %.5f", first->second.median_m, first->second.spread_m);
+        out << first->first << buffer << '\n';
+    }
+    return out.flush().good();
+}
+
+bool read_baseline(const char* file, std::size_t& size, statistics_map_t& statistics)
+{
+    std::ifstream   in(file);
+    std::string     line;
+    bool            sized(false);
+
+    if (!in) return false;
+
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream  fields(line);
+        std::string         name;
+
+        fields >> name;
+        if (name == "size") {
+            sized = bool(fields >> size);
+        } else {
+            statistics_t entry;
+
+            if (!(fields >> entry.median_m >> entry.spread_m)) return false;
+            statistics[name] = entry;
+        }
+    }
+    return sized;
+}
+
+} // namespace
+
+int main (int argc, char * const argv[]) {
+    const char* const*  first(argv + 1);
+    const char* const*  last(argv + argc);
+
+    const char* baseline_file("perf_baseline.txt");
+    bool        recording(false);
+    bool        allocations(false);
+    std::size_t size(256 * 1024);
+    std::size_t runs(11);
+    std::size_t warmup(2);
+    double      tolerance(0.05);
+
+    while (first != last) {
+        std::string option(*first);
+
+        if (option == "--record") { recording = true; ++first; continue; }
+        if (option == "--allocations") { allocations = true; ++first; continue; }
+        if (last - first < 2) break;
+
+        if (option == "--baseline") baseline_file = first[1];
+        else if (option == "--size") size = std::strtoul(first[1], 0, 10);
+        else if (option == "--runs") runs = std::strtoul(first[1], 0, 10);
+        else if (option == "--warmup") warmup = std::strtoul(first[1], 0, 10);
+        else if (option == "--tolerance") tolerance = std::atof(first[1]) / 100;
+        else break;
+
+        first += 2;
+    }
+
+    if (first != last) {
+        std::cerr << "Unknown option " << *first << std::endl;
+        return 2;
+    }
+    if (!runs) runs = 1;
+
+    if (allocations) {
+        if (!eop::allocation_accounting_enabled()) {
+            std::cerr << "Allocation accounting is not built in" << std::endl;
+            return 2;
+        }
+
+        int over(check_allocations(size));
+
+        if (over < 0) return 2;
+        if (over) {
+            std::cout << over << " of " << eop::corpus_shape_count_k
+                << " workloads allocate more than their ceiling" << std::endl;
+            return 1;
+        }
+        std::cout << "No workload allocates more than its ceiling" << std::endl;
+        return 0;
+    }
+
+    std::size_t         baseline_size(0);
+    statistics_map_t    baseline;
+
+    if (!recording) {
+        if (!read_baseline(baseline_file, baseline_size, baseline)) {
+            std::cerr << "Cannot read the baseline " << baseline_file
+                << "; record one with --record" << std::endl;
+            return 2;
+        }
+        if (baseline_size != size) {
+            std::cerr << "The baseline was recorded with --size " << baseline_size << std::endl;
+            return 2;
+        }
+    }
+
+#if defined(__linux__)
+    // Migrations between processors add to the noise; the current one is as good as any.
+    {
+        int cpu(sched_getcpu());
+
+        if (cpu >= 0) {
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+    }
+#endif
+
+    statistics_map_t current;
+
+    if (!measure(size, runs, warmup, current)) return 2;
+
+    if (recording) {
+        if (!write_baseline(baseline_file, size, current)) {
+            std::cerr << "Cannot write " << baseline_file << std::endl;
+            return 2;
+        }
+        std::cout << "Recorded " << current.size() << " workloads in " << baseline_file
+            << std::endl;
+        return 0;
+    }
+
+    std::size_t regressions(0);
+
+    std::printf("%-20s %12s %12s %9s %10s\n", "workload", "base MB/s", "MB/s", "change",
+        "threshold");
+
+    for (statistics_map_t::const_iterator entry(current.begin()); entry != current.end();
+            ++entry) {
+        statistics_map_t::const_iterator base(baseline.find(entry->first));
+
+        if (base == baseline.end() || base->second.median_m <= 0) {
+            std::printf("%-20s %12s %12.2f %9s %10s  not in the baseline\n",
+                entry->first.c_str(), "-", entry->second.median_m, "-", "-");
+            continue;
+        }
+
+        // 1.4826 scales a median absolute deviation to a standard deviation.
+        double noise(1.4826 * std::sqrt(base->second.spread_m * base->second.spread_m
+            + entry->second.spread_m * entry->second.spread_m));
+        double threshold(std::max(tolerance, 3 * noise));
+        double change(entry->second.median_m / base->second.median_m - 1);
+        const char* verdict("");
+
+        if (change < -threshold) { verdict = "  REGRESSION"; ++regressions; }
+        else if (change > threshold) verdict = "  faster; consider recording a new baseline";
+
+        std::printf("%-20s %12.2f %12.2f %+8.1f%% %9.1f%%%s\n", entry->first.c_str(),
+            base->second.median_m, entry->second.median_m, change * 100, threshold * 100,
+            verdict);
+    }
+
+    if (regressions) {
+        std::cout << regressions << " of " << current.size()
+            << " workloads regressed against " << baseline_file << std::endl;
+        return 1;
+    }
+    std::cout << "No regressions against " << baseline_file << std::endl;
+    return 0;
+}